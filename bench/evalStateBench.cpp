@@ -0,0 +1,148 @@
+/**
+* EvalState benchmark
+*
+* Moves random boundary pixels of a grid segmentation of a random image, in
+* batches, and compares the scores of the EvalState updated by the moves with
+* those of a state created from the moved labels (a full recomputation). Exits
+* with 1 if they differ.
+*
+* Usage: ./bin/evalStateBench [num_rows num_cols] [num_batches batch_size]
+*
+* @date October, 2026
+*/
+#include <chrono>
+#include <vector>
+#include "EvalState.h"
+
+//=============================================================================
+// Workload
+//=============================================================================
+// Random color image, num_rows x num_cols
+iftImage *createRandomImage(int num_rows, int num_cols)
+{
+    iftImage *image = iftCreateImage(num_cols, num_rows, 1);
+
+    image->Cb = iftAllocUShortArray(image->n);
+    image->Cr = iftAllocUShortArray(image->n);
+    for (int p = 0; p < image->n; p++)
+    {
+        image->val[p] = rand() % 256;
+        image->Cb[p] = rand() % 256;
+        image->Cr[p] = rand() % 256;
+    }
+    return image;
+}
+
+// Labels of the size x size cells of a grid shifted by offset
+iftImage *createGridLabels(int num_rows, int num_cols, int size, int offset)
+{
+    iftImage *labels = iftCreateImage(num_cols, num_rows, 1);
+    int cols = (num_cols + offset) / size + 1;
+
+    for (int p = 0; p < labels->n; p++)
+        labels->val[p] = ((p / num_cols + offset) / size) * cols + (p % num_cols + offset) / size;
+    return labels;
+}
+
+// Moves random pixels to the label of a random 4-neighbor with another label, updating labels
+int createBoundaryMoves(iftImage *labels, PixelMove *moves, int num_moves)
+{
+    int dx[4] = {-1, 1, 0, 0}, dy[4] = {0, 0, -1, 1}, num = 0;
+
+    while (num < num_moves)
+    {
+        int p = rand() % labels->n, j = rand() % 4;
+        int x = p % labels->xsize + dx[j], y = p / labels->xsize + dy[j];
+
+        if (x < 0 || y < 0 || x >= labels->xsize || y >= labels->ysize)
+            continue;
+
+        int q = y * labels->xsize + x;
+        if (labels->val[q] == labels->val[p])
+            continue;
+
+        moves[num].pixel = p;
+        moves[num].old_label = labels->val[p];
+        moves[num].new_label = labels->val[q];
+        labels->val[p] = labels->val[q];
+        num++;
+    }
+    return num;
+}
+
+double getScoreDifference(EvalScores a, EvalScores b)
+{
+    double scores_a[4] = {a.ev, a.co, a.ue, a.regularity}, scores_b[4] = {b.ev, b.co, b.ue, b.regularity};
+    double diff = fabs((double)a.num_superpixels - b.num_superpixels);
+
+    for (int i = 0; i < 4; i++)
+        diff = iftMax(diff, fabs(scores_a[i] - scores_b[i]) / iftMax(1.0, fabs(scores_b[i])));
+    return diff;
+}
+
+//=============================================================================
+// Main
+//=============================================================================
+int main(int argc, char *argv[])
+{
+    int num_rows = 1000, num_cols = 1000, num_batches = 20, batch_size = 10000;
+    double incremental_ms = 0, full_ms = 0, max_diff = 0;
+
+    if (argc >= 3)
+    {
+        num_rows = atoi(argv[1]);
+        num_cols = atoi(argv[2]);
+    }
+    if (argc >= 5)
+    {
+        num_batches = atoi(argv[3]);
+        batch_size = atoi(argv[4]);
+    }
+    if (num_rows < 2 || num_cols < 2 || num_batches < 1 || batch_size < 1)
+        printError("main", "Usage: evalStateBench [num_rows num_cols] [num_batches batch_size]");
+
+    srand(0);
+    iftImage *image = createRandomImage(num_rows, num_cols);
+    iftImage *labels = createGridLabels(num_rows, num_cols, 20, 0);
+    iftImage *gt = createGridLabels(num_rows, num_cols, 47, 13);
+    std::vector<PixelMove> moves(batch_size);
+    EvalState *state = createEvalState(image, labels, gt);
+
+    printf("%d x %d image, %d batches of %d moves\n", num_rows, num_cols, num_batches, batch_size);
+    for (int b = 0; b < num_batches; b++)
+    {
+        EvalScores incremental, full;
+        EvalState *full_state;
+        int num_moves = createBoundaryMoves(labels, moves.data(), batch_size);
+
+        auto start = std::chrono::steady_clock::now();
+        if (applyEvalStateMoves(state, moves.data(), num_moves) != num_moves)
+            printError("main", "Batch %d: not every move was applied", b);
+        incremental = getEvalStateScores(state);
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+        incremental_ms += elapsed.count();
+
+        start = std::chrono::steady_clock::now();
+        full_state = createEvalState(image, labels, gt);
+        full = getEvalStateScores(full_state);
+        elapsed = std::chrono::steady_clock::now() - start;
+        full_ms += elapsed.count();
+        freeEvalState(&full_state);
+
+        max_diff = iftMax(max_diff, getScoreDifference(incremental, full));
+        if (b == num_batches - 1)
+            printf("scores: EV %.6f, CO %.6f, UE %.6f, regularity %.6f, %d superpixels\n", incremental.ev,
+                   incremental.co, incremental.ue, incremental.regularity, incremental.num_superpixels);
+    }
+
+    printf("%-28s %10.2f ms per batch\n", "incremental", incremental_ms / num_batches);
+    printf("%-28s %10.2f ms per batch\n", "full recomputation", full_ms / num_batches);
+    printf("largest relative difference %.3g\n", max_diff);
+
+    freeEvalState(&state);
+    iftDestroyImage(&image);
+    iftDestroyImage(&labels);
+    iftDestroyImage(&gt);
+
+    return (max_diff > 1e-9) ? 1 : 0;
+}
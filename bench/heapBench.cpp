@@ -0,0 +1,232 @@
+/**
+* Heap microbenchmark
+*
+* Compares PrioQueue, iftDHeap and IndexedHeap on two workloads: sorting random
+* keys (push all, pop all) and an image foresting transform with max-arc path
+* cost on a random image, which is dominated by decrease-key operations.
+*
+* Usage: ./bin/heapBench [num_rows num_cols] [repetitions]
+*
+* @date October, 2026
+*/
+#include <chrono>
+#include <vector>
+#include "PrioQueue.h"
+#include "IndexedHeap.hpp"
+#include "ift.h"
+
+//=============================================================================
+// Workloads
+//=============================================================================
+double sortPrioQueue(std::vector<double> &keys)
+{
+    int n = keys.size();
+    std::vector<double> prio(keys);
+    PrioQueue *queue = createPrioQueue(n, prio.data(), MINVAL_POLICY);
+    double check = 0;
+
+    for (int i = 0; i < n; i++)
+        insertPrioQueue(&queue, i);
+    while (!isPrioQueueEmpty(queue))
+        check += prio[popPrioQueue(&queue)];
+
+    freePrioQueue(&queue);
+    return check;
+}
+
+double sortDHeap(std::vector<double> &keys)
+{
+    int n = keys.size();
+    std::vector<double> prio(keys);
+    iftDHeap *heap = iftCreateDHeap(n, prio.data());
+    double check = 0;
+
+    for (int i = 0; i < n; i++)
+        iftInsertDHeap(heap, i);
+    while (!iftEmptyDHeap(heap))
+        check += prio[iftRemoveDHeap(heap)];
+
+    iftDestroyDHeap(&heap);
+    return check;
+}
+
+double sortIndexedHeap(std::vector<double> &keys)
+{
+    int n = keys.size();
+    IndexedHeap<double> heap(n);
+    double check = 0, key;
+
+    for (int i = 0; i < n; i++)
+        heap.push(i, keys[i]);
+    while (!heap.empty())
+    {
+        heap.pop(&key);
+        check += key;
+    }
+    return check;
+}
+
+// 4-neighborhood IFT from the first pixel of each row, with f_max path cost
+double iftPrioQueue(std::vector<double> &image, int num_rows, int num_cols)
+{
+    int n = num_rows * num_cols, dx[4] = {-1, 1, 0, 0}, dy[4] = {0, 0, -1, 1};
+    std::vector<double> cost(n, INFINITY);
+    PrioQueue *queue = createPrioQueue(n, cost.data(), MINVAL_POLICY);
+    double check = 0;
+
+    for (int r = 0; r < num_rows; r++)
+    {
+        cost[r * num_cols] = 0;
+        insertPrioQueue(&queue, r * num_cols);
+    }
+    while (!isPrioQueueEmpty(queue))
+    {
+        int p = popPrioQueue(&queue), x = p % num_cols, y = p / num_cols;
+
+        check += cost[p];
+        for (int j = 0; j < 4; j++)
+        {
+            int qx = x + dx[j], qy = y + dy[j], q;
+            double arc;
+
+            if (qx < 0 || qy < 0 || qx >= num_cols || qy >= num_rows)
+                continue;
+            q = qy * num_cols + qx;
+            arc = iftMax(cost[p], fabs(image[p] - image[q]));
+            if (queue->state[q] != BLACK_STATE && arc < cost[q])
+            {
+                cost[q] = arc;
+                if (queue->state[q] == GRAY_STATE)
+                    moveIndexUpPrioQueue(&queue, q);
+                else
+                    insertPrioQueue(&queue, q);
+            }
+        }
+    }
+    freePrioQueue(&queue);
+    return check;
+}
+
+double iftDHeapIFT(std::vector<double> &image, int num_rows, int num_cols)
+{
+    int n = num_rows * num_cols, dx[4] = {-1, 1, 0, 0}, dy[4] = {0, 0, -1, 1};
+    std::vector<double> cost(n, INFINITY);
+    iftDHeap *heap = iftCreateDHeap(n, cost.data());
+    double check = 0;
+
+    for (int r = 0; r < num_rows; r++)
+    {
+        cost[r * num_cols] = 0;
+        iftInsertDHeap(heap, r * num_cols);
+    }
+    while (!iftEmptyDHeap(heap))
+    {
+        int p = iftRemoveDHeap(heap), x = p % num_cols, y = p / num_cols;
+
+        check += cost[p];
+        for (int j = 0; j < 4; j++)
+        {
+            int qx = x + dx[j], qy = y + dy[j], q;
+            double arc;
+
+            if (qx < 0 || qy < 0 || qx >= num_cols || qy >= num_rows)
+                continue;
+            q = qy * num_cols + qx;
+            arc = iftMax(cost[p], fabs(image[p] - image[q]));
+            if (heap->color[q] != IFT_BLACK && arc < cost[q])
+            {
+                cost[q] = arc;
+                if (heap->color[q] == IFT_GRAY)
+                    iftGoUpDHeap(heap, heap->pos[q]);
+                else
+                    iftInsertDHeap(heap, q);
+            }
+        }
+    }
+    iftDestroyDHeap(&heap);
+    return check;
+}
+
+double iftIndexedHeap(std::vector<double> &image, int num_rows, int num_cols)
+{
+    int n = num_rows * num_cols, dx[4] = {-1, 1, 0, 0}, dy[4] = {0, 0, -1, 1};
+    IndexedHeap<double> heap(n);
+    double check = 0;
+
+    for (int r = 0; r < num_rows; r++)
+        heap.push(r * num_cols, 0);
+    while (!heap.empty())
+    {
+        double cost;
+        int p = heap.pop(&cost), x = p % num_cols, y = p / num_cols;
+
+        check += cost;
+        for (int j = 0; j < 4; j++)
+        {
+            int qx = x + dx[j], qy = y + dy[j], q;
+            double arc;
+
+            if (qx < 0 || qy < 0 || qx >= num_cols || qy >= num_rows)
+                continue;
+            q = qy * num_cols + qx;
+            arc = iftMax(cost, fabs(image[p] - image[q]));
+            if (heap.getState(q) == WHITE_STATE)
+                heap.push(q, arc);
+            else if (heap.contains(q) && arc < heap.getKey(q))
+                heap.decreaseKey(q, arc);
+        }
+    }
+    return check;
+}
+
+//=============================================================================
+// Main
+//=============================================================================
+template <typename Function>
+void run(const char *name, int repetitions, Function function)
+{
+    double best = INFINITY, check = 0;
+
+    for (int i = 0; i < repetitions; i++)
+    {
+        auto start = std::chrono::steady_clock::now();
+        check = function();
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+        best = iftMin(best, elapsed.count());
+    }
+    printf("%-28s %10.2f ms   (checksum %.6g)\n", name, best, check);
+}
+
+int main(int argc, char *argv[])
+{
+    int num_rows = 1000, num_cols = 1000, repetitions = 5, n;
+
+    if (argc >= 3)
+    {
+        num_rows = atoi(argv[1]);
+        num_cols = atoi(argv[2]);
+    }
+    if (argc >= 4)
+        repetitions = atoi(argv[3]);
+    if (num_rows < 1 || num_cols < 1 || repetitions < 1)
+        printError("main", "Usage: heapBench [num_rows num_cols] [repetitions]");
+
+    n = num_rows * num_cols;
+    std::vector<double> keys(n), image(n);
+    srand(0);
+    for (int i = 0; i < n; i++)
+    {
+        keys[i] = rand() / (double)RAND_MAX;
+        image[i] = rand() % 256;
+    }
+
+    printf("%d x %d elements, best of %d runs\n", num_rows, num_cols, repetitions);
+    run("sort: PrioQueue", repetitions, [&]() { return sortPrioQueue(keys); });
+    run("sort: iftDHeap", repetitions, [&]() { return sortDHeap(keys); });
+    run("sort: IndexedHeap", repetitions, [&]() { return sortIndexedHeap(keys); });
+    run("ift: PrioQueue", repetitions, [&]() { return iftPrioQueue(image, num_rows, num_cols); });
+    run("ift: iftDHeap", repetitions, [&]() { return iftDHeapIFT(image, num_rows, num_cols); });
+    run("ift: IndexedHeap", repetitions, [&]() { return iftIndexedHeap(image, num_rows, num_cols); });
+
+    return 0;
+}
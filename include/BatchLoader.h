@@ -0,0 +1,61 @@
+/**
+* Batch loader
+*
+* Reads whole files in batches into pooled buffers. On Linux the reads of a
+* batch are submitted together through io_uring (raw system calls, no
+* liburing), so up to queue_depth requests are in flight at once; where
+* io_uring is not available (old kernels, seccomp filters, other systems)
+* the files are read one after the other with pread.
+*
+* @date October, 2026
+*/
+#ifndef BATCHLOADER_H
+#define BATCHLOADER_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//=============================================================================
+// Includes
+//=============================================================================
+#include "Utils.h"
+
+//=============================================================================
+// Structures
+//=============================================================================
+typedef struct
+{
+    const char *path; // Set by the caller; NULL entries are skipped
+    const void *data; // Contents, valid until the next batch of the loader
+    size_t size;
+    int error;        // errno of the failed open/read, 0 on success
+} LoadedFile;
+
+typedef struct
+{
+    void *ring; // io_uring queue (NULL: blocking reads)
+    int queue_depth;
+    void **buffers; // Pool: buffer i holds file i of the current batch
+    size_t *capacity;
+    int num_buffers;
+} BatchLoader;
+
+//=============================================================================
+// Constructors & Deconstructors
+//=============================================================================
+BatchLoader *createBatchLoader(int queue_depth);
+void freeBatchLoader(BatchLoader **loader);
+
+//=============================================================================
+// Prototypes
+//=============================================================================
+bool usesIoUring(BatchLoader *loader);
+// Reads the files, replacing the previous batch in the buffers
+void loadFileBatch(BatchLoader *loader, LoadedFile *files, int n);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // BATCHLOADER_H
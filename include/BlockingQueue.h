@@ -0,0 +1,58 @@
+/**
+* Blocking Queue
+*
+* Bounded FIFO of pointers shared by producer and consumer threads. Producers
+* block while the queue holds its maximum number of items or bytes, and
+* consumers block while it is empty, until the queue is closed.
+*
+* @date October, 2026
+*/
+#ifndef BLOCKINGQUEUE_H
+#define BLOCKINGQUEUE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//=============================================================================
+// Includes
+//=============================================================================
+#include "Utils.h"
+#include <pthread.h>
+
+//=============================================================================
+// Structures
+//=============================================================================
+typedef struct
+{
+    void **item;
+    size_t *bytes;         // Size declared for each item
+    int capacity, first, count;
+    size_t total_bytes, max_bytes; // max_bytes = 0: no memory cap
+    bool closed;
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty, not_full;
+} BlockingQueue;
+
+//=============================================================================
+// Constructors & Deconstructors
+//=============================================================================
+BlockingQueue *createBlockingQueue(int capacity, size_t max_bytes);
+void freeBlockingQueue(BlockingQueue **queue); // The remaining items are not freed
+
+//=============================================================================
+// Prototypes
+//=============================================================================
+// Blocks until there is room for the item. An item is always accepted by an
+// empty queue, even if it exceeds max_bytes. Returns false if the queue is closed
+bool pushBlockingQueue(BlockingQueue *queue, void *item, size_t bytes);
+// Blocks until there is an item. Returns NULL if the queue is closed and empty
+void *popBlockingQueue(BlockingQueue *queue);
+// Wakes all the waiting threads: pushes fail and pops drain the remaining items
+void closeBlockingQueue(BlockingQueue *queue);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // BLOCKINGQUEUE_H
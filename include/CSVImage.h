@@ -0,0 +1,39 @@
+/**
+* CSV image
+*
+* Label maps written as CSV: one image row per line, comma-separated integer
+* labels (optionally negative, surrounded by blanks, with \n or \r\n line
+* ends). The file is mapped and split into blocks of whole lines, whose line
+* ends are counted with SIMD byte scans; the blocks are then parsed in
+* parallel straight into the image, each line checked against the number of
+* columns of the first one.
+*
+* @date October, 2026
+*/
+#ifndef CSVIMAGE_H
+#define CSVIMAGE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//=============================================================================
+// Includes
+//=============================================================================
+#include "Utils.h"
+#include "ift.h"
+
+//=============================================================================
+// Prototypes
+//=============================================================================
+// The first line gives xsize and the number of lines gives ysize. Exits with
+// the line number on malformed values or lines with another number of columns
+iftImage *readCSVLabels(const char *path);
+// Same, for CSV text already in memory; name is only used in error messages
+iftImage *parseCSVLabels(const char *buf, size_t size, const char *name);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // CSVIMAGE_H
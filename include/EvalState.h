@@ -0,0 +1,96 @@
+/**
+* Incremental evaluation state
+*
+* Keeps per-superpixel statistics of a label map so that EV, CO, UE and the
+* area regularity can be updated while pixels move between superpixels,
+* without re-scanning the whole image.
+*
+* @date October, 2026
+*/
+#ifndef EVALSTATE_H
+#define EVALSTATE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//=============================================================================
+// Includes
+//=============================================================================
+#include "Utils.h"
+#include "ift.h"
+
+//=============================================================================
+// Structures
+//=============================================================================
+typedef struct
+{
+    int pixel, old_label, new_label;
+} PixelMove;
+
+typedef struct
+{
+    // A score is -1 when the state was created without the data it needs
+    // (image for EV, ground-truth for UE)
+    double ev, co, ue, regularity;
+    int num_superpixels;
+} EvalScores;
+
+// Ground-truth segments intersected by a superpixel (few, so a list instead of a
+// superpixel x segment table), with their number of pixels
+typedef struct
+{
+    int *segments, *counts;
+    int num_segments, capacity;
+    int max_count; // Stale while the superpixel is dirty
+} LabelIntersection;
+
+typedef struct
+{
+    int num_rows, num_cols, num_pixels, num_valid_pixels;
+    int num_labels, capacity; // Labels are within [0, num_labels)
+    int *labels;              // Own copy of the label map (-1 = ignored pixel)
+
+    // Area (EV, CO and regularity)
+    int *area;
+    int num_nonempty;
+    double mean_area, sq_dev_area; // Running (Welford) mean and sum of squared deviations of the nonempty areas
+
+    // Explained variation
+    const iftImage *image;
+    double *sum_color;        // sum_color[label * 3 + channel], centered on overall_mean
+    double overall_mean[3], sum_top, sum_bottom;
+
+    // Compactness
+    int *perimeter;
+    double sum_compactness;
+
+    // Undersegmentation error
+    int num_gt_segments;
+    int *gt;                  // Dense ground-truth segment of each pixel
+    LabelIntersection *intersections;
+    bool *dirty;              // Max intersection must be recomputed
+    int *dirty_list, num_dirty;
+    double sum_max_intersection;
+} EvalState;
+
+//=============================================================================
+// Constructors & Deconstructors
+//=============================================================================
+// image and gt are optional (NULL); image must outlive the state
+EvalState *createEvalState(const iftImage *image, const iftImage *labels, const iftImage *gt);
+void freeEvalState(EvalState **state);
+
+//=============================================================================
+// Prototypes
+//=============================================================================
+// Returns the number of moves applied. Moves whose old label does not match
+// the current label of the pixel, or involving negative labels, are skipped
+int applyEvalStateMoves(EvalState *state, const PixelMove *moves, int num_moves);
+EvalScores getEvalStateScores(EvalState *state);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // EVALSTATE_H
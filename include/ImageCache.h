@@ -0,0 +1,63 @@
+/**
+* Image cache
+*
+* Decoded images kept between the requests of a long-running process, keyed
+* by a string (e.g. their path). Insertions never evict, so the images of
+* the current request stay valid; trimImageCache then drops the least
+* recently used ones until the cache fits its memory cap. Not thread-safe.
+*
+* @date October, 2026
+*/
+#ifndef IMAGECACHE_H
+#define IMAGECACHE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//=============================================================================
+// Includes
+//=============================================================================
+#include "Utils.h"
+#include "ift.h"
+
+//=============================================================================
+// Structures
+//=============================================================================
+typedef struct
+{
+    char *key;
+    iftImage *img;
+    size_t bytes;
+    long last_use;
+} CachedImage;
+
+typedef struct
+{
+    CachedImage *entries;
+    int num_entries, capacity;
+    size_t bytes, max_bytes; // max_bytes = 0: no cap
+    long clock;
+    long hits, misses;
+} ImageCache;
+
+//=============================================================================
+// Constructors & Deconstructors
+//=============================================================================
+ImageCache *createImageCache(size_t max_bytes);
+void freeImageCache(ImageCache **cache);
+
+//=============================================================================
+// Prototypes
+//=============================================================================
+// Cached image of key (NULL on a miss), owned by the cache
+iftImage *getCachedImage(ImageCache *cache, const char *key);
+// Caches img, which is then owned by the cache
+void putCachedImage(ImageCache *cache, const char *key, iftImage *img);
+void trimImageCache(ImageCache *cache);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // IMAGECACHE_H
@@ -0,0 +1,61 @@
+/**
+* Image Writer
+*
+* Pool of background threads that encode and write output images, so the
+* evaluation does not wait for the PNG compression. The writer takes
+* ownership of the submitted buffers; submissions block while the queue is
+* full (backpressure).
+*
+* @date October, 2026
+*/
+#ifndef IMAGEWRITER_H
+#define IMAGEWRITER_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//=============================================================================
+// Includes
+//=============================================================================
+#include "Utils.h"
+#include "BlockingQueue.h"
+#include "ift.h"
+
+//=============================================================================
+// Structures
+//=============================================================================
+typedef void (*WriteFunction)(void *data, const char *path); // Writes the data and frees it
+
+typedef struct
+{
+    BlockingQueue *queue;
+    pthread_t *threads;
+    int num_threads;
+    char **written; // Paths to fsync at shutdown
+    int num_written, max_written;
+    pthread_mutex_t lock;
+} ImageWriter;
+
+//=============================================================================
+// Constructors & Deconstructors
+//=============================================================================
+// Up to capacity images (and max_bytes bytes, if positive) wait to be written
+ImageWriter *createImageWriter(int num_threads, int capacity, size_t max_bytes);
+// Writes the pending images, waits for the threads and fsyncs the written files
+void freeImageWriter(ImageWriter **writer);
+
+//=============================================================================
+// Prototypes
+//=============================================================================
+// The writer owns data until write frees it. With a NULL writer, data is
+// written right away
+void submitWriteJob(ImageWriter *writer, void *data, WriteFunction write, const char *path, size_t bytes);
+// iftWriteImageByExt in the background; *img is moved to the writer (set to NULL)
+void writeImageAsync(ImageWriter *writer, iftImage **img, const char *path);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // IMAGEWRITER_H
@@ -0,0 +1,205 @@
+/**
+* Indexed d-ary heap
+*
+* Header-only priority queue of element indices in [0, size). Unlike PrioQueue
+* and iftDHeap, each heap node stores its key inline, so comparisons do not
+* load priorities from an external array. Ties are broken by the smaller
+* index, so the removal order does not depend on the insertion order.
+*
+* @date October, 2026
+*/
+#ifndef INDEXEDHEAP_HPP
+#define INDEXEDHEAP_HPP
+
+//=============================================================================
+// Includes
+//=============================================================================
+#include <algorithm>
+#include <vector>
+#include "PrioQueue.h" // RemPolicy and ElemState
+
+//=============================================================================
+// Structures
+//=============================================================================
+template <typename Key, RemPolicy Policy = MINVAL_POLICY, int Arity = 4>
+class IndexedHeap
+{
+public:
+    explicit IndexedHeap(int size) : nodes(size), pos(size, -1), state(size, WHITE_STATE), num_nodes(0) {}
+
+    int capacity() const { return (int)pos.size(); }
+    int size() const { return num_nodes; }
+    bool empty() const { return num_nodes == 0; }
+    bool full() const { return num_nodes == capacity(); }
+
+    ElemState getState(int index) const { return state[index]; }
+    bool contains(int index) const { return state[index] == GRAY_STATE; }
+    Key getKey(int index) const { return nodes[pos[index]].key; } // Only for elements in the heap
+
+    int top() const { return nodes[0].index; }
+    Key topKey() const { return nodes[0].key; }
+
+    bool push(int index, Key key)
+    {
+        if (full() || contains(index))
+        {
+            printWarning("IndexedHeap::push", "The heap is full or already contains the element");
+            return false;
+        }
+
+        state[index] = GRAY_STATE;
+        nodes[num_nodes].key = key;
+        nodes[num_nodes].index = index;
+        pos[index] = num_nodes;
+        moveUp(num_nodes++);
+        return true;
+    }
+
+    int pop(Key *key = NULL)
+    {
+        int index;
+
+        if (empty())
+        {
+            printWarning("IndexedHeap::pop", "The heap is empty");
+            return -1;
+        }
+
+        index = nodes[0].index;
+        if (key != NULL)
+            *key = nodes[0].key;
+
+        pos[index] = -1;
+        state[index] = BLACK_STATE; // Orderly removed
+
+        if (--num_nodes > 0)
+        {
+            nodes[0] = nodes[num_nodes];
+            pos[nodes[0].index] = 0;
+            moveDown(0);
+        }
+        return index;
+    }
+
+    // Any direction; decreaseKey/increaseKey skip the comparison with the old key
+    void updateKey(int index, Key key)
+    {
+        Key old_key = nodes[pos[index]].key;
+
+        if (key < old_key)
+            decreaseKey(index, key);
+        else
+            increaseKey(index, key);
+    }
+
+    void decreaseKey(int index, Key key)
+    {
+        nodes[pos[index]].key = key;
+        if (Policy == MINVAL_POLICY)
+            moveUp(pos[index]);
+        else
+            moveDown(pos[index]);
+    }
+
+    void increaseKey(int index, Key key)
+    {
+        nodes[pos[index]].key = key;
+        if (Policy == MINVAL_POLICY)
+            moveDown(pos[index]);
+        else
+            moveUp(pos[index]);
+    }
+
+    // Non-orderly removal: the element may be pushed again
+    void remove(int index)
+    {
+        int p = pos[index];
+
+        pos[index] = -1;
+        state[index] = WHITE_STATE;
+
+        if (p != --num_nodes)
+        {
+            int moved = nodes[num_nodes].index;
+
+            nodes[p] = nodes[num_nodes];
+            pos[moved] = p;
+            moveUp(p);
+            moveDown(pos[moved]); // No-op if it moved up
+        }
+    }
+
+    void reset()
+    {
+        for (int i = 0; i < num_nodes; i++)
+            pos[nodes[i].index] = -1;
+        std::fill(state.begin(), state.end(), WHITE_STATE);
+        num_nodes = 0;
+    }
+
+private:
+    typedef struct
+    {
+        Key key;
+        int index;
+    } Node;
+
+    std::vector<Node> nodes;
+    std::vector<int> pos;        // Position in the heap (-1 if not in it)
+    std::vector<ElemState> state;
+    int num_nodes;
+
+    static bool precedes(const Node &a, const Node &b)
+    {
+        if (a.key == b.key)
+            return a.index < b.index;
+        return (Policy == MINVAL_POLICY) ? a.key < b.key : a.key > b.key;
+    }
+
+    void moveUp(int p)
+    {
+        Node node = nodes[p];
+
+        while (p > 0)
+        {
+            int father = (p - 1) / Arity;
+
+            if (!precedes(node, nodes[father]))
+                break;
+            nodes[p] = nodes[father];
+            pos[nodes[p].index] = p;
+            p = father;
+        }
+        nodes[p] = node;
+        pos[node.index] = p;
+    }
+
+    void moveDown(int p)
+    {
+        Node node = nodes[p];
+
+        while (true)
+        {
+            int first = Arity * p + 1, last, best;
+
+            if (first >= num_nodes)
+                break;
+
+            last = (first + Arity < num_nodes) ? first + Arity : num_nodes;
+            best = first;
+            for (int son = first + 1; son < last; son++)
+                if (precedes(nodes[son], nodes[best]))
+                    best = son;
+
+            if (!precedes(nodes[best], node))
+                break;
+            nodes[p] = nodes[best];
+            pos[nodes[p].index] = p;
+            p = best;
+        }
+        nodes[p] = node;
+        pos[node.index] = p;
+    }
+};
+
+#endif // INDEXEDHEAP_HPP
@@ -0,0 +1,84 @@
+/**
+* Job spec
+*
+* INI description of an evaluation campaign (methods x K values x datasets
+* x metrics), run by "main job <spec.ini>":
+*
+*   [eval]
+*   metrics = 1,3,5            ; --eval list
+*   k = 100, 200               ; optional, substituted for {k}
+*   log = campaign.txt         ; means of each (dataset, method, K)
+*   dlog = campaign_images.txt ; optional, one row per label map
+*   threads = 4                ; optional, 0 = one per core (default)
+*   buckets = 16               ; any other key is passed as --<key> <value>
+*
+*   [dataset bsds]
+*   img = ./bsds/images
+*   gt = ./bsds/gts            ; optional
+*
+*   [method slic]
+*   labels = ./results/slic/{dataset}/{k}
+*   ext = pgm
+*
+* Paths may use {dataset}, {method} and {k}. Comments start with a ; or #
+* at the start of a line or after a blank, so paths may contain both.
+*
+* @date October, 2026
+*/
+#ifndef JOBSPEC_H
+#define JOBSPEC_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//=============================================================================
+// Includes
+//=============================================================================
+#include "Utils.h"
+
+//=============================================================================
+// Structures
+//=============================================================================
+typedef struct
+{
+    char *name, *img, *gt; // gt = NULL if not given
+} JobDataset;
+
+typedef struct
+{
+    char *name, *labels, *ext;
+} JobMethod;
+
+typedef struct
+{
+    char *metrics, *log, *dlog;
+    int threads;
+    char **ks; // num_ks = 0: {k} is not used
+    int num_ks;
+    char **options; // Other [eval] keys, as "--key", "value" pairs
+    int num_options;
+    JobDataset *datasets;
+    int num_datasets;
+    JobMethod *methods;
+    int num_methods;
+} JobSpec;
+
+//=============================================================================
+// Constructors & Deconstructors
+//=============================================================================
+// Exits with the line of the first error
+JobSpec *readJobSpec(const char *path);
+void freeJobSpec(JobSpec **spec);
+
+//=============================================================================
+// Prototypes
+//=============================================================================
+// pattern with {dataset}, {method} and {k} replaced (k may be NULL)
+void expandJobPath(const char *pattern, const char *dataset, const char *method, const char *k, char *output, size_t size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // JOBSPEC_H
@@ -0,0 +1,68 @@
+/**
+* Label file
+*
+* Native compressed container for label maps (.lbl). The header stores the
+* dimensions, the label width (1, 2 or 4 bytes, after subtracting the minimum
+* label) and the number K of distinct labels. The rows are split into blocks,
+* each compressed independently (run-length coding of the rows followed by a
+* LZ77 pass) and located by a block index, so any row range can be decoded
+* alone and the blocks are encoded/decoded in parallel.
+*
+* Layout (little-endian): "LBL1", xsize, ysize, zsize (int32), width (uint8),
+* 3 reserved bytes, min_label, K, rows_per_block, num_blocks (int32), the
+* block index (offset uint64, size uint32, raw_size uint32 per block) and the
+* block payloads.
+*
+* @date October, 2026
+*/
+#ifndef LABELFILE_H
+#define LABELFILE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//=============================================================================
+// Includes
+//=============================================================================
+#include "Utils.h"
+#include "ift.h"
+
+//=============================================================================
+// Structures
+//=============================================================================
+typedef struct
+{
+    unsigned long long offset; // From the beginning of the file
+    unsigned int size, raw_size; // Compressed and run-length coded sizes
+} LabelBlock;
+
+typedef struct
+{
+    FILE *fp;
+    int xsize, ysize, zsize, width;
+    int min_label, num_labels;
+    int rows_per_block, num_blocks; // Rows of all the slices, in raster order
+    LabelBlock *index;
+} LabelFile;
+
+//=============================================================================
+// Constructors & Deconstructors
+//=============================================================================
+LabelFile *openLabelFile(const char *path); // Reads only the header and the block index
+void closeLabelFile(LabelFile **file);
+
+//=============================================================================
+// Prototypes
+//=============================================================================
+void writeLabelFile(const iftImage *labels, const char *path);
+iftImage *readLabelFile(const char *path);
+// Decodes rows first .. first + num_rows - 1 (over all the slices) into
+// labels, with xsize values per row
+void readLabelFileRows(LabelFile *file, int first, int num_rows, int *labels);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // LABELFILE_H
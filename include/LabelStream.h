@@ -0,0 +1,51 @@
+/**
+* Label stream
+*
+* Framed label maps sent through a pipe, FIFO or socket, so a segmentation
+* job can hand its output to the evaluation without encoding an image file.
+* Each frame is a 24-byte header followed by the image id and the raw labels
+* in raster order (little-endian):
+*
+*   "LBLF", width (uint8: 1 or 2 = unsigned, 4 = signed int32), 3 reserved
+*   bytes, xsize, ysize, zsize, id length (uint32), id, labels
+*
+* The id names the image in --img (with or without its extension). A frame
+* may also be passed in a POSIX shared memory object.
+*
+* @date October, 2026
+*/
+#ifndef LABELSTREAM_H
+#define LABELSTREAM_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//=============================================================================
+// Includes
+//=============================================================================
+#include "Utils.h"
+#include "ift.h"
+
+#define LABEL_FRAME_MAGIC "LBLF"
+#define LABEL_FRAME_HEADER 24
+
+//=============================================================================
+// Prototypes
+//=============================================================================
+// Reads the next frame into a new image. Returns false at the end of the
+// stream; exits on a truncated or invalid frame
+bool readLabelFrame(FILE *fp, char *id, size_t id_size, iftImage **labels);
+// Frame in memory; false if it is invalid or truncated
+bool parseLabelFrame(const void *buf, size_t size, char *id, size_t id_size, iftImage **labels);
+// Frame written to the POSIX shared memory object name (e.g. by the client of
+// a daemon); false if there is no such object or its frame is invalid
+bool readSharedLabelFrame(const char *name, char *id, size_t id_size, iftImage **labels);
+// Writes labels at the smallest width that holds them
+void writeLabelFrame(FILE *fp, const char *id, iftImage *labels);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // LABELSTREAM_H
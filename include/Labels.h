@@ -0,0 +1,61 @@
+/**
+* Label maps
+*
+* Compaction of arbitrary (sparse, hashed or non-contiguous) label values to
+* a dense 0..K-1 range, so per-superpixel arrays can be sized by K, and a
+* label-sorted pixel index to visit the pixels of each superpixel.
+*
+* @date October, 2026
+*/
+#ifndef LABELS_H
+#define LABELS_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//=============================================================================
+// Includes
+//=============================================================================
+#include "Utils.h"
+#include "ift.h"
+
+//=============================================================================
+// Structures
+//=============================================================================
+// Pixels of each label in compressed sparse row layout: the pixels of label l
+// are pixels[offsets[l]] ... pixels[offsets[l + 1] - 1], in raster order.
+// Negative labels are left out
+typedef struct
+{
+    int num_labels, num_pixels;
+    int *offsets; // num_labels + 1 entries
+    int *pixels;
+} LabelIndex;
+
+//=============================================================================
+// Constructors & Deconstructors
+//=============================================================================
+LabelIndex *createLabelIndex(iftImage *labels); // Parallel counting sort
+void freeLabelIndex(LabelIndex **index);
+
+//=============================================================================
+// Prototypes
+//=============================================================================
+// Maps the non-negative labels to 0..K-1, preserving their order; negative
+// labels (filtered pixels) become -1. Returns the original label of each
+// dense label, and K in num_labels
+int *compactLabelArray(int *labels, int n, int *num_labels);
+int *compactLabels(iftImage *labels, int *num_labels);
+// Gives each region of labels (e.g. relabeled or merged from the dense map
+// of compactLabels) the original id of the dense label under its first pixel,
+// unless an earlier region took it; the others get ids unused by orig_labels.
+// Negative labels are kept
+void restoreLabelIds(iftImage *labels, const iftImage *dense, const int *orig_labels, int num_labels);
+int getLabelSize(LabelIndex *index, int label);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // LABELS_H
@@ -0,0 +1,83 @@
+/**
+* Manifest
+*
+* CSV list of the inputs of an evaluation, read in chunks instead of
+* listing and sorting a directory. The first line names the columns, in
+* any order:
+*
+*   id,image,labels,gt,recon,imgScores
+*   100007,bsds/test/100007.jpg,slic/test/100007.png,gts/100007.pgm,,
+*
+* labels is required; the others are optional and may be left empty in a
+* row. id names the row in the logs (the stem of image, or of labels, by
+* default) and may not contain blanks; recon and imgScores are output
+* files of the row. Fields are not quoted, and lines starting with # are
+* skipped.
+*
+* @date October, 2026
+*/
+#ifndef MANIFEST_H
+#define MANIFEST_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//=============================================================================
+// Includes
+//=============================================================================
+#include "Utils.h"
+
+//=============================================================================
+// Definitions
+//=============================================================================
+#define MANIFEST_ID 0
+#define MANIFEST_IMAGE 1
+#define MANIFEST_LABELS 2
+#define MANIFEST_GT 3
+#define MANIFEST_RECON 4
+#define MANIFEST_SCORES 5
+#define MANIFEST_COLUMNS 6
+
+//=============================================================================
+// Structures
+//=============================================================================
+typedef struct
+{
+    char id[255];
+    char *image, *labels, *gt, *recon, *imgScores; // NULL if the column is absent or empty
+    long line;
+} ManifestEntry;
+
+typedef struct
+{
+    FILE *fp;
+    char *path;
+    int fields[MANIFEST_COLUMNS]; // Field of each column in a line, -1 if absent
+    int num_fields;
+    long line;
+    char *buf; // getline buffer
+    size_t buf_size;
+} Manifest;
+
+//=============================================================================
+// Constructors & Deconstructors
+//=============================================================================
+// Opens path and reads its header (exits if it is invalid)
+Manifest *openManifest(const char *path);
+void closeManifest(Manifest **manifest);
+
+//=============================================================================
+// Prototypes
+//=============================================================================
+// Reads the next (at most) max_entries rows into entries, returning their number (0 at the end). Exits
+// with the line of the first invalid row
+int readManifestChunk(Manifest *manifest, ManifestEntry *entries, int max_entries);
+// Frees the paths of the entries read by readManifestChunk
+void clearManifestEntries(ManifestEntry *entries, int num_entries);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // MANIFEST_H
@@ -0,0 +1,70 @@
+/**
+* Mapped Image
+*
+* Memory-mapped binary PGM (P5) and PPM (P6) images. Opening one parses the
+* header and maps the file: the pixel payload is a read-only view of the
+* samples, without copies. The iftImage layout (int values, plus ushort
+* Cb/Cr planes for color) is only built when a consumer asks for it.
+*
+* @date October, 2026
+*/
+#ifndef MAPPEDIMAGE_H
+#define MAPPEDIMAGE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//=============================================================================
+// Includes
+//=============================================================================
+#include "Utils.h"
+#include "ift.h"
+
+//=============================================================================
+// Structures
+//=============================================================================
+typedef struct
+{
+    void *map; // NULL for views of a caller buffer
+    size_t map_size;
+    const unsigned char *data; // Pixel payload: channels * bytes samples per pixel
+    int xsize, ysize, n;
+    int channels;       // 1 (P5) or 3 (P6)
+    int bytes, max_val; // 1 or 2 bytes (big-endian) per sample
+    iftImage *image;    // Widened image, built on demand
+} MappedImage;
+
+//=============================================================================
+// Constructors & Deconstructors
+//=============================================================================
+MappedImage *openMappedImage(const char *path); // NULL if it is not a binary PGM/PPM
+// View of a PGM/PPM file already in memory (NULL if it is not binary or is
+// truncated); buf must outlive it
+MappedImage *openMappedImageBuffer(const void *buf, size_t size);
+void closeMappedImage(MappedImage **img);       // Also frees the widened image
+
+//=============================================================================
+// Prototypes
+//=============================================================================
+// Sample of channel c of pixel p, straight from the mapped file
+static inline int getMappedSample(const MappedImage *img, int p, int c)
+{
+    size_t i = (size_t)p * img->channels + c;
+
+    if (img->bytes == 1)
+        return img->data[i];
+    return (img->data[2 * i] << 8) | img->data[2 * i + 1];
+}
+
+// The image in the iftImage layout (YCbCr for PPM, as iftReadImageP6). It is
+// built in parallel on the first call and owned by img
+iftImage *getMappedIftImage(MappedImage *img);
+// Same, but the caller owns the image; img is closed (unmapped)
+iftImage *takeMappedIftImage(MappedImage **img);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // MAPPEDIMAGE_H
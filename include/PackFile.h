@@ -0,0 +1,86 @@
+/**
+* Pack file
+*
+* Single-file container of a dataset (.pak): the images, ground-truths and
+* label maps of any number of methods/K values, each stored under a section
+* name (e.g. "img", "gt", "SLIC/200") and the original file name. Entries
+* hold the decoded iftImage planes, each at its smallest width (1, 2 or 4
+* bytes after subtracting the minimum), so reading one is a parallel widening
+* from the memory-mapped file, without per-file open/stat or decoding.
+*
+* Layout (little-endian): a 64-byte header ("PAK1", version, number of
+* entries, index offset and size), the entries, each aligned to
+* PACK_ALIGNMENT bytes with its planes aligned to 64 bytes, and the index
+* at the end. Appending writes the new entries and a new index after the
+* old one, and only then points the header at it, so an interrupted append
+* leaves the previous pack intact. An entry added again under the same
+* section and stem replaces the indexed one.
+*
+* @date October, 2026
+*/
+#ifndef PACKFILE_H
+#define PACKFILE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//=============================================================================
+// Includes
+//=============================================================================
+#include "Utils.h"
+#include "ift.h"
+#include <stdint.h>
+
+#define PACK_ALIGNMENT 4096
+
+//=============================================================================
+// Structures
+//=============================================================================
+typedef struct
+{
+    char *section, *name; // e.g. "gt" and "im1.pgm"
+    uint64_t offset, size;
+    int xsize, ysize, zsize;
+    float dx, dy, dz;
+    int num_planes;            // 1 (val) or 3 (val, Cb, Cr)
+    int width[3], min_val[3];  // Stored value = value - min_val, in width bytes
+    uint64_t plane_offset[3];  // Relative to offset
+} PackEntry;
+
+typedef struct
+{
+    int fd;
+    bool writable;
+    void *map; // Read mode: the whole file
+    size_t map_size;
+    uint64_t end; // Write mode: end of the written data
+    int num_entries, capacity;
+    PackEntry *entries;  // Sorted by (section, name) in read mode
+    int *table, table_size; // Hash of (section, stem) -> entry, -1 = empty
+} PackFile;
+
+//=============================================================================
+// Constructors & Deconstructors
+//=============================================================================
+PackFile *openPackFile(const char *path);   // Read-only, mapped
+PackFile *appendPackFile(const char *path); // Creates the pack if it does not exist
+void closePackFile(PackFile **pack);        // Write mode: writes the index and the header
+
+//=============================================================================
+// Prototypes
+//=============================================================================
+// Entry of the file with the given stem (name without extension), or NULL
+PackEntry *findPackEntry(PackFile *pack, const char *section, const char *stem);
+// First entry of a section, with its number of entries in count (sorted by name)
+PackEntry *findPackSection(PackFile *pack, const char *section, int *count);
+iftImage *readPackImage(PackFile *pack, PackEntry *entry);
+
+// Write mode. Adds img as section/name, replacing an entry with the same stem
+void addPackImage(PackFile *pack, const char *section, const char *name, iftImage *img);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // PACKFILE_H
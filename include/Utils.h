@@ -19,13 +19,46 @@ extern "C" {
 #include <stdarg.h>
 #include <stdbool.h>
 #include <math.h>
+#include <setjmp.h>
     
+//=============================================================================
+// Structures
+//=============================================================================
+// Recovers from the errors of a call that would exit the program, e.g. decoding an input sent by a
+// client. After setjmp(trap.env) returns 0, setErrorTrap(&trap) makes the next printError or
+// iftError of the calling thread (outside of the parallel regions opened after it) clear the trap
+// and jump back with setjmp returning 1 and the error in message. Traps nest: clearing one restores
+// the trap set before it. Before jumping, the cleanups registered by the failed call (see
+// pushErrorCleanup) are run in reverse order; anything else it allocated is leaked
+#define MAX_ERROR_CLEANUPS 16
+typedef void (*ErrorCleanup)(void *ref); // Releases the resource held by the variable at ref
+
+typedef struct ErrorTrap
+{
+    jmp_buf env;
+    int level; // OpenMP nesting level of setErrorTrap
+    char message[512];
+    struct ErrorTrap *outer; // Trap of the thread when this one was set
+    ErrorCleanup cleanups[MAX_ERROR_CLEANUPS];
+    void *refs[MAX_ERROR_CLEANUPS];
+    int num_cleanups; // May exceed MAX_ERROR_CLEANUPS; the extra ones are not run
+} ErrorTrap;
+
 //=============================================================================
 // Prototypes
 //=============================================================================
-void printError(const char* function_name, const char* message, ...); // Exits the program
+void printError(const char* function_name, const char* message, ...); // Exits the program, or jumps to the error trap
 void printWarning(const char* function_name, const char* message, ...);
 char *parseArgs(char *argv[], int argc, const char *stringKey);
+void setErrorTrap(ErrorTrap *trap); // NULL clears the trap of the calling thread, restoring its outer trap
+void trapError(const char *function_name, const char *message); // Returns only if there is no trap
+// Registers, in the trap of the calling thread (if any, at this OpenMP level), the release of the
+// resource in the variable at ref; popErrorCleanup unregisters the last one once the call that
+// could fail is done. ref must stay valid until then, so it is usually the address of a local
+void pushErrorCleanup(ErrorCleanup cleanup, void *ref);
+void popErrorCleanup(void);
+void freeOnError(void *ref); // ErrorCleanup of malloc memory: free(*(void **)ref)
+void closeOnError(void *ref); // ErrorCleanup of a FILE *: fclose(*(FILE **)ref) unless NULL
 
 #ifdef __cplusplus
 }
@@ -120,6 +120,7 @@ void iftDestroyFloatArray(iftFloatArray **darr);
 #include <assert.h>
 #include <ctype.h>
 #include <dirent.h>
+#include <errno.h>
 #include <float.h>
 #include <libgen.h>
 #include <limits.h>
@@ -390,6 +391,9 @@ typedef struct ift_image {
 } iftImage;
 
 iftImage *iftReadImageByExt(const char *filename, ...);
+// Decodes a file already read into memory (png, jpg, binary pgm/ppm and csv);
+// NULL for the other formats, which are only read from the file
+iftImage *iftReadImageBufferByExt(const char *filename, const void *buf, size_t size);
 iftImage *iftCreateImage(int xsize, int ysize, int zsize);
 iftImage *iftCopyImage(const iftImage *img);
 void iftDestroyImage(iftImage **img);
@@ -408,6 +412,8 @@ iftBoundingBox iftMinBoundingBox(const iftImage *img, iftVoxel *gc_out);
 iftImage *iftReadImage(const char *filename, ...);
 iftImage* iftReadImagePNG(const char* format, ...);
 iftImage* iftReadImageJPEG(const char* format, ...);
+iftImage *iftReadImagePNGFile(FILE *fp, const char *filename); // From an open stream (e.g. fmemopen)
+iftImage *iftReadImageJPEGFile(FILE *infile);
 iftImage *iftReadImageP5(const char *filename, ...);
 iftImage *iftReadImageP6(const char *filename, ...);
 iftImage *iftReadImageP2(const char *filename, ...);
@@ -417,7 +423,9 @@ void iftWriteImage(const iftImage *img, const char *filename, ...);
 void iftWriteImageP5(const iftImage *img, const char *filename, ...);
 void iftWriteImageP6(const iftImage *img, const char *filename, ...);
 void iftWriteImageP2(const iftImage *img, const char *filename, ...);
+void iftSetPGMAscii(bool ascii); // iftWriteImageByExt writes .pgm as P2 instead of binary P5
 void iftWriteImagePNG(const iftImage* img, const char* format, ...);
+void iftSetPNGCompression(int level); // -1: libpng (default); 0..9: parallel encoder, where 0 stores unfiltered rows
 void iftWriteImageJPEG(const iftImage* img, const char* format, ...);
 
 int iftMaximumValueInRegion(const iftImage *img, iftBoundingBox bb);
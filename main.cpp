@@ -4,10 +4,22 @@
 #include <opencv2/highgui.hpp>
 #include <iostream>
 #include <vector>
+#include <algorithm>
 // #include "Eval.h"
 
 #include "PrioQueue.h"
+#include "IndexedHeap.hpp"
 #include "Image.h"
+#include "Labels.h"
+#include "BlockingQueue.h"
+#include "LabelStream.h"
+#include "ImageCache.h"
+#include "JobSpec.h"
+#include "Manifest.h"
+#include "ImageWriter.h"
+#include "CSVImage.h"
+#include "PackFile.h"
+#include "BatchLoader.h"
 #include "Utils.h"
 #include <stdio.h>
 #include <stdlib.h>
@@ -15,6 +27,13 @@
 #include <stdbool.h>
 #include <math.h>
 #include <time.h>
+#include <omp.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#include <sys/socket.h>
+#include <sys/un.h>
 #include "ift.h"
 
 #define STB_IMAGE_IMPLEMENTATION
@@ -27,19 +46,27 @@ using namespace std;
 
 //===============================================================
 int getNumSuperpixels(iftImage *L);
+iftImage *readLabelImage(char *filepath, int **origLabels, int *numLabels);
+iftImage *compactLabelImage(iftImage *labels, int **origLabels, int *numLabels);
+iftImage *convertToRGBImage(iftImage *image);
 double *getImageVariance_channels(iftImage *image, iftImage *labels);
 int relabelSuperpixels(int *labels, int connectivity);
-int enforceNumSuperpixel(iftImage *labels, iftImage *image, int numDesiredSpx);
-
-void RBD(iftImage *image, iftImage *labels, int label, int nbuckets, int *alpha, double **Descriptor);
-double *SIRS(iftImage *labels, iftImage *image, int alpha, int nbuckets, char *reconFile, double gauss_variance, double *score);
+int enforceNumSuperpixel(iftImage *labels, iftImage *image, int numDesiredSpx, int mergeMode, int nbuckets, int alpha);
+
+void RBD(iftImage *image, LabelIndex *index, int label, int nbuckets, int *alpha, float **Descriptor, const int *buckets);
+int getDominanceBucket(iftImage *image, int i, int nbuckets);
+int *computeRBDBuckets(iftImage *image, int nbuckets);
+double getBucketsReconstructionError(double *hist, int num_buckets, int alpha, int *top);
+double *SIRS(iftImage *labels, iftImage *image, int alpha, int nbuckets, char *reconFile, double gauss_variance, double *score,
+            LabelIndex *index, const int *buckets);
 double *computeExplainedVariation(int *labels, iftImage *image, char *reconFile, double *score);
 
 bool is4ConnectedBoundaryPixel(iftImage *img, int i, int j, iftImage *labels);
 
 void computeIntersectionMatrix(iftImage *labels, iftImage *gt,
                                int **intersection_matrix, int *superpixel_sizes, int *gt_sizes, int cols, int rows);
-double computeBoundaryRecall(iftImage *labels, iftImage *gt, float d);
+unsigned char *computeGTEdges(iftImage *gt);
+double computeBoundaryRecall(iftImage *labels, iftImage *gt, float d, const unsigned char *gtEdges);
 double computeUndersegmentationError(iftImage *labels, iftImage *gt);
 double computeCompactness(iftImage *labels);
 
@@ -49,6 +76,13 @@ int mergeSpxBasedOnSize(iftImage *labels, iftImage *orig_img, int min_size,
                         iftImage *gt_image, iftColor color, char *tmp_save_path);
 //===============================================================
 
+// Criteria to choose the neighbor in enforceNumSuperpixel
+#define MERGE_BY_COLOR 0 // smallest squared mean-color distance
+#define MERGE_BY_SIRS 1  // smallest increase of the SIRS reconstruction error
+#define BUCKET_STATS 5   // count, color sums (3) and sum of squared norms
+
+#define MAX_METRICS 10 // metrics evaluated in a single run (--eval 1,2,3)
+
 typedef struct TextsConfig
 {
     Vec3b textColor;
@@ -59,8 +93,30 @@ typedef struct Args
 {
     char *img_path, *label_path, *label_path2, *label_ext, *gt_path;
     char *imgScoresPath, *imgRecon;
-    char *logFile, *dLogFile, *saveLabels;
-    int buckets, alpha, metric, k;
+    char *logFile, *dLogFile, *saveLabels, *saveExt;
+    int buckets, alpha, metric, k, mergeMode;
+    int metrics[MAX_METRICS], num_metrics; // metric = metrics[0]
+    int threads; // images evaluated concurrently in directory mode
+    int prefetch, ioThreads, prefetchMB; // decode-ahead queue depth (0: off), its threads and memory cap
+    int writers, writeQueue; // background output writers (0: synchronous) and their queue depth
+    int pngLevel; // -1: libpng/OpenCV defaults
+    bool pgmAscii; // write .pgm outputs as P2 instead of binary P5
+    char *packPath; // --img, --gt and --label are sections of this pack
+    int uring; // images per io_uring read batch of the --prefetch I/O threads (0: blocking reads)
+    char *streamPath; // label frames (see LabelStream.h) evaluated instead of --label
+    char *daemonPath; // Unix socket of the daemon mode, whose requests name the labels
+    int cacheMB; // memory cap of the images and ground-truths kept by the daemon
+    char *watchSentinel; // --label is watched for new label maps until this file appears in it
+    int shardIndex, numShards; // --shard i/n: only the images whose stem hashes to i modulo n
+    char *journalPath; // results of the evaluated images, so an interrupted run can be resumed
+    int journalSync; // images journaled between two fsyncs
+    char **methodPaths; // --label list: label directory of each method (NULL for a single directory)
+    int num_methods;
+    char *deltaLogPath; // per-image differences between every pair of methods of a --label list
+    char *sweepPath; // directory with one label directory per K value, evaluated instead of --label
+    int *kGrid, num_kGrid; // numbers of superpixels at which the --sweep scores are interpolated
+    char *curvePath; // scores of the --sweep at each K value (or --kGrid value)
+    char *manifestPath; // CSV with the input (and output) files of each image, read instead of --img and --label
     int removeColor, removeSize, recreateLabels;
     bool drawScores;
     double gauss_variance;
@@ -68,9 +124,47 @@ typedef struct Args
     int rgb[3], distances[2];
 } Args;
 
+ImageWriter *outputWriter = NULL; // Background writer of the output images (--writers)
+int outputPngLevel = -1;          // --pngLevel of the OpenCV outputs
+PackFile *inputPack = NULL;       // Dataset pack of the inputs (--pack)
+
+// name of the metrics that can be evaluated together (NULL otherwise)
+const char *getMetricName(int metric)
+{
+    switch (metric)
+    {
+    case 1: return "SIRS";
+    case 2: return "EV";
+    case 3: return "BR";
+    case 4: return "UE";
+    case 5: return "CO";
+    case 9: return "Regularity";
+    default: return NULL;
+    }
+}
+
+bool hasMetric(Args args, int metric)
+{
+    for (int i = 0; i < args.num_metrics; i++)
+        if (args.metrics[i] == metric)
+            return true;
+    return false;
+}
+
+// ground-truth directory of a multi-metric run: --gt, or --img when no metric needs the original image
+char *getGTDir(Args args)
+{
+    if (args.gt_path != NULL)
+        return args.gt_path;
+    if (!hasMetric(args, 1) && !hasMetric(args, 2))
+        return args.img_path;
+    return NULL;
+}
+
 void usage()
 {
     printf("Usage: main --eval <eval option> [args] \n");
+    printf("       main pack <file.pak> <section>=<dir> [<section>=<dir> ...] \n");
     printf("-----------------------------------------------------------------------------------------------------\n");
     printf("Eval options: \n");
     printf("1: SIRS                  - Evaluate color homogeneity with SIRS measure. \n");
@@ -96,9 +190,15 @@ void usage()
     printf("8: Qualitative           - Evaluate the number of superpixels with distinct labels. \n");
     printf("-----------------------------------------------------------------------------------------------------\n");
     printf("Arguments required for any evaluation option: \n");
-    printf("--eval        - Superpixel evaluation option. Type: int. \n");
-    printf("--label       - A pgm/png path with labeled superpixels image(s). Type: char* \n");
-    printf("--ext         - File extension for image labels. Type: char* \n");
+    printf("--eval        - Superpixel evaluation option. A comma-separated list of the metrics 1,2,3,4,5,9 \n");
+    printf("                (e.g. 1,2,5) evaluates all of them reading each image once, with one log row \n");
+    printf("                per image. In a list, 3 and 4 read the ground-truth from --gt, or from --img \n");
+    printf("                when neither 1 nor 2 is listed. Type: int or int list. \n");
+    printf("--label       - A pgm/png path with labeled superpixels image(s). A comma-separated list of \n");
+    printf("                directories evaluates several methods (metrics 1,2,3,4,5,9), decoding each image \n");
+    printf("                and ground-truth once for all of them; the --dlog rows start with the method \n");
+    printf("                (the directory name) and --log has the means of each method. Type: char* \n");
+    printf("--ext         - File extension for image labels (pgm, png, lbl or csv). Type: char* \n");
     printf("-----------------------------------------------------------------------------------------------------\n");
     printf("Arguments required for some evaluation options: \n");
     printf("--img         - Original image or gt file/path. Used in metrics 1,2,7,8 (original image), \n");
@@ -112,22 +212,93 @@ void usage()
     printf("--rgb         - Used in metric 8. RGB color for superpixels' boundaries. \n");
     printf("                The color is a list with three float values in [0,1]. \n");
     printf("                Default: 1,0,0. Type: float[3]. \n");
+    printf("--merge       - Used in metric 7. Merge criterion: 0 (smallest superpixel first, with the neighbor \n");
+    printf("                of closest mean color) or 1 (cheapest merge first, the one that least degrades \n");
+    printf("                SIRS, using --buckets and --alpha). Default: 0. Type: int \n");
     printf("--thick       - Used in metric 8. Thick of superpixels' boundaries. Default: 1. Type: int \n");
     printf("--distances   - Used in metric 8. Two values for x and y image distances, respectively. \n");
     printf("                Default: xsize,ysize. Type: int[2] \n");
     printf("--save        - Used in metrics 6, 7, and 8. Optional in 6 and 7. Directoy for output image. \n");
     printf("                Type: char* \n");
+    printf("--saveExt     - File extension of the label maps saved by metrics 6, 7 and 10: pgm, png or lbl \n");
+    printf("                (compressed label container). Default: pgm. Type: char* \n");
     printf("-----------------------------------------------------------------------------------------------------\n");
     printf("Optional arguments: \n");
     printf("--log         - txt path for th overall results (only used when --img is a directory). \n");
     printf("                Optional. Type: char* \n");
     printf("--dlog        - txt file path with evaluated results (for each image). Optional. Type: char* \n");
+    printf("--threads     - Number of images evaluated concurrently when --img is a directory (0: one per \n");
+    printf("                core). The --dlog rows keep the sequential order. Default: 1. Type: int \n");
+    printf("--prefetch    - Number of images decoded ahead by dedicated I/O threads when --img is a \n");
+    printf("                directory (metrics 1,2,3,4,5,9). Default: 0 (off). Type: int \n");
+    printf("--ioThreads   - Number of I/O threads used by --prefetch. Default: 1. Type: int \n");
+    printf("--prefetchMB  - Memory cap of the images decoded ahead, in MB (0: no cap). Default: 1024. Type: int \n");
+    printf("--uring       - Number of images whose files each --prefetch I/O thread reads in one io_uring \n");
+    printf("                batch before decoding them (blocking reads where io_uring is not available). \n");
+    printf("                Default: 0 (one blocking read at a time). Type: int \n");
+    printf("--writers     - Number of background threads writing the --recon, --imgScores and --save \n");
+    printf("                images. Default: 0 (written by the evaluation). Type: int \n");
+    printf("--writeQueue  - Number of images waiting for the --writers before the evaluation blocks. \n");
+    printf("                Default: 16. Type: int \n");
+    printf("--pngLevel    - Compression level (0-9) of the png outputs, written by a parallel encoder. \n");
+    printf("                0 stores unfiltered and uncompressed rows (fast, large files). Default: -1 \n");
+    printf("                (single-threaded libpng). Type: int \n");
+    printf("--pgmAscii    - Boolean option to write the pgm outputs as ASCII (P2) instead of binary 8/16-bit \n");
+    printf("                (P5). Default: 0. Type: bool \n");
     printf("--imgScores   - Used in metrics 1 and 2. Optional. Path to save images whose color maps indicate \n");
     printf("                SIRS/EV scores. Type: char* \n");
     printf("--drawScores  - Used in metrics 1 and 2. Optional. Boolean option when using \"--imgScores\" to show \n");
     printf("                score values. Type: bool \n");
     printf("--recon       - Used in metrics 1 and 2. Optional. Path to save the reconstructed images. Type: char* \n");
     printf("--label2      - Used in metric 8. A pgm/png path with other labeled images. Type: char* \n");
+    printf("--deltaLog    - Used with a --label list or --sweep. txt file with the differences between every \n");
+    printf("                pair of methods (or K values) on each image (first minus second). Optional. Type: char* \n");
+    printf("--sweep       - Directory with one label directory per K value (named by the number, e.g. 100, \n");
+    printf("                200), all evaluated instead of --label (metrics 1,2,3,4,5,9) decoding each image \n");
+    printf("                and ground-truth once. The --dlog rows start with K and --log has the means of \n");
+    printf("                each K value. Type: char* \n");
+    printf("--curve       - Used with --sweep. txt file to which the curve (the means of each K value) is \n");
+    printf("                appended, each row starting with the --sweep directory. Type: char* \n");
+    printf("--manifest    - CSV file with the files of each image, read in chunks instead of listing --img \n");
+    printf("                and --label (metrics 1,2,3,4,5,9). Its header names the columns: labels and \n");
+    printf("                optionally id, image, gt, recon and imgScores (see include/Manifest.h). The rows \n");
+    printf("                keep the manifest order, with --threads and --prefetch. Type: char* \n");
+    printf("--kGrid       - Used with --curve. Comma-separated numbers of superpixels at which the curve is \n");
+    printf("                written instead, linearly interpolating the means of the K values by their \n");
+    printf("                actual mean number of superpixels (no extrapolation). Type: int list \n");
+    printf("--pack        - Dataset pack (.pak) created by \"main pack\". The --img, --gt and --label paths \n");
+    printf("                (and --label2) are section names of the pack instead of directories. Type: char* \n");
+    printf("--stream      - File, FIFO or \"stdin\" with framed label maps (see include/LabelStream.h), \n");
+    printf("                evaluated instead of --label as they arrive (metrics 1,2,3,4,5,9). Each frame \n");
+    printf("                names an image of --img and writes its --dlog row to stdout. Type: char* \n");
+    printf("--daemon      - Unix socket on which the evaluation runs as a daemon, instead of --label (metrics \n");
+    printf("                1,2,3,4,5,9). Each request line \"FILE <label path>\" or \"SHM <name>\" (a --stream \n");
+    printf("                frame in a POSIX shared memory object) is answered with \"OK <--dlog row>\" or \n");
+    printf("                \"ERROR <reason>\"; \"QUIT\" stops the daemon. Type: char* \n");
+    printf("--cacheMB     - Memory cap of the images and ground-truths the daemon keeps decoded between \n");
+    printf("                requests, in MB (0: no cap). Default: 1024. Type: int \n");
+    printf("--shard       - i/n: evaluates only the images of --img whose stem hashes to i modulo n (e.g. 0/4 \n");
+    printf("                on the first of 4 nodes); \"main merge\" combines their --dlog or --journal files \n");
+    printf("                (only --journal scores have all their digits, so only merged journals give the \n");
+    printf("                means of a single run; --dlog means may differ in the last digit). Type: char* \n");
+    printf("--journal     - Append-only file with the results of the evaluated images (a --dlog file with \n");
+    printf("                full-precision scores). Rerunning with the same --journal skips the journaled \n");
+    printf("                images and uses their results in --log (directory processing). Type: char* \n");
+    printf("--journalSync - Number of images journaled between two fsyncs; their --dlog rows are written \n");
+    printf("                and fsync'd just before. Default: 100. Type: int \n");
+    printf("--watch       - Name of a sentinel file. The label maps of the --label directory are evaluated \n");
+    printf("                as their writers close them (metrics 1,2,3,4,5,9), each row going to stdout and \n");
+    printf("                --dlog, until the sentinel is created in --label. Type: char* \n");
+    printf("-----------------------------------------------------------------------------------------------------\n");
+    printf("pack: adds the images of each <dir> to <file.pak> (created if needed) under <section>, e.g. \n");
+    printf("      \"main pack bsds.pak img=./images gt=./gts SLIC/200=./slic200\". Files with the same stem \n");
+    printf("      are stored next to each other, in the order of the evaluation. \n");
+    printf("job: evaluates the campaign (datasets x methods x K values x metrics) of an INI job spec (see \n");
+    printf("      include/JobSpec.h), decoding each image and ground-truth once for all its label maps: \n");
+    printf("      \"main job campaign.ini\". \n");
+    printf("merge: appends to <log> the --log row of the images of the --dlog or --journal files, e.g. of the \n");
+    printf("      --shard runs: \"main merge scores.txt shard0.journal shard1.journal\". The means are \n");
+    printf("      computed from totals. \n");
     printf("-----------------------------------------------------------------------------------------------------\n");
 
     printError("main", "Too many/few parameters");
@@ -140,7 +311,10 @@ bool initArgs(Args *args, int argc, char *argv[])
          *gauss_varianceChar = NULL, *kChar = NULL,
          *tickChar = NULL, *rgbChar = NULL, *distancesChar = NULL,
          *removeColorChar = NULL, *removeSizeChar = NULL,
-         *relabelSpsChar = NULL;
+         *relabelSpsChar = NULL, *mergeModeChar = NULL, *threadsChar = NULL,
+         *prefetchChar = NULL, *ioThreadsChar = NULL, *prefetchMBChar = NULL,
+         *writersChar = NULL, *writeQueueChar = NULL, *pngLevelChar = NULL, *pgmAsciiChar = NULL, *uringChar = NULL,
+         *cacheMBChar = NULL, *shardChar = NULL, *journalSyncChar = NULL, *kGridChar = NULL;
 
     args->img_path = parseArgs(argv, argc, "--img");
     args->label_path = parseArgs(argv, argc, "--label");
@@ -155,6 +329,7 @@ bool initArgs(Args *args, int argc, char *argv[])
     args->imgScoresPath = parseArgs(argv, argc, "--imgScores");
     args->imgRecon = parseArgs(argv, argc, "--recon");
     args->saveLabels = parseArgs(argv, argc, "--save");
+    args->saveExt = parseArgs(argv, argc, "--saveExt");
     kChar = parseArgs(argv, argc, "--k");
     nbucketsChar = parseArgs(argv, argc, "--buckets");
     alphaChar = parseArgs(argv, argc, "--alpha");
@@ -164,6 +339,29 @@ bool initArgs(Args *args, int argc, char *argv[])
     tickChar = parseArgs(argv, argc, "--thick");
     rgbChar = parseArgs(argv, argc, "--rgb");
     distancesChar = parseArgs(argv, argc, "--distances");
+    mergeModeChar = parseArgs(argv, argc, "--merge");
+    threadsChar = parseArgs(argv, argc, "--threads");
+    prefetchChar = parseArgs(argv, argc, "--prefetch");
+    ioThreadsChar = parseArgs(argv, argc, "--ioThreads");
+    prefetchMBChar = parseArgs(argv, argc, "--prefetchMB");
+    writersChar = parseArgs(argv, argc, "--writers");
+    writeQueueChar = parseArgs(argv, argc, "--writeQueue");
+    pngLevelChar = parseArgs(argv, argc, "--pngLevel");
+    pgmAsciiChar = parseArgs(argv, argc, "--pgmAscii");
+    args->packPath = parseArgs(argv, argc, "--pack");
+    uringChar = parseArgs(argv, argc, "--uring");
+    args->streamPath = parseArgs(argv, argc, "--stream");
+    args->daemonPath = parseArgs(argv, argc, "--daemon");
+    cacheMBChar = parseArgs(argv, argc, "--cacheMB");
+    args->watchSentinel = parseArgs(argv, argc, "--watch");
+    shardChar = parseArgs(argv, argc, "--shard");
+    args->journalPath = parseArgs(argv, argc, "--journal");
+    journalSyncChar = parseArgs(argv, argc, "--journalSync");
+    args->deltaLogPath = parseArgs(argv, argc, "--deltaLog");
+    args->sweepPath = parseArgs(argv, argc, "--sweep");
+    kGridChar = parseArgs(argv, argc, "--kGrid");
+    args->curvePath = parseArgs(argv, argc, "--curve");
+    args->manifestPath = parseArgs(argv, argc, "--manifest");
 
     // Parameters to filter superpixels
     removeColorChar = parseArgs(argv, argc, "--rmcolor");
@@ -172,15 +370,55 @@ bool initArgs(Args *args, int argc, char *argv[])
 
     if (strcmp(args->saveLabels, "-") == 0)
         args->saveLabels = NULL;
+    if (strcmp(args->saveExt, "-") == 0)
+        args->saveExt = (char *)"pgm";
 
     args->k = strcmp(kChar, "-") != 0 ? atoi(kChar) : 0;
     args->gauss_variance = strcmp(gauss_varianceChar, "-") != 0 ? atof(gauss_varianceChar) : 0.01;
     args->buckets = strcmp(nbucketsChar, "-") != 0 ? atoi(nbucketsChar) : 16;
     args->alpha = strcmp(alphaChar, "-") != 0 ? atoi(alphaChar) : 4;
-    args->metric = strcmp(metricChar, "-") != 0 ? atoi(metricChar) : 1;
+    args->num_metrics = 0;
+    if (strcmp(metricChar, "-") != 0)
+    {
+        char *tok, *tmp;
+
+        tmp = iftCopyString(metricChar);
+        for (tok = strtok(tmp, ","); tok != NULL; tok = strtok(NULL, ","))
+        {
+            if (args->num_metrics == MAX_METRICS)
+                iftError("Too many metrics in --eval", "initArgs");
+            args->metrics[args->num_metrics++] = atoi(tok);
+        }
+        free(tmp);
+    }
+    if (args->num_metrics == 0)
+        args->metrics[args->num_metrics++] = 1;
+    args->metric = args->metrics[0];
     args->drawScores = strcmp(drawScoresChar, "-") != 0 ? atoi(drawScoresChar) : false;
     args->gauss_variance = strcmp(gauss_varianceChar, "-") != 0 ? atof(gauss_varianceChar) : 0.01;
     args->thick = strcmp(tickChar, "-") != 0 ? atof(tickChar) : 1.0;
+    args->mergeMode = strcmp(mergeModeChar, "-") != 0 ? atoi(mergeModeChar) : MERGE_BY_COLOR;
+    args->threads = strcmp(threadsChar, "-") != 0 ? atoi(threadsChar) : 1;
+    if (args->threads <= 0)
+        args->threads = omp_get_max_threads();
+    args->prefetch = strcmp(prefetchChar, "-") != 0 ? atoi(prefetchChar) : 0;
+    args->ioThreads = strcmp(ioThreadsChar, "-") != 0 ? iftMax(atoi(ioThreadsChar), 1) : 1;
+    args->prefetchMB = strcmp(prefetchMBChar, "-") != 0 ? atoi(prefetchMBChar) : 1024;
+    args->writers = strcmp(writersChar, "-") != 0 ? atoi(writersChar) : 0;
+    args->writeQueue = strcmp(writeQueueChar, "-") != 0 ? iftMax(atoi(writeQueueChar), 1) : 16;
+    args->pngLevel = strcmp(pngLevelChar, "-") != 0 ? atoi(pngLevelChar) : -1;
+    args->pgmAscii = strcmp(pgmAsciiChar, "-") != 0 ? atoi(pgmAsciiChar) : false;
+    args->uring = strcmp(uringChar, "-") != 0 ? iftMax(atoi(uringChar), 0) : 0;
+    args->cacheMB = strcmp(cacheMBChar, "-") != 0 ? iftMax(atoi(cacheMBChar), 0) : 1024;
+    args->journalSync = strcmp(journalSyncChar, "-") != 0 ? iftMax(atoi(journalSyncChar), 1) : 100;
+    args->shardIndex = 0;
+    args->numShards = 1;
+    if (strcmp(shardChar, "-") != 0 &&
+        (sscanf(shardChar, "%d/%d", &args->shardIndex, &args->numShards) != 2 || args->numShards < 1 ||
+         args->shardIndex < 0 || args->shardIndex >= args->numShards))
+        return false;
+    if (args->pngLevel < -1 || args->pngLevel > 9)
+        return false;
 
     args->removeColor = strcmp(removeColorChar, "-") != 0 ? atoi(removeColorChar) : -1;
     args->removeSize = strcmp(removeSizeChar, "-") != 0 ? atoi(removeSizeChar) : -1;
@@ -198,6 +436,55 @@ bool initArgs(Args *args, int argc, char *argv[])
         args->label_path2 = NULL;
     if (strcmp(args->gt_path, "-") == 0)
         args->gt_path = NULL;
+    if (strcmp(args->packPath, "-") == 0)
+        args->packPath = NULL;
+    if (strcmp(args->streamPath, "-") == 0)
+        args->streamPath = NULL;
+    if (strcmp(args->daemonPath, "-") == 0)
+        args->daemonPath = NULL;
+    if (strcmp(args->watchSentinel, "-") == 0)
+        args->watchSentinel = NULL;
+    if (strcmp(args->journalPath, "-") == 0)
+        args->journalPath = NULL;
+    if (strcmp(args->deltaLogPath, "-") == 0)
+        args->deltaLogPath = NULL;
+    if (strcmp(args->sweepPath, "-") == 0)
+        args->sweepPath = NULL;
+    if (strcmp(args->curvePath, "-") == 0)
+        args->curvePath = NULL;
+    if (strcmp(args->manifestPath, "-") == 0)
+        args->manifestPath = NULL;
+
+    args->kGrid = NULL;
+    args->num_kGrid = 0;
+    if (strcmp(kGridChar, "-") != 0)
+    {
+        char *tok, *tmp;
+
+        tmp = iftCopyString("%s", kGridChar);
+        args->kGrid = (int *)calloc(strlen(kGridChar), sizeof(int));
+        for (tok = strtok(tmp, ","); tok != NULL; tok = strtok(NULL, ","))
+        {
+            args->kGrid[args->num_kGrid] = atoi(tok);
+            if (args->kGrid[args->num_kGrid++] < 1)
+                return false;
+        }
+        free(tmp);
+    }
+
+    // A comma-separated --label is a list of methods, whose label maps share the decoded images
+    args->methodPaths = NULL;
+    args->num_methods = 1;
+    if (strchr(args->label_path, ',') != NULL)
+    {
+        args->methodPaths = (char **)calloc(strlen(args->label_path), sizeof(char *));
+        args->num_methods = 0;
+        for (char *tok = strtok(args->label_path, ","); tok != NULL; tok = strtok(NULL, ","))
+            args->methodPaths[args->num_methods++] = tok;
+        if (args->num_methods == 0)
+            return false;
+        args->label_path = args->methodPaths[0];
+    }
 
     if (strcmp(rgbChar, "-") != 0)
     {
@@ -254,13 +541,49 @@ bool initArgs(Args *args, int argc, char *argv[])
         args->distances[1] = -1;
     }
 
-    if (args->metric > 10 || args->metric < 1 || strcmp(args->label_path, "-") == 0 || strcmp(args->label_ext, "-") == 0)
+    if (args->metric > 10 || args->metric < 1 || (args->journalPath != NULL && args->metric == 8))
+        return false;
+    // SIRS ranges, before the modes below return: every one of them can evaluate it
+    if (hasMetric(*args, 1) && (args->buckets < 1 || args->alpha < 1 || args->alpha > args->buckets * 7))
+        return false;
+    if (args->metric == 7 && args->mergeMode == MERGE_BY_SIRS && (args->buckets < 1 || args->alpha < 1))
+        return false;
+    if ((args->streamPath != NULL) + (args->daemonPath != NULL) + (args->watchSentinel != NULL) +
+            (args->num_methods > 1) + (args->sweepPath != NULL) + (args->manifestPath != NULL) > 1)
+        return false;
+    if ((args->num_methods > 1 || args->sweepPath != NULL || args->manifestPath != NULL) && args->journalPath != NULL)
         return false;
-    if (args->metric == 1 && strcmp(args->img_path, "-") == 0 && (args->buckets < 1 || args->alpha < 1 || args->alpha > args->buckets * 7))
+    if ((args->curvePath != NULL || args->num_kGrid > 0) && args->sweepPath == NULL)
         return false;
-    if ((args->metric == 2 || args->metric == 3 || args->metric == 4) && strcmp(args->img_path, "-") == 0)
+    if (args->num_kGrid > 0 && args->curvePath == NULL)
         return false;
-    if (args->metric == 7 && args->k < 1)
+    if (args->streamPath == NULL && args->daemonPath == NULL && args->manifestPath == NULL &&
+        ((strcmp(args->label_path, "-") == 0 && args->sweepPath == NULL) || strcmp(args->label_ext, "-") == 0))
+        return false;
+    if (args->num_metrics > 1 || args->streamPath != NULL || args->daemonPath != NULL || args->watchSentinel != NULL ||
+        args->num_methods > 1 || args->sweepPath != NULL || args->manifestPath != NULL)
+    {
+        // only quantitative metrics can share the loaded data (so do the --stream, --daemon, --watch, --label list,
+        // --sweep and --manifest modes)
+        for (int i = 0; i < args->num_metrics; i++)
+        {
+            if (getMetricName(args->metrics[i]) == NULL)
+                return false;
+            for (int j = 0; j < i; j++)
+                if (args->metrics[j] == args->metrics[i])
+                    return false;
+        }
+        if (args->manifestPath != NULL) // The inputs are the columns of the manifest
+            return true;
+        if (strcmp(args->img_path, "-") == 0)
+            return false;
+        if ((hasMetric(*args, 3) || hasMetric(*args, 4) || args->removeColor != -1) && getGTDir(*args) == NULL)
+            return false;
+        return true;
+    }
+    if ((args->metric == 1 || args->metric == 2 || args->metric == 3 || args->metric == 4) && strcmp(args->img_path, "-") == 0)
+        return false;
+    if (args->metric == 7 && (args->k < 1 || strcmp(args->img_path, "-") == 0 || args->mergeMode < MERGE_BY_COLOR || args->mergeMode > MERGE_BY_SIRS))
         return false;
     if (args->metric == 8 && (strcmp(args->img_path, "-") == 0 || strcmp(args->saveLabels, "-") == 0))
         return false;
@@ -276,7 +599,7 @@ bool initArgs(Args *args, int argc, char *argv[])
 
 int getNumSuperpixels(iftImage *L)
 {
-    int maxLabel = 0;
+    int maxLabel = -1;
     for (int i = 0; i < L->n; i++)
     {
         if (L->val[i] > maxLabel)
@@ -284,20 +607,21 @@ int getNumSuperpixels(iftImage *L)
     }
     maxLabel++;
 
-    int tmp[iftMax(L->n, maxLabel)], numLabels = 0;
+    // labels are expected to be dense (see readLabelImage)
+    bool *found = (bool *)calloc(iftMax(maxLabel, 1), sizeof(bool));
+    int numLabels = 0;
 
-    for (int i = 0; i < iftMax(L->n, maxLabel); i++)
-        tmp[i] = 0;
     for (int i = 0; i < L->n; i++)
     {
         if (L->val[i] >= 0)
-            tmp[L->val[i]] = -1;
+            found[L->val[i]] = true;
     }
-    for (int i = 0; i < iftMax(L->n, maxLabel); i++)
+    for (int i = 0; i < maxLabel; i++)
     {
-        if (tmp[i] == -1)
+        if (found[i])
             numLabels++;
     }
+    free(found);
 
 #ifdef DEBUG
     printf("Number of superpixels: %d\n", numLabels);
@@ -353,24 +677,21 @@ double *getImageVariance_channels(iftImage *image, iftImage *labels)
 // return the number of connected components and change labels to have a unique label for each connected component
 int relabelSuperpixels(iftImage *labels, int connectivity)
 {
-    PrioQueue *queue;
     NodeAdj *adj_rel;
-    double *visited;
 
-    // mark which pixels were touched by a neighbor with the same label
-    visited = (double *)calloc(labels->n, sizeof(double));
-    queue = createPrioQueue(labels->n, visited, MINVAL_POLICY);
+    // priority: -2 seed, -1 touched by a neighbor with the same label, 0 otherwise
+    IndexedHeap<int> queue(labels->n);
     adj_rel = create8NeighAdj();
 
     // set initial label
     int label = labels->val[0], i = 0;
     int newLabel = -1;
-    visited[i] = -2;
-    insertPrioQueue(&queue, i);
+    queue.push(i, -2);
 
-    while (!isPrioQueueEmpty(queue))
+    while (!queue.empty())
     {
-        int vertex = popPrioQueue(&queue);
+        int visited;
+        int vertex = queue.pop(&visited);
         int vertexLabel = labels->val[vertex];
         NodeCoords vertexCoords;
         vertexCoords = getNodeCoordsImage(labels->xsize, vertex);
@@ -380,7 +701,7 @@ int relabelSuperpixels(iftImage *labels, int connectivity)
         {
             // if the spx wasn't touched by a neighbor
             // with the same label, set a new label for it
-            if (visited[vertex] == 0 || newLabel < 0)
+            if (visited == 0 || newLabel < 0)
             {
                 newLabel++; // set new label
                 label = vertexLabel; // set old label
@@ -395,33 +716,142 @@ int relabelSuperpixels(iftImage *labels, int connectivity)
             if (areValidNodeCoordsImage(labels->ysize, labels->xsize, adjCoords))
             {
                 int adjVertex = getNodeIndexImage(labels->xsize, adjCoords);
-                if (queue->state[adjVertex] != BLACK_STATE)
+                if (queue.getState(adjVertex) != BLACK_STATE)
                 {
-                    if (labels->val[adjVertex] == label && vertexLabel != -1)
-                        visited[adjVertex] = -1;
-                    if (queue->state[adjVertex] == WHITE_STATE)
-                        insertPrioQueue(&queue, adjVertex);
-                    else
-                    {
-                        if (labels->val[adjVertex] == label)
-                            moveIndexUpPrioQueue(&queue, adjVertex);
-                    }
+                    bool touched = (labels->val[adjVertex] == label && vertexLabel != -1);
+
+                    if (queue.getState(adjVertex) == WHITE_STATE)
+                        queue.push(adjVertex, touched ? -1 : 0);
+                    else if (touched && queue.getKey(adjVertex) > -1)
+                        queue.decreaseKey(adjVertex, -1);
                 }
             }
         }
     }
-    free(visited);
-    freePrioQueue(&queue);
     freeNodeAdj(&adj_rel);
     return getNumSuperpixels(labels);
 }
 
+// Adjacent superpixel in enforceNumSuperpixel, with the increase of the SIRS reconstruction error if
+// both were merged (MERGE_BY_SIRS)
+typedef struct MergeEdge
+{
+    int label;
+    double error;
+} MergeEdge;
+
+bool compareMergeEdges(const MergeEdge &a, const MergeEdge &b)
+{
+    return a.label < b.label;
+}
+
+bool sameMergeEdge(const MergeEdge &a, const MergeEdge &b)
+{
+    return a.label == b.label;
+}
+
+// Root of a superpixel merged by enforceNumSuperpixel, compressing its path
+int findMergedLabel(int *new_labels, int label)
+{
+    int root = label;
+
+    while (new_labels[root] != root)
+        root = new_labels[root];
+    while (new_labels[label] != root)
+    {
+        int parent = new_labels[label];
+        new_labels[label] = root;
+        label = parent;
+    }
+    return root;
+}
+
+// Replaces the merged superpixels of an adjacency list by their roots, without repetitions or label
+void compactNeighbors(vector<MergeEdge> &neighbors, int *new_labels, int label)
+{
+    size_t num = 0;
+
+    for (size_t i = 0; i < neighbors.size(); i++)
+    {
+        neighbors[i].label = findMergedLabel(new_labels, neighbors[i].label);
+        if (neighbors[i].label != label)
+            neighbors[num++] = neighbors[i];
+    }
+    neighbors.resize(num);
+    sort(neighbors.begin(), neighbors.end(), compareMergeEdges);
+    neighbors.erase(unique(neighbors.begin(), neighbors.end(), sameMergeEdge), neighbors.end());
+}
+
+// Computes the merge error of every neighbor of a superpixel and returns the least one, whose neighbor is
+// set in best (-1 if there is none). merged (num_buckets * BUCKET_STATS values) and top (alpha values)
+// are scratch buffers
+double computeMergeErrors(vector<MergeEdge> &neighbors, int label, double *buckets, double *error, int num_buckets,
+                          int alpha, double *merged, int *top, int *best)
+{
+    double *local = &buckets[(size_t)label * num_buckets * BUCKET_STATS], minError = INFINITY;
+
+    *best = -1;
+    for (size_t i = 0; i < neighbors.size(); i++)
+    {
+        double *other = &buckets[(size_t)neighbors[i].label * num_buckets * BUCKET_STATS];
+
+        for (int b = 0; b < num_buckets * BUCKET_STATS; b++)
+            merged[b] = local[b] + other[b];
+        neighbors[i].error = getBucketsReconstructionError(merged, num_buckets, alpha, top) - error[label] -
+                             error[neighbors[i].label];
+        if (neighbors[i].error < minError)
+        {
+            minError = neighbors[i].error;
+            *best = neighbors[i].label;
+        }
+    }
+    return minError;
+}
+
+// After label was merged into new_label, replaces both by new_label, with its merge error, in the
+// adjacency list of one of their neighbors and returns the least merge error of that neighbor (the
+// errors of its other merges did not change)
+double updateMergeErrors(vector<MergeEdge> &neighbors, int label, int new_label, double mergeError, int *best)
+{
+    double minError = INFINITY;
+    bool found = false;
+    size_t num = 0;
+
+    for (size_t i = 0; i < neighbors.size(); i++)
+    {
+        MergeEdge edge = neighbors[i];
+
+        if (edge.label == label || edge.label == new_label)
+        {
+            if (found)
+                continue;
+            found = true;
+            edge.label = new_label;
+            edge.error = mergeError;
+        }
+        neighbors[num++] = edge;
+        if (edge.error < minError)
+        {
+            minError = edge.error;
+            *best = edge.label;
+        }
+    }
+    neighbors.resize(num);
+    return minError;
+}
+
 // warning: this function is not able to deal with negative labels
-int enforceNumSuperpixel(iftImage *labels, iftImage *image, int numDesiredSpx)
+// Each superpixel keeps the list of its adjacent superpixels. mergeMode MERGE_BY_COLOR merges the
+// superpixels in ascending order of size, each with the neighbor of closest mean color. MERGE_BY_SIRS
+// keeps the dominance buckets of each superpixel (as in RBD), so the descriptor of a merged superpixel
+// comes from adding its buckets and no pixel is revisited, and always makes the cheapest merge: the
+// heap is keyed on the least merge error of each superpixel, and only the merge errors with the
+// merged superpixel are computed again
+int enforceNumSuperpixel(iftImage *labels, iftImage *image, int numDesiredSpx, int mergeMode, int nbuckets, int alpha)
 {
     NodeAdj *adj_rel;
-    PrioQueue *queue;
-    int num_channels;
+    int num_channels, num_buckets = 0, *best = NULL, *top = NULL;
+    double *buckets = NULL, *error = NULL, *merged = NULL;
 
     if (iftIsColorImage(image))
         num_channels = 3;
@@ -431,102 +861,142 @@ int enforceNumSuperpixel(iftImage *labels, iftImage *image, int numDesiredSpx)
     adj_rel = create8NeighAdj();
     int numSpx = relabelSuperpixels(labels, 8); // ensure connectivity
 
-    float meanColor[numSpx][3];
-    bool **neighbors = (bool **)malloc(numSpx * sizeof(bool *));
+    float (*meanColor)[3] = (float (*)[3])calloc(numSpx, sizeof(*meanColor));
     double *sizeSpx = (double *)calloc(numSpx, sizeof(double));
-    int new_labels[numSpx];
+    int *new_labels = (int *)malloc(numSpx * sizeof(int));
+    vector<vector<MergeEdge>> neighbors(numSpx);
 
     for (int i = 0; i < numSpx; i++)
-    {
-        meanColor[i][0] = meanColor[i][1] = meanColor[i][2] = 0;
-        neighbors[i] = (bool *)calloc(numSpx, sizeof(bool));
         new_labels[i] = i;
+
+    if (mergeMode == MERGE_BY_SIRS)
+    {
+        num_buckets = 7 * nbuckets;
+        buckets = (double *)calloc((size_t)numSpx * num_buckets * BUCKET_STATS, sizeof(double));
+        error = (double *)calloc(numSpx, sizeof(double));
+        best = (int *)malloc(numSpx * sizeof(int));
+        merged = (double *)malloc(num_buckets * BUCKET_STATS * sizeof(double));
+        top = (int *)malloc(alpha * sizeof(int));
     }
 
-    // for each superpixel find its adjacent superpixels and compute the mean color and size
-    for (int node = 0; node < labels->n; node++)
+    // for each superpixel find its adjacent superpixels and compute the mean color and size.
+    // Each thread visits the pixels of its own superpixels, so it only writes their entries
+    LabelIndex *index = createLabelIndex(labels);
+
+#pragma omp parallel for schedule(dynamic, 16)
+    for (int label = 0; label < numSpx; label++)
     {
-        NodeCoords coords;
-        int label = labels->val[node];
+        for (int q = index->offsets[label]; q < index->offsets[label + 1]; q++)
+        {
+            NodeCoords coords;
+            int node = index->pixels[q];
 
-        coords = getNodeCoordsImage(labels->xsize, node);
+            coords = getNodeCoordsImage(labels->xsize, node);
 
-        sizeSpx[label] += 1;
-        meanColor[label][0] += (float)image->val[node];
+            sizeSpx[label] += 1;
+            meanColor[label][0] += (float)image->val[node];
 
-        if (num_channels > 1)
-            meanColor[label][1] += (float)image->Cb[node];
-        else
-            meanColor[label][1] += (float)image->val[node];
+            if (num_channels > 1)
+                meanColor[label][1] += (float)image->Cb[node];
+            else
+                meanColor[label][1] += (float)image->val[node];
 
-        if (num_channels > 2)
-            meanColor[label][2] += (float)image->Cr[node];
-        else
-            meanColor[label][2] += (float)image->val[node];
+            if (num_channels > 2)
+                meanColor[label][2] += (float)image->Cr[node];
+            else
+                meanColor[label][2] += (float)image->val[node];
 
-        for (int j = 0; j < adj_rel->size; j++)
-        {
-            NodeCoords adjCoords = getAdjacentNodeCoords(adj_rel, coords, j);
-            if (areValidNodeCoordsImage(labels->ysize, labels->xsize, adjCoords))
+            if (mergeMode == MERGE_BY_SIRS)
             {
-                int adjLabel = labels->val[getNodeIndexImage(labels->xsize, adjCoords)];
-                if (adjLabel != label)
+                double color[3] = {(double)image->val[node], (double)image->Cb[node], (double)image->Cr[node]};
+                double *bucket = &buckets[((size_t)label * num_buckets + getDominanceBucket(image, node, nbuckets)) * BUCKET_STATS];
+
+                bucket[0] += 1;
+                for (int c = 0; c < 3; c++)
                 {
-                    if (neighbors[label][adjLabel] == false)
-                    {
-                        neighbors[label][adjLabel] = true;
-                        neighbors[adjLabel][label] = true;
-                    }
+                    bucket[1 + c] += color[c];
+                    bucket[4] += color[c] * color[c];
+                }
+            }
+
+            for (int j = 0; j < adj_rel->size; j++)
+            {
+                NodeCoords adjCoords = getAdjacentNodeCoords(adj_rel, coords, j);
+                if (areValidNodeCoordsImage(labels->ysize, labels->xsize, adjCoords))
+                {
+                    int adjLabel = labels->val[getNodeIndexImage(labels->xsize, adjCoords)];
+                    if (adjLabel != label && (neighbors[label].empty() || neighbors[label].back().label != adjLabel))
+                        neighbors[label].push_back({adjLabel, 0}); // the adjacency is symmetric
                 }
             }
         }
+        compactNeighbors(neighbors[label], new_labels, label);
     }
+    freeLabelIndex(&index);
+    freeNodeAdj(&adj_rel);
 
-    queue = createPrioQueue(numSpx, sizeSpx, MINVAL_POLICY);
-    for (int i = 0; i < numSpx; i++)
-        insertPrioQueue(&queue, i);
+    IndexedHeap<double> queue(numSpx);
+    if (mergeMode == MERGE_BY_SIRS)
+    {
+        double *cost = (double *)malloc(numSpx * sizeof(double));
 
-    freeNodeAdj(&adj_rel);
+#pragma omp parallel
+        {
+            double *local_merged = (double *)malloc(num_buckets * BUCKET_STATS * sizeof(double));
+            int *local_top = (int *)malloc(alpha * sizeof(int));
+
+#pragma omp for
+            for (int i = 0; i < numSpx; i++)
+                error[i] = getBucketsReconstructionError(&buckets[(size_t)i * num_buckets * BUCKET_STATS], num_buckets, alpha, local_top);
+#pragma omp for schedule(dynamic, 16)
+            for (int i = 0; i < numSpx; i++)
+                cost[i] = computeMergeErrors(neighbors[i], i, buckets, error, num_buckets, alpha, local_merged, local_top,
+                                             &best[i]);
+            free(local_merged);
+            free(local_top);
+        }
+        for (int i = 0; i < numSpx; i++)
+            queue.push(i, cost[i]);
+        free(cost);
+    }
+    else
+    {
+        for (int i = 0; i < numSpx; i++)
+            queue.push(i, sizeSpx[i]);
+    }
 
     int k = numSpx - numDesiredSpx; // number of superpixels to merge with other
 
-    // for each superpixel in ascending order of size, merge it with the most similar adjacent superpixel
-    while (k > 0 && !isPrioQueueEmpty(queue))
+    // MERGE_BY_COLOR: for each superpixel in ascending order of size, merge it with the most similar
+    // adjacent superpixel. MERGE_BY_SIRS: make the cheapest merge. Only popped superpixels are merged
+    // into others, so the heap only holds roots
+    while (k > 0 && !queue.empty())
     {
-        int label = popPrioQueue(&queue);
-        float minDistance = INFINITY;
-        float localMean[3];
+        double cost;
+        int label = queue.pop(&cost);
         int new_label = -1;
 
-        int parent = new_labels[label];
-        while (label != parent)
+        if (mergeMode == MERGE_BY_SIRS)
         {
-            label = parent;
-            parent = new_labels[label];
+            if (best[label] == -1) // the cheapest: no superpixel left has a neighbor
+                break;
+            new_label = best[label];
         }
-
-        localMean[0] = meanColor[label][0] / (float)sizeSpx[label];
-        localMean[1] = meanColor[label][1] / (float)sizeSpx[label];
-        localMean[2] = meanColor[label][2] / (float)sizeSpx[label];
-
-        bool *ptr_adj = neighbors[label];
-        for (int adj = 0; adj < numSpx; adj++, ptr_adj++)
+        else
         {
-            if (*(ptr_adj) == false)
-                continue;
+            float minDistance = INFINITY;
+            float localMean[3];
 
-            float adjMean[3];
-            int adjLabel = *(ptr_adj);
-            parent = new_labels[adjLabel];
+            localMean[0] = meanColor[label][0] / (float)sizeSpx[label];
+            localMean[1] = meanColor[label][1] / (float)sizeSpx[label];
+            localMean[2] = meanColor[label][2] / (float)sizeSpx[label];
 
-            while (adjLabel != parent)
+            compactNeighbors(neighbors[label], new_labels, label);
+            for (size_t i = 0; i < neighbors[label].size(); i++)
             {
-                adjLabel = parent;
-                parent = new_labels[adjLabel];
-            }
+                int adjLabel = neighbors[label][i].label;
+                float adjMean[3];
 
-            if (adjLabel != label)
-            {
                 adjMean[0] = meanColor[adjLabel][0] / (float)sizeSpx[adjLabel];
                 adjMean[1] = meanColor[adjLabel][1] / (float)sizeSpx[adjLabel];
                 adjMean[2] = meanColor[adjLabel][2] / (float)sizeSpx[adjLabel];
@@ -541,14 +1011,9 @@ int enforceNumSuperpixel(iftImage *labels, iftImage *image, int numDesiredSpx)
                     new_label = adjLabel;
                 }
             }
-            else
-            {
-                *(ptr_adj) = false;
-                neighbors[adj][label] = false;
-            }
         }
 
-        // merge with the most similar neighbor superpixel with different label
+        // merge with the chosen neighbor superpixel
         if (new_label != -1)
         {
             new_labels[label] = new_label;
@@ -558,54 +1023,56 @@ int enforceNumSuperpixel(iftImage *labels, iftImage *image, int numDesiredSpx)
             meanColor[new_label][2] += meanColor[label][2];
             sizeSpx[new_label] += sizeSpx[label];
 
-            neighbors[new_label][label] = false;
-            neighbors[label][new_label] = false;
-            
-            bool *ptr_adj = neighbors[label];
-            bool *ptr_new = neighbors[new_label];
-            for (int adj = 0; adj < numSpx; adj++, ptr_adj++, ptr_new++)
+            neighbors[new_label].insert(neighbors[new_label].end(), neighbors[label].begin(), neighbors[label].end());
+            vector<MergeEdge>().swap(neighbors[label]);
+
+            if (mergeMode == MERGE_BY_SIRS)
+            {
+                double *local = &buckets[(size_t)label * num_buckets * BUCKET_STATS];
+                double *other = &buckets[(size_t)new_label * num_buckets * BUCKET_STATS];
+
+                for (int b = 0; b < num_buckets * BUCKET_STATS; b++)
+                    other[b] += local[b];
+                error[new_label] = getBucketsReconstructionError(other, num_buckets, alpha, top);
+
+                // Only the merges with new_label changed
+                compactNeighbors(neighbors[new_label], new_labels, new_label);
+                cost = computeMergeErrors(neighbors[new_label], new_label, buckets, error, num_buckets, alpha, merged,
+                                          top, &best[new_label]);
+                queue.updateKey(new_label, cost);
+                for (size_t i = 0; i < neighbors[new_label].size(); i++)
+                {
+                    MergeEdge *edge = &neighbors[new_label][i];
+
+                    cost = updateMergeErrors(neighbors[edge->label], label, new_label, edge->error, &best[edge->label]);
+                    queue.updateKey(edge->label, cost);
+                }
+            }
+            else
             {
-                if (adj != label && adj != new_label && *ptr_adj)
-                    (*ptr_new) = true;
+                compactNeighbors(neighbors[new_label], new_labels, new_label);
+                if (queue.contains(new_label))
+                    queue.increaseKey(new_label, sizeSpx[new_label]);
             }
-            moveIndexDownPrioQueue(&queue, new_label);
             k--;
         }
     }
 
-    for (k = 0; k < numSpx; k++)
-    {
-        free(neighbors[k]);
-    }
-    free(neighbors);
+    free(meanColor);
     free(sizeSpx);
-
-    // atualiza os rótulos que foram unidos - update labels that were merged
-    for (k = 0; k < numSpx; k++)
+    if (mergeMode == MERGE_BY_SIRS)
     {
-        int label;
-        int parent;
-        label = k;
-        parent = new_labels[label];
-
-        while (label != parent)
-        {
-            label = parent;
-            parent = new_labels[label];
-            new_labels[label] = parent;
-        }
-        label = k;
-        while (label != parent)
-        {
-            int tmp = new_labels[label];
-            new_labels[label] = parent;
-            label = tmp;
-        }
+        free(buckets);
+        free(error);
+        free(best);
+        free(merged);
+        free(top);
     }
 
     // rotula os pixels com os rótulos novos - labels superpixels with new labels
     for (int i = 0; i < labels->n; i++)
-        labels->val[i] = new_labels[labels->val[i]];
+        labels->val[i] = findMergedLabel(new_labels, labels->val[i]);
+    free(new_labels);
 
     return relabelSuperpixels(labels, 8);
 }
@@ -613,15 +1080,16 @@ int enforceNumSuperpixel(iftImage *labels, iftImage *image, int numDesiredSpx)
 //==========================================================
 
 // compute RBD descriptor for a superpixel
-void RBD(iftImage *image, iftImage *labels, int label, int nbuckets, int *alpha, float **Descriptor)
+void RBD(iftImage *image, LabelIndex *index, int label, int nbuckets, int *alpha, float **Descriptor,
+         const int *buckets)
 {
     /* Compute the superpixels descriptors
         image : RGB image
-        labels     : Image labels (0,K-1)
+        index      : Pixels of each label (0,K-1)
         Descriptor : Descriptor[num_channels][alpha]
+        buckets    : RBD bucket of each pixel (computeRBDBuckets), or NULL
     */
 
-    PrioQueue *queue;
     int num_histograms;
     int superpixel_size = 0, num_channels;
 
@@ -629,10 +1097,10 @@ void RBD(iftImage *image, iftImage *labels, int label, int nbuckets, int *alpha,
     else num_channels = 1;
 
     num_histograms = pow(2, num_channels) - 1;
-    long int ColorHistogram[num_histograms][nbuckets][3]; // Descriptor[image->num_channels][nbuckets]
+    long int ColorHistogram[num_histograms * nbuckets][3]; // Descriptor[image->num_channels * nbuckets]
     double V[num_histograms * nbuckets];                  // buckets priority : V[image->num_channels][nbuckets]
 
-    queue = createPrioQueue(num_histograms * nbuckets, V, MINVAL_POLICY);
+    IndexedHeap<double> queue(num_histograms * nbuckets);
 
     for (int h = 0; h < num_histograms; h++)
     {
@@ -640,7 +1108,7 @@ void RBD(iftImage *image, iftImage *labels, int label, int nbuckets, int *alpha,
         {
             V[h * nbuckets + b] = 0;
             for (int c = 0; c < num_channels; c++)
-                ColorHistogram[h][b][c] = 0;
+                ColorHistogram[h * nbuckets + b][c] = 0;
         }
     }
 
@@ -648,79 +1116,17 @@ void RBD(iftImage *image, iftImage *labels, int label, int nbuckets, int *alpha,
     printf("RBD: Compute histogram\n");
 #endif
 
-    // compute histograms
-    for (int i = 0; i < image->n; i++)
+    // compute histograms over the pixels of the superpixel
+    for (int j = index->offsets[label]; j < index->offsets[label + 1]; j++)
     {
-        if (labels->val[i] == label)
-        {
-            superpixel_size++;
-            int hist_id = 0;
-            int bit = 1;
-
-            if (image->val[i] < image->Cb[i])
-                hist_id = hist_id | bit;
-            else
-            {
-                if (image->val[i] < image->Cr[i])
-                    hist_id = hist_id | bit;
-            }
-            bit = bit << 1;
-
-            if (image->Cb[i] < image->val[i])
-                hist_id = hist_id | bit;
-            else
-            {
-                if (image->Cb[i] < image->Cr[i])
-                    hist_id = hist_id | bit;
-            }
-            bit = bit << 1;
-
-            if (image->Cr[i] < image->val[i])
-                hist_id = hist_id | bit;
-            else
-            {
-                if (image->Cr[i] < image->Cb[i])
-                    hist_id = hist_id | bit;
-            }
-            bit = bit << 1;
-
-            hist_id = ~hist_id;
-            hist_id *= -1;
-
-            // find one max channel index
-            int max_channel = 0;
-            int tmp_hist_id = hist_id;
-
-            while (tmp_hist_id % 2 == 0)
-            {
-                tmp_hist_id = tmp_hist_id >> 1;
-                max_channel++;
-            }
-
-            int bin;
-            if (max_channel == 0)
-                bin = floor(((float)image->val[i] / 255.0) * nbuckets);
-            else
-            {
-                if (max_channel == 1)
-                    bin = floor(((float)image->Cb[i] / 255.0) * nbuckets);
-                else
-                    bin = floor(((float)image->Cr[i] / 255.0) * nbuckets);
-            }
-            hist_id--;
-
-            if (hist_id < 0 || hist_id > 6)
-                printf(">> hist_id:%d \n", hist_id);
-            if (bin < 0 || bin > nbuckets)
-                printf(">> bin:%d \n", bin);
-            if (hist_id * nbuckets + bin < 0 || hist_id * nbuckets + bin > num_histograms * nbuckets)
-                printf(">> hist_id * nbuckets + bin:%d \n", hist_id * nbuckets + bin);
-
-            V[hist_id * nbuckets + bin]++;
-            ColorHistogram[hist_id][bin][0] += (long int)image->val[i];
-            ColorHistogram[hist_id][bin][1] += (long int)image->Cb[i];
-            ColorHistogram[hist_id][bin][2] += (long int)image->Cr[i];
-        }
+        int i = index->pixels[j];
+        int bucket = (buckets != NULL) ? buckets[i] : getDominanceBucket(image, i, nbuckets);
+
+        superpixel_size++;
+        V[bucket]++;
+        ColorHistogram[bucket][0] += (long int)image->val[i];
+        ColorHistogram[bucket][1] += (long int)image->Cb[i];
+        ColorHistogram[bucket][2] += (long int)image->Cr[i];
     }
 
 #ifdef DEBUG
@@ -733,14 +1139,14 @@ void RBD(iftImage *image, iftImage *labels, int label, int nbuckets, int *alpha,
         {
             if (V[c * nbuckets + b] > 0)
             {
-                if (isPrioQueueEmpty(queue) || queue->last_elem_pos < (*alpha) - 1)
-                    insertPrioQueue(&queue, c * nbuckets + b); // push (color, frequency) into Q, sorted by V[i]
+                if (queue.size() < (*alpha))
+                    queue.push(c * nbuckets + b, V[c * nbuckets + b]); // push (color, frequency) into Q, sorted by V[i]
                 else
                 {
-                    if (!isPrioQueueEmpty(queue) && V[queue->node[0]] < V[c * nbuckets + b])
+                    if (queue.topKey() < V[c * nbuckets + b])
                     {
-                        popPrioQueue(&queue);
-                        insertPrioQueue(&queue, c * nbuckets + b); // push (color, frequency) into Q, sorted by V[i]
+                        queue.pop();
+                        queue.push(c * nbuckets + b, V[c * nbuckets + b]); // push (color, frequency) into Q, sorted by V[i]
                     }
                 }
             }
@@ -748,7 +1154,7 @@ void RBD(iftImage *image, iftImage *labels, int label, int nbuckets, int *alpha,
     }
 
     // Get the higher alpha buckets
-    if (isPrioQueueEmpty(queue))
+    if (queue.empty())
     {
         (*alpha) = 0;
         int a = 0;
@@ -757,18 +1163,16 @@ void RBD(iftImage *image, iftImage *labels, int label, int nbuckets, int *alpha,
     }
     else
     {
-        if (queue->last_elem_pos < (*alpha) - 1)
-            (*alpha) = queue->last_elem_pos + 1;
+        if (queue.size() < (*alpha))
+            (*alpha) = queue.size();
 
         for (int a = (*alpha) - 1; a >= 0; a--)
         {
-            int val = popPrioQueue(&queue);
-            int bin = val % nbuckets;
-            int hist = (val - bin) / nbuckets;
+            int val = queue.pop();
 
             for (int c = 0; c < num_channels; c++)
             {
-                Descriptor[a][c] = (float)ColorHistogram[hist][bin][c] / (float)V[val]; // get the mean color
+                Descriptor[a][c] = (float)ColorHistogram[val][c] / (float)V[val]; // get the mean color
             }
         }
     }
@@ -786,11 +1190,108 @@ void RBD(iftImage *image, iftImage *labels, int label, int nbuckets, int *alpha,
     }
 #endif
 
-#ifdef DEBUG
-    printf("\nFREE STRUCTURES: getSuperpixelDescriptor\n");
-#endif
+}
+
+// index (histogram * nbuckets + bin) of the RBD bucket of a pixel. The bin is clamped to nbuckets - 1
+int getDominanceBucket(iftImage *image, int i, int nbuckets)
+{
+    int hist_id = 0, max_channel = 0, bin, value;
+
+    if (image->val[i] < image->Cb[i] || image->val[i] < image->Cr[i])
+        hist_id |= 1;
+    if (image->Cb[i] < image->val[i] || image->Cb[i] < image->Cr[i])
+        hist_id |= 2;
+    if (image->Cr[i] < image->val[i] || image->Cr[i] < image->Cb[i])
+        hist_id |= 4;
+
+    // one max channel index, as RBD does from ~hist_id
+    for (int tmp_hist_id = hist_id + 1; tmp_hist_id % 2 == 0; tmp_hist_id >>= 1)
+        max_channel++;
+
+    if (max_channel == 0)
+        value = image->val[i];
+    else if (max_channel == 1)
+        value = image->Cb[i];
+    else
+        value = image->Cr[i];
+
+    bin = iftMin((int)floor(((float)value / 255.0) * nbuckets), nbuckets - 1);
+    return hist_id * nbuckets + bin;
+}
+
+// RBD bucket of every pixel of an image, shared by the SIRS of its label maps
+int *computeRBDBuckets(iftImage *image, int nbuckets)
+{
+    int *buckets = (int *)calloc(image->n, sizeof(int));
+
+#pragma omp parallel for
+    for (int i = 0; i < image->n; i++)
+        buckets[i] = getDominanceBucket(image, i, nbuckets);
+    return buckets;
+}
+
+// squared reconstruction error of a superpixel summarized by its buckets (BUCKET_STATS values each),
+// when every bucket is represented by the closest of the alpha most frequent bucket means. top is a
+// scratch buffer of alpha values, allocated once by the caller
+double getBucketsReconstructionError(double *hist, int num_buckets, int alpha, int *top)
+{
+    int num_top = 0;
+    double error = 0;
+
+    // the alpha most frequent buckets (RBD descriptor)
+    for (int b = 0; b < num_buckets; b++)
+    {
+        int pos;
+
+        if (hist[b * BUCKET_STATS] <= 0 || (num_top == alpha && hist[b * BUCKET_STATS] <= hist[top[alpha - 1] * BUCKET_STATS]))
+            continue;
+
+        pos = (num_top < alpha) ? num_top++ : alpha - 1;
+        while (pos > 0 && hist[top[pos - 1] * BUCKET_STATS] < hist[b * BUCKET_STATS])
+        {
+            top[pos] = top[pos - 1];
+            pos--;
+        }
+        top[pos] = b;
+    }
+
+    for (int b = 0; b < num_buckets; b++)
+    {
+        double *bucket = &hist[b * BUCKET_STATS], count = bucket[0];
+        double mean[3], best = INFINITY, *descriptor = NULL;
 
-    freePrioQueue(&queue);
+        if (count <= 0)
+            continue;
+
+        for (int c = 0; c < 3; c++)
+            mean[c] = bucket[1 + c] / count;
+
+        for (int a = 0; a < num_top; a++)
+        {
+            double *candidate = &hist[top[a] * BUCKET_STATS], distance = 0;
+
+            for (int c = 0; c < 3; c++)
+            {
+                double diff = mean[c] - candidate[1 + c] / candidate[0];
+                distance += diff * diff;
+            }
+            if (distance < best)
+            {
+                best = distance;
+                descriptor = candidate;
+            }
+        }
+
+        // sum of |x - d|^2 = sum of |x|^2 - 2 d . sum of x + count |d|^2
+        error += bucket[4];
+        for (int c = 0; c < 3; c++)
+        {
+            double d = descriptor[1 + c] / descriptor[0];
+            error += count * d * d - 2 * d * bucket[1 + c];
+        }
+    }
+
+    return error / (255.0 * 255.0);
 }
 
 //==========================================================
@@ -799,7 +1300,7 @@ void RBD(iftImage *image, iftImage *labels, int label, int nbuckets, int *alpha,
 
 double *SIRS(iftImage *labels, iftImage *image, 
             int alpha, int nbuckets, char *reconFile, double gauss_variance, 
-            double *score)
+            double *score, LabelIndex *index, const int *buckets)
 {
     double *histogramVariation;
     float ***Descriptor;  // Descriptor[numSup][alpha][num_channels]
@@ -810,6 +1311,7 @@ double *SIRS(iftImage *labels, iftImage *image,
     double **mean_buckets;         // mean_buckets[superpixels][num_channels];
     double **variation_descriptor; // variation_descriptor[superpixels][num_channels];
     int num_channels;
+    LabelIndex *own_index = NULL;
 
     if (!iftIsColorImage(image))
         iftError("The original image must be color or 3-channel grayscale", "SIRS");
@@ -823,14 +1325,12 @@ double *SIRS(iftImage *labels, iftImage *image,
     if (reconFile != NULL)
         recons = iftCreateColorImage(image->xsize, image->ysize, 1, 8); // for RGB colors, depth = 8
 
+    // pixels of each superpixel (may be shared with other metrics)
+    if (index == NULL)
+        index = own_index = createLabelIndex(labels);
+
     // get the higher label = number of superpixels
-    int superpixels = 0;
-    for (int i = 0; i < image->n; ++i)
-    {
-        if (labels->val[i] > superpixels)
-            superpixels = labels->val[i];
-    }
-    superpixels++;
+    int superpixels = index->num_labels;
 
     histogramVariation = (double *)calloc(superpixels, sizeof(double));
     descriptor_size = (int *)calloc(superpixels, sizeof(int));
@@ -842,11 +1342,10 @@ double *SIRS(iftImage *labels, iftImage *image,
     int *superpixelSize = (int *)calloc(superpixels, sizeof(int));
     
     // compute superpixels area
-    for (int i = 0; i < image->n; ++i)
-    {
-        if (labels->val[i] != -1) superpixelSize[labels->val[i]]++;
-    }
+    for (int s = 0; s < superpixels; ++s)
+        superpixelSize[s] = getLabelSize(index, s);
 
+#pragma omp parallel for schedule(dynamic) reduction(+ : emptySuperpixels)
     for (int s = 0; s < superpixels; s++)
     {
         if (superpixelSize[s] == 0){
@@ -869,7 +1368,7 @@ double *SIRS(iftImage *labels, iftImage *image,
 #ifdef DEBUG
         printf("call RBD \n");
 #endif
-        RBD(image, labels, s, nbuckets, &(descriptor_size[s]), Descriptor[s]);
+        RBD(image, index, s, nbuckets, &(descriptor_size[s]), Descriptor[s], buckets);
 
         for (int i = 0; i < num_channels; i++)
             MSE[s][i] = 0.0;
@@ -1006,12 +1505,10 @@ double *SIRS(iftImage *labels, iftImage *image,
     free(variation_descriptor);
     free(superpixelSize);
     free(variance);
+    freeLabelIndex(&own_index);
 
     if (reconFile != NULL)
-    {
-        iftWriteImageByExt(recons, reconFile);
-        iftDestroyImage(&recons);
-    }
+        writeImageAsync(outputWriter, &recons, reconFile);
 
     return histogramVariation;
 }
@@ -1152,7 +1649,7 @@ double *computeExplainedVariation(iftImage *labels, iftImage *image, char *recon
     free(valuesBottom);
 
     if (reconFile != NULL)
-        iftWriteImageByExt(recons, reconFile);
+        writeImageAsync(outputWriter, &recons, reconFile);
 
     return supExplainedVariation;
 }
@@ -1198,6 +1695,55 @@ bool is4ConnectedBoundaryPixel(iftImage *img, int y, int x,
     return false;
 }
 
+// Bits of the 4-neighbors of a pixel with another color (in the order tested by is4ConnectedBoundaryPixel)
+#define EDGE_UP 1
+#define EDGE_RIGHT 2
+#define EDGE_LEFT 4
+#define EDGE_DOWN 8
+
+// Neighbors with another color of every ground-truth pixel, shared by the BR of the label maps of an
+// image: only their labels remain to be tested
+unsigned char *computeGTEdges(iftImage *gt)
+{
+    unsigned char *edges = (unsigned char *)calloc(gt->n, sizeof(unsigned char));
+
+#pragma omp parallel for
+    for (int y = 0; y < gt->ysize; y++)
+    {
+        for (int x = 0; x < gt->xsize; x++)
+        {
+            iftColor color;
+            unsigned char bits = 0;
+
+            color.val[0] = iftImgVal(gt, x, y, 0);
+            color.val[1] = iftIsColorImage(gt) ? iftImgCb(gt, x, y, 0) : 0;
+            color.val[2] = iftIsColorImage(gt) ? iftImgCr(gt, x, y, 0) : 0;
+
+            if (y > 0 && !hasSameColor(color, gt, getIndexImage(gt->xsize, y - 1, x)))
+                bits |= EDGE_UP;
+            if (x < gt->xsize - 1 && !hasSameColor(color, gt, getIndexImage(gt->xsize, y, x + 1)))
+                bits |= EDGE_RIGHT;
+            if (x > 0 && !hasSameColor(color, gt, getIndexImage(gt->xsize, y, x - 1)))
+                bits |= EDGE_LEFT;
+            if (y < gt->ysize - 1 && !hasSameColor(color, gt, getIndexImage(gt->xsize, y + 1, x)))
+                bits |= EDGE_DOWN;
+            edges[getIndexImage(gt->xsize, y, x)] = bits;
+        }
+    }
+    return edges;
+}
+
+// is4ConnectedBoundaryPixel of the ground-truth from its computeGTEdges
+bool isGTEdgePixel(const unsigned char *gtEdges, int y, int x, iftImage *labels)
+{
+    unsigned char bits = gtEdges[getIndexImage(labels->xsize, y, x)];
+
+    return ((bits & EDGE_UP) && iftImgVal(labels, x, y - 1, 0) > -1) ||
+           ((bits & EDGE_RIGHT) && iftImgVal(labels, x + 1, y, 0) > -1) ||
+           ((bits & EDGE_LEFT) && iftImgVal(labels, x - 1, y, 0) > -1) ||
+           ((bits & EDGE_DOWN) && iftImgVal(labels, x, y + 1, 0) > -1);
+}
+
 void computeIntersectionMatrix(iftImage *labels, iftImage *gt,
                                int **intersection_matrix, int *superpixel_sizes,
                                int *gt_sizes, int cols, int rows)
@@ -1224,7 +1770,8 @@ void computeIntersectionMatrix(iftImage *labels, iftImage *gt,
     }
 }
 
-double computeBoundaryRecall(iftImage *labels, iftImage *gt, float d)
+// gtEdges: computeGTEdges of gt, or NULL
+double computeBoundaryRecall(iftImage *labels, iftImage *gt, float d, const unsigned char *gtEdges)
 {
     int H = gt->ysize; // num_rows
     int W = gt->xsize; // num_cols
@@ -1239,8 +1786,10 @@ double computeBoundaryRecall(iftImage *labels, iftImage *gt, float d)
         for (int j = 0; j < W; j++)
         {
             // Computes only if the superpixel in that position was not filtered out
-            if (is4ConnectedBoundaryPixel(gt, i, j, labels) && 
-                iftImgVal(labels, j, i, 0) > -1)
+            bool gtBoundary = (gtEdges != NULL) ? isGTEdgePixel(gtEdges, i, j, labels)
+                                                : is4ConnectedBoundaryPixel(gt, i, j, labels);
+
+            if (gtBoundary && iftImgVal(labels, j, i, 0) > -1)
             {
                 bool pos = false;
                 for (int k = max(0, i - r); k < min(H - 1, i + r) + 1; k++)
@@ -1297,8 +1846,6 @@ double computeUndersegmentationError(iftImage *labels, iftImage *gt)
 
     computeIntersectionMatrix(labels, gt, intersection_matrix, superpixel_sizes, gt_sizes, superpixels, gt_segments);
 
-    free(gt_sizes);
-
     double error = 0;
     for (int j = 0; j < superpixels; ++j)
     {
@@ -1327,6 +1874,7 @@ double computeUndersegmentationError(iftImage *labels, iftImage *gt)
     }
 
     free(superpixel_sizes);
+    free(gt_sizes);
     for (int i = 0; i < gt_segments; ++i)
         free(intersection_matrix[i]);
     free(intersection_matrix);
@@ -1833,16 +2381,14 @@ void qualitative(iftImage *orig,
         ovlay_img = ovlayBorders(orig, label_img, NULL, args.thick, YCbCr, YCbCr, YCbCr);
         ovlay_img2 = ovlayBorders(orig, label_img2, NULL, args.thick, YCbCr, YCbCr, YCbCr);
         result_img = merge(ovlay_img, ovlay_img2, 4 * args.thick, args.distances);
-        iftWriteImageByExt(result_img, save_path);
+        writeImageAsync(outputWriter, &result_img, save_path);
         iftDestroyImage(&ovlay_img);
         iftDestroyImage(&ovlay_img2);
-        iftDestroyImage(&result_img);
     }
     else
     {
         ovlay_img = ovlayBorders(orig, label_img, NULL, args.thick, YCbCr, YCbCr, YCbCr);
-        iftWriteImageByExt(ovlay_img, save_path);
-        iftDestroyImage(&ovlay_img);
+        writeImageAsync(outputWriter, &ovlay_img, save_path);
     }
 }
 
@@ -1879,7 +2425,19 @@ void drawtorect(cv::Mat &mat, cv::Rect target, int face, int thickness, cv::Scal
     putText(mat, str, Point(target.x + marginx, target.y + target.height - marginy), face, scale, color, thickness, 8, false);
 }
 
-Rect findMinRect(const Mat1b &src)
+// WriteFunction of the --imgScores images
+void writeMatImage(void *data, const char *path)
+{
+    Mat *image = (Mat *)data;
+
+    if (outputPngLevel >= 0)
+        imwrite(path, *image, std::vector<int>{IMWRITE_PNG_COMPRESSION, outputPngLevel});
+    else
+        imwrite(path, *image);
+    delete image;
+}
+
+Rect findMinRect(const Mat1b &src)
 {
     Mat1f W(src.rows, src.cols, float(0));
     Mat1f H(src.rows, src.cols, float(0));
@@ -1914,26 +2472,24 @@ Rect findMinRect(const Mat1b &src)
     return maxRect;
 }
 
-void createImageMetric(iftImage *L, double *colorVariance, int num_rows, int num_cols, const char *filename, bool showScores)
+void createImageMetric(iftImage *L, double *colorVariance, int num_rows, int num_cols, const char *filename, bool showScores, LabelIndex *index)
 {
     /*
     L : label map
     colorVariance : segmentaton error
+    index : pixels of each label (optional, built if NULL)
     */
 
     NodeAdj *AdjRel;
     Mat image;
+    LabelIndex *own_index = NULL;
     int K;
 
-    K = 0;
-    for (int p = 0; p < num_rows * num_cols; p++)
-        K = MAX(K, L->val[p]);
-    K++;
+    if (index == NULL)
+        index = own_index = createLabelIndex(L);
+    K = index->num_labels;
 
-    int superpixel_size[K];
-    TextsConfig textsConfig[K];
-    vector<vector<Point>> contours(K);
-    int count_contours[K];
+    vector<TextsConfig> textsConfig(K);
 
 #ifdef DEBUG
     printf("createImageMetric: Alloc structures\n");
@@ -1942,20 +2498,14 @@ void createImageMetric(iftImage *L, double *colorVariance, int num_rows, int num
     AdjRel = create8NeighAdj();
     image = Mat::zeros(num_rows, num_cols, CV_8UC3);
 
-    int max_Label = 0;
     for (int s = 0; s < K; s++)
     {
-        superpixel_size[s] = 0;
-        count_contours[s] = 0;
-    }
-    for (int p = 0; p < num_rows * num_cols; p++)
-    {
-        superpixel_size[L->val[p]]++;
-        max_Label = MAX(max_Label, L->val[p]);
-    }
+        int color = (int)(255 * MIN(1, colorVariance[s]));
 
-    for (int s = 0; s < K; s++)
-        contours[s] = vector<Point>(superpixel_size[s]);
+        gcvt(colorVariance[s], 2, textsConfig[s].text);
+        textsConfig[s].textColor[0] = color < 128 ? 255 : 0;
+        textsConfig[s].textColor[1] = textsConfig[s].textColor[2] = textsConfig[s].textColor[0];
+    }
 
 #ifdef DEBUG
     printf("Iterate over the image pixels.. \n");
@@ -1966,6 +2516,10 @@ void createImageMetric(iftImage *L, double *colorVariance, int num_rows, int num
         NodeCoords coords;
         int label = L->val[p];
 
+        // filtered pixels are left black
+        if (label < 0)
+            continue;
+
         color[0] = color[1] = color[2] = (int)(255 * MIN(1, colorVariance[label])); // get superpixel color according to its error
         border[0] = border[1] = border[2] = (color[0] < 128) ? 255 : 0;
 
@@ -1994,13 +2548,6 @@ void createImageMetric(iftImage *L, double *colorVariance, int num_rows, int num
         }
         if (!isBorder)
             image.at<Vec3b>(Point(coords.x, coords.y)) = color;
-
-        contours[label][count_contours[label]] = Point(coords.x, coords.y);
-        count_contours[label]++;
-
-        gcvt(colorVariance[label], 2, textsConfig[label].text);
-        textsConfig[label].textColor[0] = color[0] < 128 ? 255 : 0;
-        textsConfig[label].textColor[1] = textsConfig[label].textColor[2] = textsConfig[label].textColor[0];
     }
 
 #ifdef DEBUG
@@ -2011,8 +2558,6 @@ void createImageMetric(iftImage *L, double *colorVariance, int num_rows, int num
 
     if (showScores)
     {
-        vector<vector<Point>> contours_poly(contours.size());
-        vector<Rect> boundRect(contours.size());
 
 #ifdef DEBUG
         printf("Draw scores.. \n");
@@ -2022,16 +2567,17 @@ void createImageMetric(iftImage *L, double *colorVariance, int num_rows, int num
         // multidimentional vectors in c++: https://www.geeksforgeeks.org/2d-vector-in-cpp-with-user-defined-size/
         // fin min enclosed rectangle: https://stackoverflow.com/questions/34896431/creating-rectangle-within-a-blob-using-opencv
 
-        for (size_t i = 0; i < contours.size(); ++i)
+        for (int i = 0; i < K; ++i)
         {
-            if (contours[i].size() > 0)
+            if (getLabelSize(index, i) > 0)
             {
                 // Create a mask for each single blob
                 Mat1b maskSingleContour(num_rows, num_cols, uchar(0));
 
-                for (size_t j = 0; j < contours[i].size(); j++)
+                for (int j = index->offsets[i]; j < index->offsets[i + 1]; j++)
                 {
-                    maskSingleContour.at<uchar>(contours[i][j]) = 255;
+                    NodeCoords coords = getNodeCoordsImage(num_cols, index->pixels[j]);
+                    maskSingleContour.at<uchar>(Point(coords.x, coords.y)) = 255;
                 }
 
                 // Find minimum rect for each blob
@@ -2047,23 +2593,121 @@ void createImageMetric(iftImage *L, double *colorVariance, int num_rows, int num
     printf("Write final image.. \n");
 #endif
 
-    imwrite(filename, image);
+    // Moved to the writer: only the header is copied
+    size_t bytes = image.total() * image.elemSize();
+    submitWriteJob(outputWriter, new Mat(std::move(image)), writeMatImage, filename, bytes);
 
 #ifdef DEBUG
     printf("Free structure.. \n");
 #endif
 
     freeNodeAdj(&AdjRel);
+    freeLabelIndex(&own_index);
 }
 
 //==========================================================
 
+// Section of a dir/name input path when it is in the --pack (NULL otherwise)
+bool getPackSection(const char *path, char *section)
+{
+    const char *slash = strrchr(path, '/');
+    int count;
+
+    if (inputPack == NULL || slash == NULL)
+        return false;
+
+    sprintf(section, "%.*s", (int)(slash - path), path);
+    return findPackSection(inputPack, section, &count) != NULL;
+}
+
+// Entry with the stem of a path in a --pack section (see getPackSection), or NULL
+PackEntry *findPackInput(char *path, char *section, char *stem)
+{
+    const char *name = strrchr(path, '/') + 1, *dot = strrchr(name, '.');
+
+    sprintf(stem, "%.*s", (dot != NULL) ? (int)(dot - name) : (int)strlen(name), name);
+    return findPackEntry(inputPack, section, stem);
+}
+
+// Reads an input image: the entry with the same stem in the --pack section, or the file
+iftImage *readInputImage(char *path)
+{
+    char section[512], stem[255];
+
+    if (getPackSection(path, section))
+    {
+        PackEntry *entry = findPackInput(path, section, stem);
+
+        if (entry == NULL)
+            printError("readInputImage", "%s is not in the pack section %s", stem, section);
+        return readPackImage(inputPack, entry);
+    }
+
+    return iftReadImageByExt(path);
+}
+
+// Decodes a file read by a BatchLoader; pack entries, formats without an in-memory decoder
+// and failed reads are read from the path
+iftImage *readLoadedImage(char *path, LoadedFile *file)
+{
+    iftImage *img = NULL;
+
+    if (file != NULL && file->data != NULL && file->error == 0)
+        img = iftReadImageBufferByExt(path, file->data, file->size);
+    return (img != NULL) ? img : readInputImage(path);
+}
+
+// readInputImage that returns NULL, with the error in reason, instead of exiting if path cannot be
+// decoded (see ErrorTrap)
+iftImage *tryReadInputImage(char *path, char *reason, size_t reason_size)
+{
+    ErrorTrap trap;
+    iftImage *img;
+
+    if (setjmp(trap.env) == 0)
+    {
+        setErrorTrap(&trap);
+        img = readInputImage(path);
+        setErrorTrap(NULL);
+    }
+    else
+    {
+        snprintf(reason, reason_size, "%s", trap.message);
+        img = NULL;
+    }
+    return img;
+}
+
+// True if readInputImage can read the path
+bool inputExists(char *path)
+{
+    char section[512], stem[255];
+
+    if (getPackSection(path, section))
+        return findPackInput(path, section, stem) != NULL;
+    return iftFileExists(path);
+}
+
+// First of the (non-empty) paths that readInputImage cannot read, or NULL
+char *findMissingInput(char paths[][512], int num_paths)
+{
+    for (int i = 0; i < num_paths; i++)
+        if (paths[i][0] != '\0' && !inputExists(paths[i]))
+            return paths[i];
+    return NULL;
+}
+
 iftImage *readRGBImage(char *filepath)
 {
-    iftImage *image, *rgb_image;
+    return convertToRGBImage(readInputImage(filepath));
+}
+
+// RGB copy of an image read by iftReadImageByExt (YCbCr for color images); image is destroyed
+iftImage *convertToRGBImage(iftImage *image)
+{
+    iftImage *rgb_image;
     iftColor YCbCr, RGB;
 
-    image = iftReadImageByExt(filepath);
     rgb_image = iftCreateColorImage(image->xsize, image->ysize, image->zsize, 255);
 
     for (int p = 0; p < image->n; p++)
@@ -2090,66 +2734,40 @@ iftImage *readRGBImage(char *filepath)
     return rgb_image;
 }
 
+// CSV label map (see CSVImage.h); xsize and ysize, when not 0, are the expected dimensions
 iftImage *readCSVImage(char *filepath, int xsize, int ysize, int zsize)
 {
-    FILE *fp;
-    iftImage *img;
-    char ch;
+    iftImage *img = readCSVLabels(filepath);
 
-    if (xsize != 0 && ysize != 0)
-        img = iftCreateImage(xsize, ysize, zsize);
-    else
-    {
-        fp = fopen(filepath, "r");
-        if (fp == NULL)
-            printError("readCSVImage", "Could not open the file <%s>", filepath);
+    if ((xsize != 0 && img->xsize != xsize) || (ysize != 0 && img->ysize != ysize) || zsize > 1)
+        printError("readCSVImage", "%s is %dx%d, expected %dx%dx%d", filepath, img->xsize, img->ysize, xsize, ysize, zsize);
 
-        xsize = 0;
-        ysize = 0;
-        while (!feof(fp))
-        {
-            ch = fgetc(fp);
-            if (ch == '\n')
-                ysize++;
-            else if (ch != ',')
-                xsize++;
-        }
-        fclose(fp);
-        img = iftCreateImage(xsize, ysize, zsize);
-    }
+    return img;
+}
 
-    fp = fopen(filepath, "r");
-    if (fp == NULL)
-        printError("readCSVImage", "Could not open the file <%s>", filepath);
+// read a label image and map its labels to 0..K-1, so arbitrary (e.g., hashed) label values do not
+// size per-superpixel arrays. The original label of each dense label is returned in origLabels
+// (optional), to report the ids of the segmentation (see restoreLabelIds)
+iftImage *readLabelImage(char *filepath, int **origLabels, int *numLabels)
+{
+    return compactLabelImage(readInputImage(filepath), origLabels, numLabels);
+}
 
-    int index = 0, val = 0;
-    int num_rows = 0, num_cols = 0;
-    while (!feof(fp))
-    {
-        ch = fgetc(fp);
-        if (ch == ',' || ch != '\n')
-        {
-            if (ch == ',')
-                num_cols++;
-            else
-            {
-                num_rows++;
-                if (num_cols != ysize)
-                    printError("readCSVImage", "Number of columns do not match: %d %d", num_cols, ysize);
-            }
-            img->val[index] = val;
-            val = 0;
-            index++;
-        }
-        else
-            val = val * 10 + (ch - '0');
-    }
-    fclose(fp);
+// In-place version of readLabelImage for an image already read
+iftImage *compactLabelImage(iftImage *labels, int **origLabels, int *numLabels)
+{
+    int *orig, K;
 
-    if (num_rows != xsize)
-        printError("readCSVImage", "Number of rows do not match: %d %d", num_rows, xsize);
+    orig = compactLabels(labels, &K);
 
-    return img;
+    if (numLabels != NULL)
+        (*numLabels) = K;
+    if (origLabels != NULL)
+        (*origLabels) = orig;
+    else
+        free(orig);
+
+    return labels;
 }
 
 // set -1 in the superpixels (at pixel level) that have the same color as the ignoreColor in the gt image.
@@ -2354,8 +2972,7 @@ int mergeSpxBasedOnSize(iftImage *labels, iftImage *orig_img, int min_size,
     NodeAdj *adj_rel = create8NeighAdj();
     int num_merged_spx = 0;
 
-    iftDHeap *heap = iftCreateDHeap(numSuperpixels, superpixel_sizes);
-    heap->removal_policy = MINVAL_POLICY;
+    IndexedHeap<double> heap(numSuperpixels);
 
     for (int i = 0; i < numSuperpixels; i++)
     {
@@ -2415,13 +3032,13 @@ int mergeSpxBasedOnSize(iftImage *labels, iftImage *orig_img, int min_size,
     for (int i = 0; i < numSuperpixels; ++i)
     {
         if (superpixel_sizes[i] > 0 && superpixel_sizes[i] < min_size)
-            iftInsertDHeap(heap, i);
+            heap.push(i, superpixel_sizes[i]);
     }
 
     // set which superpixels should merge
-    while (!iftEmptyDHeap(heap))
+    while (!heap.empty())
     {
-        int i = iftRemoveDHeap(heap);
+        int i = heap.pop();
 
         // compress path
         int old_parent = i;
@@ -2513,11 +3130,10 @@ int mergeSpxBasedOnSize(iftImage *labels, iftImage *orig_img, int min_size,
                 // is after mearging the size is still small, insert it in the heap
                 if (superpixel_sizes[new_parent] < min_size)
                 {
-                    if (heap->color[new_parent] == IFT_GRAY)
-                        iftRemoveDHeapElem(heap, new_parent);
-                    if (heap->color[new_parent] == IFT_BLACK)
-                        heap->color[new_parent] = IFT_WHITE;
-                    iftInsertDHeap(heap, new_parent);
+                    if (heap.contains(new_parent))
+                        heap.increaseKey(new_parent, superpixel_sizes[new_parent]);
+                    else
+                        heap.push(new_parent, superpixel_sizes[new_parent]);
                 }
             }
         }
@@ -2567,7 +3183,6 @@ int mergeSpxBasedOnSize(iftImage *labels, iftImage *orig_img, int min_size,
     for (int i = 0; i < numSuperpixels; ++i)
         free(adjacencyMatrixSpx[i]);
     free(adjacencyMatrixSpx);
-    iftDestroyDHeap(&heap);
     freeNodeAdj(&adj_rel);
 
     return relabelSuperpixels(labels, 8);
@@ -2675,6 +3290,13 @@ int filterDir(const struct dirent *name)
 void readFileInDir(char *file_name, char *dir, const char *ext, char *output)
 {
     struct stat stats; // determine mode : file or path
+    int count;
+
+    if (inputPack != NULL && findPackSection(inputPack, dir, &count) != NULL)
+    {
+        sprintf(output, "%s/%s.%s", dir, file_name, ext); // Read by readInputImage
+        return;
+    }
 
     if (stat(dir, &stats) == -1)
         printError("readFileInDir", "directory %s not found.", dir);
@@ -2704,6 +3326,7 @@ double eval(char *image_name, Args args, int *numSuperpixels)
         printf("SIRS \n"); // Added GT - Changed metric function - Appears to work
 #endif
         iftImage *labels, *image, *gt = NULL;
+        LabelIndex *index;
         double *explainedVariation = NULL, score = 0;
         int maxLabel;
         char fileName[255], labels_path[255], img_path[255], gt_path[255];
@@ -2721,7 +3344,7 @@ double eval(char *image_name, Args args, int *numSuperpixels)
         else
             reconstruction_path = NULL;
 
-        labels = iftReadImageByExt(labels_path);
+        labels = readLabelImage(labels_path, NULL, NULL);
         image = readRGBImage(img_path);
 
         if (image->xsize != labels->xsize || image->ysize != labels->ysize || image->zsize != labels->zsize)
@@ -2729,7 +3352,7 @@ double eval(char *image_name, Args args, int *numSuperpixels)
 
         if (args.removeColor != -1){
             sprintf(gt_path, "%s/%s", args.gt_path, image_name); // Used for mask
-            gt = iftReadImageByExt(gt_path); // Used for mask
+            gt = readInputImage(gt_path); // Used for mask
             removeSuperpixelsByGTColor(labels, gt, args.removeColor); // Used for mask
         }
 
@@ -2739,9 +3362,10 @@ double eval(char *image_name, Args args, int *numSuperpixels)
         }*/
 
         (*numSuperpixels) = relabelSuperpixels(labels, 8);
+        index = createLabelIndex(labels); // shared by SIRS and the scores image
         explainedVariation = SIRS(labels, image, 
                             args.alpha, args.buckets, reconstruction_path, args.gauss_variance, 
-                            &score);
+                            &score, index, NULL);
         if(gt != NULL) iftDestroyImage(&gt);
         iftDestroyImage(&image);
         if (args.imgRecon != NULL) free(reconstruction_path);
@@ -2750,10 +3374,11 @@ double eval(char *image_name, Args args, int *numSuperpixels)
         {
             char *imgScores_path = (char *)malloc(255 * sizeof(char));
             readFileInDir(fileName, args.imgScoresPath, "png", imgScores_path);
-            createImageMetric(labels, explainedVariation, labels->ysize, labels->xsize, imgScores_path, args.drawScores);
+            createImageMetric(labels, explainedVariation, labels->ysize, labels->xsize, imgScores_path, args.drawScores, index);
             free(imgScores_path);
         }
         free(explainedVariation);
+        freeLabelIndex(&index);
         iftDestroyImage(&labels);
 
         return score;
@@ -2781,7 +3406,7 @@ double eval(char *image_name, Args args, int *numSuperpixels)
         else
             reconstruction_path = NULL;
 
-        labels = iftReadImageByExt(labels_path);
+        labels = readLabelImage(labels_path, NULL, NULL);
         image = readRGBImage(img_path);
 
         if (image->xsize != labels->xsize || image->ysize != labels->ysize || image->zsize != labels->zsize)
@@ -2789,7 +3414,7 @@ double eval(char *image_name, Args args, int *numSuperpixels)
 
         if (args.removeColor != -1){
             sprintf(gt_path, "%s/%s", args.gt_path, image_name); // Used for mask
-            gt = iftReadImageByExt(gt_path); // Used for mask
+            gt = readInputImage(gt_path); // Used for mask
             removeSuperpixelsByGTColor(labels, gt, args.removeColor); // Used for mask
         }
 
@@ -2811,7 +3436,7 @@ double eval(char *image_name, Args args, int *numSuperpixels)
         {
             char *imgScores_path = (char *)malloc(255 * sizeof(char));
             readFileInDir(fileName, args.imgScoresPath, "png", imgScores_path);
-            createImageMetric(labels, explainedVariation, labels->ysize, labels->xsize, imgScores_path, args.drawScores);
+            createImageMetric(labels, explainedVariation, labels->ysize, labels->xsize, imgScores_path, args.drawScores, NULL);
             free(imgScores_path);
         }
         free(explainedVariation);
@@ -2833,8 +3458,8 @@ double eval(char *image_name, Args args, int *numSuperpixels)
         readFileInDir(fileName, args.label_path, args.label_ext, labels_path);
         sprintf(img_path, "%s/%s", args.img_path, image_name);
 
-        labels = iftReadImageByExt(labels_path);
-        gt = iftReadImageByExt(img_path);
+        labels = readLabelImage(labels_path, NULL, NULL);
+        gt = readInputImage(img_path);
 
         if (gt->xsize != labels->xsize || gt->ysize != labels->ysize || gt->zsize != labels->zsize)
             printError("eval", "gt image and labels must have the same size");
@@ -2851,7 +3476,7 @@ double eval(char *image_name, Args args, int *numSuperpixels)
         }*/
 
         (*numSuperpixels) = relabelSuperpixels(labels, 8);
-        score = computeBoundaryRecall(labels, gt, 0.0025);
+        score = computeBoundaryRecall(labels, gt, 0.0025, NULL);
         iftDestroyImage(&gt);
         iftDestroyImage(&labels);
         return score;
@@ -2870,8 +3495,8 @@ double eval(char *image_name, Args args, int *numSuperpixels)
         readFileInDir(fileName, args.label_path, args.label_ext, labels_path);
         sprintf(img_path, "%s/%s", args.img_path, image_name);
 
-        labels = iftReadImageByExt(labels_path);
-        gt = iftReadImageByExt(img_path);
+        labels = readLabelImage(labels_path, NULL, NULL);
+        gt = readInputImage(img_path);
 
         if (gt->xsize != labels->xsize || gt->ysize != labels->ysize || gt->zsize != labels->zsize)
             printError("eval", "gt image and labels must have the same size");
@@ -2904,11 +3529,11 @@ double eval(char *image_name, Args args, int *numSuperpixels)
 
         getImageName(image_name, fileName);
         readFileInDir(fileName, args.label_path, args.label_ext, labels_path);
-        labels = iftReadImageByExt(labels_path);
+        labels = readLabelImage(labels_path, NULL, NULL);
         
         if (args.removeColor != -1){
             sprintf(gt_path, "%s/%s", args.gt_path, image_name); // Used for mask
-            gt = iftReadImageByExt(gt_path); // Used for mask
+            gt = readInputImage(gt_path); // Used for mask
             removeSuperpixelsByGTColor(labels, gt, args.removeColor); // Used for mask
         }
         
@@ -2931,19 +3556,22 @@ double eval(char *image_name, Args args, int *numSuperpixels)
 #ifdef DEBUG
         printf("Connectivity \n"); // Added GT - Need to change metric function, will be a problem cause it uses the relabelSuperpixel for the score - free(): invalid pointer
 #endif
-        iftImage *labels, *gt = NULL;
+        iftImage *labels, *gt = NULL, *dense = NULL;
+        int *origLabels, numLabels;
         double score = 0;
         char fileName[255], labels_path[255], gt_path[255];
 
         getImageName(image_name, fileName);
         readFileInDir(fileName, args.label_path, args.label_ext, labels_path);
-        labels = iftReadImageByExt(labels_path);
+        labels = readLabelImage(labels_path, &origLabels, &numLabels);
+        if (args.saveLabels != NULL)
+            dense = iftCopyImage(labels);
         
         (*numSuperpixels) = getNumSuperpixels(labels);
         
         if (args.removeColor != -1){
             sprintf(gt_path, "%s/%s", args.gt_path, image_name); // Used for mask
-            gt = iftReadImageByExt(gt_path); // Used for mask
+            gt = readInputImage(gt_path); // Used for mask
             removeSuperpixelsByGTColor(labels, gt, args.removeColor); // Used for mask
         }
 
@@ -2958,10 +3586,13 @@ double eval(char *image_name, Args args, int *numSuperpixels)
         if (args.saveLabels != NULL)
         {
             char *save_path = (char *)malloc(255 * sizeof(char));
-            readFileInDir(fileName, args.saveLabels, "pgm", save_path);
-            iftWriteImageByExt(labels, save_path);
+            readFileInDir(fileName, args.saveLabels, args.saveExt, save_path);
+            restoreLabelIds(labels, dense, origLabels, numLabels); // split components get new ids
+            iftDestroyImage(&dense);
+            writeImageAsync(outputWriter, &labels, save_path);
             free(save_path);
         }
+        free(origLabels);
         iftDestroyImage(&labels);
         return score;
     }
@@ -2971,18 +3602,21 @@ double eval(char *image_name, Args args, int *numSuperpixels)
 #ifdef DEBUG
         printf("Enforce superpixels' number \n"); // Added GT - I assume it will result in an error but testing is needed
 #endif
-        iftImage *labels, *image, *gt = NULL;
+        iftImage *labels, *image, *gt = NULL, *dense = NULL;
+        int *origLabels, numLabels;
         double score = 0;
-        char fileName[255], labels_path[255], gt_path[255];
+        char fileName[255], labels_path[255], img_path[255], gt_path[255];
 
         getImageName(image_name, fileName);
         readFileInDir(fileName, args.label_path, args.label_ext, labels_path);
         
-        labels = iftReadImageByExt(labels_path);
+        labels = readLabelImage(labels_path, &origLabels, &numLabels);
+        if (args.saveLabels != NULL)
+            dense = iftCopyImage(labels);
         
         if (args.removeColor != -1){
             sprintf(gt_path, "%s/%s", args.gt_path, image_name); // Used for mask
-            gt = iftReadImageByExt(gt_path); // Used for mask
+            gt = readInputImage(gt_path); // Used for mask
             removeSuperpixelsByGTColor(labels, gt, args.removeColor); // Used for mask
         }
         
@@ -2997,23 +3631,28 @@ double eval(char *image_name, Args args, int *numSuperpixels)
         if (args.saveLabels != NULL)
         {
             char *save_path = (char *)malloc(255 * sizeof(char));
-            readFileInDir(fileName, args.saveLabels, "pgm", save_path);
-            image = readRGBImage(save_path);
+            readFileInDir(fileName, args.saveLabels, args.saveExt, save_path);
+            sprintf(img_path, "%s/%s", args.img_path, image_name);
+            image = readRGBImage(img_path);
 
             if (image->xsize != labels->xsize || image->ysize != labels->ysize || image->zsize != labels->zsize)
                 printError("eval", "Image and labels must have the same size");
 
-            score = enforceNumSuperpixel(labels, image, (*numSuperpixels));
+            score = enforceNumSuperpixel(labels, image, args.k, args.mergeMode, args.buckets, args.alpha);
             iftDestroyImage(&image);
 
-            if (score != (*numSuperpixels))
+            if (score < iftMin(args.k, (*numSuperpixels)))
                 printError("eval", "Computing the wrong number of superpixels.");
-            iftWriteImageByExt(labels, save_path);
+            (*numSuperpixels) = score;
+            restoreLabelIds(labels, dense, origLabels, numLabels); // a merged superpixel keeps one of its ids
+            iftDestroyImage(&dense);
+            writeImageAsync(outputWriter, &labels, save_path);
             free(save_path);
         }
         else
             score = 0;
 
+        free(origLabels);
         iftDestroyImage(&labels);
         return score;
     }
@@ -3033,7 +3672,7 @@ double eval(char *image_name, Args args, int *numSuperpixels)
         basename = iftFilename(labels_path, ext);
         sprintf(filename, "%s/%s.png", gt_path, basename);
 
-        labels = iftReadImageByExt(labels_path);
+        labels = readLabelImage(labels_path, NULL, NULL);
         gt = iftReadImageByExt(filename);
 
         // ideally, this should be in args
@@ -3060,13 +3699,13 @@ double eval(char *image_name, Args args, int *numSuperpixels)
         getImageName(image_name, fileName);
 
         readFileInDir(fileName, args.label_path, args.label_ext, labels_path1);
-        labels1 = iftReadImageByExt(labels_path1);
+        labels1 = readLabelImage(labels_path1, NULL, NULL);
         maxLabel = relabelSuperpixels(labels1, labels1->ysize, labels1->xsize, 8);
 
         if(args.label_path2 != NULL){
             char labels_path2[255];
             readFileInDir(fileName, args.label_path2, args.label_ext, labels_path2);
-            labels2 = iftReadImageByExt(labels_path2);
+            labels2 = readLabelImage(labels_path2, NULL, NULL);
             maxLabel = relabelSuperpixels(labels2, labels2->ysize, labels2->xsize, 8);
         }else labels2 = NULL;
 
@@ -3094,11 +3733,11 @@ double eval(char *image_name, Args args, int *numSuperpixels)
         getImageName(image_name, fileName);
         readFileInDir(fileName, args.label_path, args.label_ext, labels_path);
         
-        labels = iftReadImageByExt(labels_path);
+        labels = readLabelImage(labels_path, NULL, NULL);
         
         if (args.removeColor != -1){
             sprintf(gt_path, "%s/%s", args.img_path, image_name); // Used for mask
-            gt = iftReadImageByExt(gt_path); // Used for mask
+            gt = readInputImage(gt_path); // Used for mask
             removeSuperpixelsByGTColor(labels, gt, args.removeColor); // Used for mask
         }
         
@@ -3119,18 +3758,19 @@ double eval(char *image_name, Args args, int *numSuperpixels)
 #ifdef DEBUG
         printf("Count small superpixels \n");
 #endif
-        iftImage *labels, *gt = NULL, *image;
+        iftImage *labels, *gt = NULL, *image, *dense;
+        int *origLabels, numLabels;
         double score = 0;
         char fileName[255], labels_path[255], gt_path[255], save_path[255];
 
         getImageName(image_name, fileName);
         readFileInDir(fileName, args.label_path, args.label_ext, labels_path);
         
-        labels = iftReadImageByExt(labels_path);
+        labels = readLabelImage(labels_path, NULL, NULL);
 
         if (args.removeColor != -1){
             sprintf(gt_path, "%s/%s", args.gt_path, image_name); // Used for mask
-            gt = iftReadImageByExt(gt_path); // Used for mask
+            gt = readInputImage(gt_path); // Used for mask
             removeSuperpixelsByGTColor(labels, gt, args.removeColor); // Used for mask
         }
         
@@ -3146,10 +3786,11 @@ double eval(char *image_name, Args args, int *numSuperpixels)
         {
             char *save_path = (char *)malloc(255 * sizeof(char));
             char img_path[255];
-            readFileInDir(fileName, args.saveLabels, "pgm", save_path);
+            readFileInDir(fileName, args.saveLabels, args.saveExt, save_path);
 
             iftDestroyImage(&labels);
-            labels = iftReadImageByExt(labels_path);
+            labels = readLabelImage(labels_path, &origLabels, &numLabels);
+            dense = iftCopyImage(labels);
             sprintf(img_path, "%s/%s", args.img_path, image_name);
             image = readRGBImage(img_path);
 
@@ -3164,7 +3805,10 @@ double eval(char *image_name, Args args, int *numSuperpixels)
 
             mergeSpxBasedOnSize(labels, image, args.removeSize, gt, ignoreColorGt, NULL);
             iftDestroyImage(&image);
-            iftWriteImageByExt(labels, save_path);
+            restoreLabelIds(labels, dense, origLabels, numLabels);
+            iftDestroyImage(&dense);
+            free(origLabels);
+            writeImageAsync(outputWriter, &labels, save_path);
             free(save_path);
         }
 
@@ -3175,29 +3819,19 @@ double eval(char *image_name, Args args, int *numSuperpixels)
     return -1;
 }
 
+// Base name of the path without its extension (the whole base name if it has none)
 void getImageName(char *fullImgPath, char *fileName)
 {
-    char *imgName;
-    int length, endFileName;
-
-    imgName = fullImgPath;
-    length = strlen(imgName);
+    char *imgName, *ext;
+    int length;
 
-    while (imgName[length] != '.')
-    {
-        length--;
-    }
-    endFileName = length;
-    while (imgName[length] != '/' && length > 0)
-    {
-        length--;
-    }
-    if (imgName[length] == '/')
-        length++;
+    imgName = strrchr(fullImgPath, '/');
+    imgName = (imgName != NULL) ? imgName + 1 : fullImgPath;
+    ext = strrchr(imgName, '.');
+    length = (ext != NULL) ? ext - imgName : strlen(imgName);
 
-    imgName += length;
-    strncpy(fileName, imgName, endFileName - length);
-    fileName[endFileName - length] = '\0';
+    strncpy(fileName, imgName, length);
+    fileName[length] = '\0';
 }
 
 // return true if the file specified
@@ -3208,211 +3842,2225 @@ bool file_exists(const char *filename)
     return (stat(filename, &buffer) == 0 && (buffer.st_mode & S_IFMT) == S_IFREG) ? true : false;
 }
 
-void runDirectory(Args args)
+// Shared inputs of the metrics evaluated on one image
+typedef struct EvalData
 {
-    // determine mode : file or path
-    struct stat sb;
-    double score_path = 0;
-    int numSuperpixels = 0;
+    char name[255]; // image name without extension
+    iftImage *image, *gt, *labels;
+    LabelIndex *index;
+    int *origLabels, numLabels;   // original id of each label of the compacted map (compactLabels)
+    const int *rbdBuckets;        // computeRBDBuckets of image, or NULL (owned by the caller)
+    const unsigned char *gtEdges; // computeGTEdges of gt, or NULL (owned by the caller)
+    const char *reconPath, *scoresPath; // --recon and --imgScores files of a --manifest row, or NULL
+    int numSuperpixels;
+    int position; // of the image in the directory run
+} EvalData;
+
+void destroyEvalDataOnError(void *data);
+
+// dir/<image_name>, or dir itself when it is a file (single file processing). If
+// dir/<image_name> does not exist, a file with the same name and another image
+// extension is used (e.g. pgm ground-truths of ppm images)
+void getInputPath(char *dir, char *image_name, char *output)
+{
+    const char *base = strrchr(image_name, '/'), *exts[] = {"pgm", "png", "ppm", "jpg"};
+    char fileName[255], path[512];
 
-    if (stat(args.img_path, &sb) == -1)
+    if (file_exists(dir))
     {
-        perror("stat");
-        exit(EXIT_SUCCESS);
+        strcpy(output, dir);
+        return;
     }
 
-    int type;
-    switch (sb.st_mode & S_IFMT)
+    sprintf(output, "%s/%s", dir, base != NULL ? base + 1 : image_name);
+    if (file_exists(output))
+        return;
+
+    getImageName(image_name, fileName);
+    for (int i = 0; i < 4; i++)
     {
-    case S_IFDIR:
-        printf("Directory processing: ");
-        type = 0;
-        break;
-    case S_IFREG:
-        printf("Single file processing\n");
-        type = 1;
-        break;
-    default:
-        type = -1;
-        break;
+        sprintf(path, "%s/%s.%s", dir, fileName, exts[i]);
+        if (file_exists(path))
+        {
+            strcpy(output, path);
+            return;
+        }
     }
+}
 
-    if (type == -1)
-        exit(EXIT_SUCCESS);
-    else if (type == 1)
-    {
-        double score_img = 0;
-        char fileName[255];
+// Input files of an image, in EvalPaths order: labels, image and ground-truth
+#define EVAL_FILES 3
+typedef char EvalPaths[EVAL_FILES][512];
 
-        getImageName(args.img_path, fileName);
-        score_img = eval(args.img_path, args, &numSuperpixels);
+// Paths of the label image (unless the labels come from --stream or --daemon) and, if required by the
+// metrics in --eval, of the image and its ground-truth (empty otherwise)
+void getEvalDataPaths(char *image_name, Args args, EvalPaths paths)
+{
+    char name[255];
 
-        // ************************
-        if (args.metric != 8)
-        {
-            if (args.dLogFile != NULL)
-            {
-                bool file_exist = file_exists(args.dLogFile);
-                FILE *fp = fopen(args.dLogFile, "a+");
+    getImageName(image_name, name);
+    paths[0][0] = paths[1][0] = paths[2][0] = '\0';
+    if (args.streamPath == NULL && args.daemonPath == NULL)
+        readFileInDir(name, args.label_path, args.label_ext, paths[0]);
 
-                if (!file_exist)
-                {
-                    if (args.metric < 6)
-                        fprintf(fp, "Image Superpixels Score\n");
-                    else
-                    {
-                        if (args.metric == 6)
-                            fprintf(fp, "Image Superpixels ConnectedSpx\n");
-                        else
-                            fprintf(fp, "Image DesiredSpx Superpixels\n");
-                    }
-                }
+    if (hasMetric(args, 1) || hasMetric(args, 2))
+        getInputPath(args.img_path, image_name, paths[1]);
+    if (hasMetric(args, 3) || hasMetric(args, 4) || args.removeColor != -1)
+        getInputPath(getGTDir(args), image_name, paths[2]);
+}
 
-                if (args.metric == 7)
-                    fprintf(fp, "%s %d %d\n", fileName, args.k, numSuperpixels);
-                else
-                    fprintf(fp, "%s %d %.5f\n", fileName, numSuperpixels, score_img);
-                fclose(fp);
-            }
+/*!
+ * \brief       Decodes the label image and, if required by the metrics in
+ *              --eval, the image and its ground-truth
+ * \param       image_name      Image name with extension (or the image
+ *                              path in single file processing).
+ * \param       args            Command line arguments
+ * \param       paths           Paths from getEvalDataPaths
+ * \param       files           Contents of the paths read by a BatchLoader,
+ *                              or NULL to read them here
+ * \param       labels          Label image already read (a --stream frame),
+ *                              or NULL to read paths[0]
+ * \result      The read data, to be prepared by prepareEvalData
+ */
+EvalData *readLoadedEvalData(char *image_name, Args args, EvalPaths paths, LoadedFile *files, iftImage *labels)
+{
+    EvalData *data = (EvalData *)calloc(1, sizeof(EvalData));
 
-            if (args.metric < 6)
-                printf("Score: %.5f , superpixels: %d \n", score_img, numSuperpixels);
-            else
-            {
-                if (args.metric == 6)
-                    printf("Superpixels: %d , Connected superpixels: %.5f \n", numSuperpixels, score_img);
-                else
-                    printf("Desired superpixels: %d , Generated superpixels: %d \n", args.k, numSuperpixels);
-            }
-        }
-    }
-    else if (type == 0)
-    {
-        // get file list
-        struct dirent **namelist;
-        int n;
+    pushErrorCleanup(destroyEvalDataOnError, &data);
+    getImageName(image_name, data->name);
+    if (labels == NULL)
+        labels = readLoadedImage(paths[0], files != NULL ? &files[0] : NULL);
+    data->labels = labels;
+    compactLabelImage(labels, &data->origLabels, &data->numLabels);
 
-        if (args.img_path != NULL)
-            n = scandir(args.img_path, &namelist, &filterDir, alphasort);
-        else
-            n = scandir(args.label_path, &namelist, &filterDir, alphasort);
+    if (paths[1][0] != '\0')
+    {
+        data->image = convertToRGBImage(readLoadedImage(paths[1], files != NULL ? &files[1] : NULL));
+        if (data->image->xsize != labels->xsize || data->image->ysize != labels->ysize || data->image->zsize != labels->zsize)
+            printError("loadEvalData", "Image and labels must have the same size");
+    }
 
-        if (n == -1)
-        {
-            printf("No images found.\n");
-            perror("scandir");
-            exit(EXIT_FAILURE);
-        }
+    if (paths[2][0] != '\0')
+    {
+        data->gt = readLoadedImage(paths[2], files != NULL ? &files[2] : NULL);
+        if (data->gt->xsize != labels->xsize || data->gt->ysize != labels->ysize || data->gt->zsize != labels->zsize)
+            printError("loadEvalData", "gt image and labels must have the same size");
+    }
 
-        if (n == 0)
-        {
-            printf("No images found.\n");
-            exit(EXIT_SUCCESS);
-        }
-        else
-            printf("%d Images found.\n", n);
+    popErrorCleanup();
+    return data;
+}
 
-        // process file list
+// readLoadedEvalData that returns NULL, with the error in reason, instead of exiting if the files
+// cannot be decoded (see ErrorTrap)
+EvalData *tryReadEvalData(char *image_name, Args args, EvalPaths paths, char *reason, size_t reason_size)
+{
+    ErrorTrap trap;
+    EvalData *data;
 
-        int numImages = n;
-        int sum_num_superpixel = 0;
+    if (setjmp(trap.env) == 0)
+    {
+        setErrorTrap(&trap);
+        data = readLoadedEvalData(image_name, args, paths, NULL, NULL);
+        setErrorTrap(NULL);
+    }
+    else
+    {
+        snprintf(reason, reason_size, "%s", trap.message);
+        data = NULL;
+    }
+    return data;
+}
 
-        while (n--)
-        {
-            char fileName[255];
-            double score_img = 0;
+EvalData *readEvalData(char *image_name, Args args)
+{
+    EvalPaths paths;
 
-            // get image name
-            getImageName(namelist[n]->d_name, fileName);
+    getEvalDataPaths(image_name, args, paths);
+    return readLoadedEvalData(image_name, args, paths, NULL, NULL);
+}
 
-            // ********
-            score_img = eval(namelist[n]->d_name, args, &numSuperpixels);
-            // ********
-            sum_num_superpixel += numSuperpixels;
-            score_path += score_img;
+// Applies the GT mask and the relabeling shared by the metrics in --eval
+void prepareEvalData(EvalData *data, Args args)
+{
+    if (args.removeColor != -1)
+        removeSuperpixelsByGTColor(data->labels, data->gt, args.removeColor); // Used for mask
 
-            if (args.dLogFile != NULL && args.metric != 8)
-            {
-                bool file_exist = file_exists(args.dLogFile);
-                FILE *fp = fopen(args.dLogFile, "a+");
+    data->numSuperpixels = relabelSuperpixels(data->labels, 8);
+    if (hasMetric(args, 1))
+        data->index = createLabelIndex(data->labels);
+}
 
-                if (!file_exist)
-                {
-                    if (args.metric < 6)
-                        fprintf(fp, "Image Superpixels Score\n");
-                    else
-                    {
-                        if (args.metric == 6)
-                            fprintf(fp, "Image Superpixels ConnectedSpx\n");
-                        else
-                            fprintf(fp, "Image DesiredSpx Superpixels\n");
-                    }
-                }
-                if (args.metric == 7)
-                    fprintf(fp, "%s %d %d\n", fileName, args.k, numSuperpixels);
-                else
-                    fprintf(fp, "%s %d %.5lf\n", fileName, numSuperpixels, score_img);
-                fclose(fp);
-            }
+EvalData *loadEvalData(char *image_name, Args args)
+{
+    EvalData *data = readEvalData(image_name, args);
 
-            free(namelist[n]);
-        }
+    prepareEvalData(data, args);
+    return data;
+}
 
-        free(namelist);
+// Memory held by the read images, used for the --prefetchMB cap
+size_t getEvalDataBytes(EvalData *data)
+{
+    iftImage *images[3] = {data->labels, data->image, data->gt};
+    size_t bytes = sizeof(EvalData);
 
-        if (args.logFile != NULL)
-        {
-            bool file_exist = file_exists(args.logFile);
-            FILE *fp = fopen(args.logFile, "a+");
+    for (int i = 0; i < 3; i++)
+        if (images[i] != NULL)
+            bytes += (size_t)images[i]->n * sizeof(int) * (images[i]->Cb != NULL ? 3 : 1);
+    return bytes;
+}
 
-            if (!file_exist)
-            {
-                if (args.metric < 6)
-                    fprintf(fp, "Superpixels Score\n");
-                else
-                {
-                    if (args.metric == 6)
-                        fprintf(fp, "Superpixels ConnectedSpx\n");
-                    else
-                        fprintf(fp, "DesiredSpx Superpixels\n");
-                }
-            }
+void destroyEvalData(EvalData **data)
+{
+    if (*data != NULL)
+    {
+        EvalData *tmp = *data;
+
+        if (tmp->image != NULL)
+            iftDestroyImage(&tmp->image);
+        if (tmp->gt != NULL)
+            iftDestroyImage(&tmp->gt);
+        iftDestroyImage(&tmp->labels);
+        freeLabelIndex(&tmp->index);
+        free(tmp->origLabels);
+        free(tmp);
 
-            if (args.metric == 7)
-                fprintf(fp, "%d %.5f\n", args.k, (double)sum_num_superpixel / (double)numImages);
-            else
-                fprintf(fp, "%.5f %.5f\n", (double)sum_num_superpixel / (double)numImages, score_path / (double)numImages);
-            fclose(fp);
-        }
+        *data = NULL;
     }
 }
 
+// ErrorCleanup of the data being read (see pushErrorCleanup)
+void destroyEvalDataOnError(void *data)
+{
+    destroyEvalData((EvalData **)data);
+}
 
-void runOvlayDir(char *orig_path, char *labels_path, char *gt_path, char *save_path)
+// Output path of --recon/--imgScores (dir), or the file of a --manifest row; suffixed by the metric when both
+// SIRS and EV are evaluated. NULL if there is neither
+char *getMetricOutputPath(EvalData *data, Args args, char *dir, const char *file, int metric, char *output)
 {
-    if (!iftDirExists(labels_path))
-        iftError("Labels directory not found", __func__);
-    if (!iftDirExists(gt_path))
-        iftError("Ground truth directory not found", __func__);
-    if (!iftDirExists(orig_path))
-        iftError("Images directory not found", __func__);
-    if (!iftDirExists(save_path))
-        iftMakeDir(save_path);
+    bool suffix = hasMetric(args, 1) && hasMetric(args, 2);
+    char fileName[300];
 
-    iftColor spxColor, gtColor, overlapColor;
-    // YCbCr = (210, 16, 146)
-    spxColor.val[0] = 210;
-    spxColor.val[1] = 16;
-    spxColor.val[2] = 146;
+    if (file != NULL)
+    {
+        const char *base = strrchr(file, '/'), *ext = strrchr(file, '.');
 
-    // (82, 90, 240);
-    gtColor.val[0] = 82;
-    gtColor.val[1] = 90;
-    gtColor.val[2] = 240;
+        if (!suffix)
+            snprintf(output, 512, "%s", file);
+        else if (ext != NULL && (base == NULL || ext > base))
+            snprintf(output, 512, "%.*s_%s%s", (int)(ext - file), file, getMetricName(metric), ext);
+        else
+            snprintf(output, 512, "%s_%s", file, getMetricName(metric));
+        return output;
+    }
+    if (dir == NULL)
+        return NULL;
 
-    // YCbCr =  (41, 240, 110);
-    overlapColor.val[0] = 41;
-    overlapColor.val[1] = 240;
+    if (suffix)
+        sprintf(fileName, "%s_%s", data->name, getMetricName(metric));
+    else
+        strcpy(fileName, data->name);
+    readFileInDir(fileName, dir, "png", output);
+    return output;
+}
+
+/*!
+ * \brief       Evaluates every metric in --eval on the shared data
+ * \param       data            Data loaded by loadEvalData
+ * \param       args            Command line arguments
+ * \param       scores          (output) One score per metric, in the
+ *                              order given in --eval.
+ */
+void evalMetrics(EvalData *data, Args args, double *scores)
+{
+    for (int m = 0; m < args.num_metrics; m++)
+    {
+        int metric = args.metrics[m];
+        double score = 0;
+
+        if (metric == 1 || metric == 2)
+        {
+            char recon_path[512], imgScores_path[512], *recon, *imgScores;
+            double *explainedVariation;
+
+            recon = getMetricOutputPath(data, args, args.imgRecon, data->reconPath, metric, recon_path);
+            if (metric == 1)
+                explainedVariation = SIRS(data->labels, data->image, args.alpha, args.buckets, recon,
+                                          args.gauss_variance, &score, data->index, data->rbdBuckets);
+            else
+                explainedVariation = computeExplainedVariation(data->labels, data->image, recon, &score);
+
+            imgScores = getMetricOutputPath(data, args, args.imgScoresPath, data->scoresPath, metric, imgScores_path);
+            if (imgScores != NULL)
+                createImageMetric(data->labels, explainedVariation, data->labels->ysize, data->labels->xsize,
+                                  imgScores, args.drawScores, data->index);
+            free(explainedVariation);
+        }
+        else if (metric == 3)
+            score = computeBoundaryRecall(data->labels, data->gt, 0.0025, data->gtEdges);
+        else if (metric == 4)
+            score = computeUndersegmentationError(data->labels, data->gt);
+        else if (metric == 5)
+            score = computeCompactness(data->labels);
+        else if (metric == 9)
+            score = computeRegularity(data->labels);
+
+        scores[m] = score;
+    }
+}
+
+// Scores of one image (a single score unless --eval is a list)
+typedef struct ImageResult
+{
+    char name[255];
+    int numSuperpixels;
+    double scores[MAX_METRICS];
+    bool done;
+    bool resumed; // read from the --journal of a previous run
+} ImageResult;
+
+void evalImage(char *image_name, Args args, ImageResult *result)
+{
+    if (args.num_metrics > 1)
+    {
+        EvalData *data = loadEvalData(image_name, args);
+
+        evalMetrics(data, args, result->scores);
+        result->numSuperpixels = data->numSuperpixels;
+        destroyEvalData(&data);
+    }
+    else
+        result->scores[0] = eval(image_name, args, &result->numSuperpixels);
+
+    getImageName(image_name, result->name);
+}
+
+void writeLogHeader(FILE *fp, Args args, bool perImage)
+{
+    if (perImage)
+        fprintf(fp, "Image ");
+
+    if (args.num_metrics > 1)
+    {
+        fprintf(fp, "Superpixels");
+        for (int m = 0; m < args.num_metrics; m++)
+            fprintf(fp, " %s", getMetricName(args.metrics[m]));
+        fprintf(fp, "\n");
+    }
+    else if (args.metric == 6)
+        fprintf(fp, "Superpixels ConnectedSpx\n");
+    else if (args.metric == 7)
+        fprintf(fp, "DesiredSpx Superpixels\n");
+    else
+        fprintf(fp, "Superpixels Score\n"); // the rows of 1-5, 9 and 10 (see writeResultRow)
+}
+
+// Opens a log in append mode, writing its header if it is a new file
+FILE *openLog(char *path, Args args, bool perImage)
+{
+    bool file_exist = file_exists(path);
+    FILE *fp = fopen(path, "a+");
+
+    if (fp == NULL)
+        printError("openLog", "Could not open %s", path);
+    if (!file_exist)
+        writeLogHeader(fp, args, perImage);
+    return fp;
+}
+
+// openLog with a prefix (e.g. the names of the columns before "Image") in the header
+FILE *openPrefixedLog(char *path, Args args, const char *prefix, bool perImage)
+{
+    bool file_exist = file_exists(path);
+    FILE *fp = fopen(path, "a+");
+
+    if (fp == NULL)
+        printError("openLog", "Could not open %s", path);
+    if (!file_exist)
+    {
+        fprintf(fp, "%s", prefix);
+        writeLogHeader(fp, args, perImage);
+    }
+    return fp;
+}
+
+// Log row with the scores printed with 5 decimals, or with all their digits if exact
+void writeResultRow(FILE *fp, Args args, ImageResult *result, bool exact)
+{
+    const char *format = exact ? " %.17g" : " %.5f";
+
+    if (args.num_metrics > 1)
+    {
+        fprintf(fp, "%s %d", result->name, result->numSuperpixels);
+        for (int m = 0; m < args.num_metrics; m++)
+            fprintf(fp, format, result->scores[m]);
+        fprintf(fp, "\n");
+    }
+    else if (args.metric == 7)
+        fprintf(fp, "%s %d %d\n", result->name, args.k, result->numSuperpixels);
+    else
+    {
+        fprintf(fp, "%s %d", result->name, result->numSuperpixels);
+        fprintf(fp, format, result->scores[0]);
+        fprintf(fp, "\n");
+    }
+}
+
+// --dlog row; the --journal has the exact scores from which main merge recomputes the means of a single run
+void writeLogRow(FILE *fp, Args args, ImageResult *result)
+{
+    writeResultRow(fp, args, result, false);
+}
+
+void printResult(Args args, ImageResult *result)
+{
+    if (args.num_metrics > 1)
+    {
+        printf("Superpixels: %d", result->numSuperpixels);
+        for (int m = 0; m < args.num_metrics; m++)
+            printf(" , %s: %.5f", getMetricName(args.metrics[m]), result->scores[m]);
+        printf("\n");
+    }
+    else if (args.metric < 6)
+        printf("Score: %.5f , superpixels: %d \n", result->scores[0], result->numSuperpixels);
+    else if (args.metric == 6)
+        printf("Superpixels: %d , Connected superpixels: %.5f \n", result->numSuperpixels, result->scores[0]);
+    else
+        printf("Desired superpixels: %d , Generated superpixels: %d \n", args.k, result->numSuperpixels);
+}
+
+// Means over numImages images, the --log row
+void writeMeansRow(FILE *fp, Args args, double sum_num_superpixel, double *sum_scores, long numImages)
+{
+    if (args.num_metrics > 1)
+    {
+        fprintf(fp, "%.5f", sum_num_superpixel / (double)numImages);
+        for (int m = 0; m < args.num_metrics; m++)
+            fprintf(fp, " %.5f", sum_scores[m] / (double)numImages);
+        fprintf(fp, "\n");
+    }
+    else if (args.metric == 7)
+        fprintf(fp, "%d %.5f\n", args.k, sum_num_superpixel / (double)numImages);
+    else
+        fprintf(fp, "%.5f %.5f\n", sum_num_superpixel / (double)numImages, sum_scores[0] / (double)numImages);
+}
+
+// Appends the means over numImages images to --log
+void writeLogMeans(Args args, double sum_num_superpixel, double *sum_scores, long numImages)
+{
+    FILE *fp = openLog(args.logFile, args, false);
+
+    writeMeansRow(fp, args, sum_num_superpixel, sum_scores, numImages);
+    fclose(fp);
+}
+
+// Append-only --journal of a directory run: a --dlog file (header and one row per image, in the
+// order of the --dlog rows) whose scores have full precision. The rows of both files are held in
+// memory until the next sync, which writes the --dlog before the journal, so an image journaled by
+// an interrupted run has its --dlog row
+typedef struct Journal
+{
+    FILE *fp, *dlog; // dlog = NULL without --dlog
+    FILE *pendingJournal, *pendingDlog; // rows since the last sync (memory streams)
+    char *journalRows, *dlogRows;
+    size_t journalSize, dlogSize;
+    int pending, syncEvery; // rows written since the last fsync
+} Journal;
+
+// Result of a journal row (see writeResultRow). False if the row is incomplete
+bool parseJournalRow(char *line, Args args, ImageResult *result)
+{
+    char *tok = strtok(line, " \n");
+    double values[MAX_METRICS + 1];
+    int num_values = (args.num_metrics > 1) ? args.num_metrics + 1 : 2, v = 0;
+
+    if (tok == NULL || strlen(tok) >= sizeof(result->name))
+        return false;
+    snprintf(result->name, sizeof(result->name), "%s", tok);
+    for (tok = strtok(NULL, " \n"); tok != NULL && v < num_values; tok = strtok(NULL, " \n"))
+        values[v++] = atof(tok);
+    if (v != num_values || tok != NULL)
+        return false;
+
+    result->numSuperpixels = (int)values[(args.metric == 7 && args.num_metrics == 1) ? 1 : 0];
+    for (int m = 0; m < num_values - 1; m++)
+        result->scores[m] = values[m + 1];
+    return true;
+}
+
+int compareResultNames(const void *a, const void *b)
+{
+    return strcmp(((const ImageResult *)a)->name, ((const ImageResult *)b)->name);
+}
+
+/*!
+ * \brief       Opens the --journal, creating it if needed. The results of
+ *              the journaled images of namelist are copied to results
+ *              (resumed, so they are not evaluated again). A row cut by the
+ *              end of an interrupted run is discarded
+ */
+Journal *openJournal(Args args, struct dirent **namelist, int numImages, ImageResult *results, FILE *dlog)
+{
+    Journal *journal = (Journal *)calloc(1, sizeof(Journal));
+    char header[1024], line[4096];
+    ImageResult *entries = NULL;
+    int num_entries = 0, capacity = 0, resumed = 0;
+    long valid_end = 0;
+    FILE *fp;
+
+    fp = fmemopen(header, sizeof(header), "w");
+    writeLogHeader(fp, args, true);
+    fclose(fp);
+
+    fp = fopen(args.journalPath, "r");
+    if (fp != NULL)
+    {
+        if (fgets(line, sizeof(line), fp) != NULL)
+        {
+            if (strcmp(line, header) != 0)
+                printError("openJournal", "%s was written with other --eval metrics", args.journalPath);
+            valid_end = ftell(fp);
+        }
+
+        while (fgets(line, sizeof(line), fp) != NULL)
+        {
+            if (num_entries == capacity)
+            {
+                capacity = iftMax(2 * capacity, 1024);
+                entries = (ImageResult *)realloc(entries, capacity * sizeof(ImageResult));
+            }
+            if (line[strlen(line) - 1] != '\n' || !parseJournalRow(line, args, &entries[num_entries]))
+                break;
+            num_entries++;
+            valid_end = ftell(fp);
+        }
+        fclose(fp);
+
+        if (truncate(args.journalPath, valid_end) != 0)
+            printError("openJournal", "Could not truncate %s", args.journalPath);
+    }
+
+    qsort(entries, num_entries, sizeof(ImageResult), compareResultNames);
+    for (int i = 0; i < numImages && num_entries > 0; i++)
+    {
+        ImageResult key, *entry;
+
+        getImageName(namelist[numImages - 1 - i]->d_name, key.name);
+        entry = (ImageResult *)bsearch(&key, entries, num_entries, sizeof(ImageResult), compareResultNames);
+        if (entry != NULL)
+        {
+            results[i] = *entry;
+            results[i].done = results[i].resumed = true;
+            resumed++;
+        }
+    }
+    free(entries);
+    if (resumed > 0)
+        printf("%d images resumed from %s.\n", resumed, args.journalPath);
+
+    journal->fp = fopen(args.journalPath, "a");
+    if (journal->fp == NULL)
+        printError("openJournal", "Could not open %s", args.journalPath);
+    setvbuf(journal->fp, NULL, _IOFBF, 1 << 16);
+    if (valid_end == 0)
+        fputs(header, journal->fp);
+    journal->dlog = dlog;
+    journal->pendingJournal = open_memstream(&journal->journalRows, &journal->journalSize);
+    journal->pendingDlog = open_memstream(&journal->dlogRows, &journal->dlogSize);
+    journal->syncEvery = args.journalSync;
+    return journal;
+}
+
+// Writes the pending rows to the --dlog, then to the journal, fsyncing each
+void syncJournal(Journal *journal)
+{
+    FILE *pending[2] = {journal->pendingDlog, journal->pendingJournal}, *files[2] = {journal->dlog, journal->fp};
+    char **rows[2] = {&journal->dlogRows, &journal->journalRows};
+    size_t *sizes[2] = {&journal->dlogSize, &journal->journalSize};
+
+    for (int f = 0; f < 2; f++)
+    {
+        fflush(pending[f]);
+        if (files[f] != NULL)
+        {
+            fwrite(*rows[f], 1, *sizes[f], files[f]);
+            fflush(files[f]);
+            fsync(fileno(files[f]));
+        }
+        rewind(pending[f]);
+    }
+    journal->pending = 0;
+}
+
+void closeJournal(Journal **journal)
+{
+    if (*journal != NULL)
+    {
+        Journal *tmp = *journal;
+
+        syncJournal(tmp);
+        fclose(tmp->fp);
+        fclose(tmp->pendingJournal);
+        fclose(tmp->pendingDlog);
+        free(tmp->journalRows);
+        free(tmp->dlogRows);
+        free(tmp);
+        *journal = NULL;
+    }
+}
+
+// Writes the rows of the finished images that follow all the previous ones, and journals them in
+// the same order (the resumed images were written by the run that evaluated them)
+void emitResult(Args args, ImageResult *results, int position, int numImages, int *next, FILE *dfp, Journal *journal)
+{
+#pragma omp critical(dlog)
+    {
+        results[position].done = true;
+        while (*next < numImages && results[*next].done)
+        {
+            if (!results[*next].resumed)
+            {
+                if (journal != NULL)
+                {
+                    if (dfp != NULL)
+                        writeLogRow(journal->pendingDlog, args, &results[*next]);
+                    writeResultRow(journal->pendingJournal, args, &results[*next], true);
+                    if (++journal->pending >= journal->syncEvery)
+                        syncJournal(journal);
+                }
+                else if (dfp != NULL)
+                    writeLogRow(dfp, args, &results[*next]);
+            }
+            (*next)++;
+        }
+    }
+}
+
+// True if the metrics can be evaluated from the data read by readEvalData
+bool canReadEvalData(Args args)
+{
+    for (int m = 0; m < args.num_metrics; m++)
+        if (getMetricName(args.metrics[m]) == NULL)
+            return false;
+    return !((hasMetric(args, 3) || hasMetric(args, 4) || args.removeColor != -1) && getGTDir(args) == NULL);
+}
+
+// EvalPaths of a --manifest row: its labels and, if required by the metrics in --eval, its image and
+// ground-truth (the image column is the ground-truth when neither 1 nor 2 is evaluated, as in getGTDir)
+void getManifestPaths(ManifestEntry *entry, Args args, EvalPaths paths)
+{
+    bool needsImage = hasMetric(args, 1) || hasMetric(args, 2);
+    char *gt = (entry->gt != NULL || needsImage) ? entry->gt : entry->image;
+    char *inputs[EVAL_FILES] = {entry->labels, needsImage ? entry->image : NULL,
+                                (hasMetric(args, 3) || hasMetric(args, 4) || args.removeColor != -1) ? gt : NULL};
+
+    paths[0][0] = paths[1][0] = paths[2][0] = '\0';
+    if (needsImage && entry->image == NULL)
+        printError("getManifestPaths", "%s:%ld: the metrics need the image", args.manifestPath, entry->line);
+    if ((hasMetric(args, 3) || hasMetric(args, 4) || args.removeColor != -1) && gt == NULL)
+        printError("getManifestPaths", "%s:%ld: the metrics need the ground-truth", args.manifestPath, entry->line);
+
+    for (int f = 0; f < EVAL_FILES; f++)
+    {
+        if (inputs[f] == NULL)
+            continue;
+        if (strlen(inputs[f]) >= sizeof(paths[f]))
+            printError("getManifestPaths", "%s:%ld: %s is too long", args.manifestPath, entry->line, inputs[f]);
+        strcpy(paths[f], inputs[f]);
+    }
+}
+
+// Names the data of a --manifest row by its id, with the output files of the row
+void setManifestOutputs(EvalData *data, ManifestEntry *entry)
+{
+    snprintf(data->name, sizeof(data->name), "%s", entry->id);
+    data->reconPath = entry->recon;
+    data->scoresPath = entry->imgScores;
+}
+
+// Shared by the I/O threads of runPrefetchPipeline
+typedef struct DecodeContext
+{
+    Args *args;
+    struct dirent **namelist;
+    ManifestEntry *entries; // Rows of a --manifest chunk, read instead of namelist (NULL otherwise)
+    ImageResult *results; // The images resumed from the --journal are skipped
+    int numImages, nextImage, activeThreads;
+    bool warned; // --uring fell back to blocking reads
+    BlockingQueue *queue;
+} DecodeContext;
+
+// With --uring, the files of the next --uring images are read in one batch, then decoded
+void *decodeImages(void *arg)
+{
+    DecodeContext *ctx = (DecodeContext *)arg;
+    int batch = iftMax(ctx->args->uring, 1), first;
+    BatchLoader *loader = NULL;
+    EvalPaths *paths;
+    LoadedFile *files;
+    bool closed = false;
+
+    paths = (EvalPaths *)calloc(batch, sizeof(EvalPaths));
+    files = (LoadedFile *)calloc(batch * EVAL_FILES, sizeof(LoadedFile));
+    if (ctx->args->uring > 0)
+    {
+        loader = createBatchLoader(batch * EVAL_FILES);
+        if (!usesIoUring(loader) && !__atomic_exchange_n(&ctx->warned, true, __ATOMIC_RELAXED))
+            printWarning("decodeImages", "io_uring is not available, --uring uses blocking reads");
+    }
+
+    while (!closed && (first = __atomic_fetch_add(&ctx->nextImage, batch, __ATOMIC_RELAXED)) < ctx->numImages)
+    {
+        int count = iftMin(batch, ctx->numImages - first);
+        char section[512];
+
+        for (int j = 0; j < count; j++)
+        {
+            bool resumed = ctx->results[first + j].resumed;
+
+            if (!resumed && ctx->entries != NULL)
+                getManifestPaths(&ctx->entries[first + j], *ctx->args, paths[j]);
+            else if (!resumed)
+                getEvalDataPaths(ctx->namelist[ctx->numImages - 1 - (first + j)]->d_name, *ctx->args, paths[j]);
+            for (int f = 0; f < EVAL_FILES; f++)
+            {
+                char *path = paths[j][f];
+                files[j * EVAL_FILES + f].path = (!resumed && path[0] != '\0' && !getPackSection(path, section)) ? path : NULL;
+            }
+        }
+        if (loader != NULL)
+            loadFileBatch(loader, files, count * EVAL_FILES);
+
+        for (int j = 0; j < count && !closed; j++)
+        {
+            EvalData *data;
+
+            if (ctx->results[first + j].resumed)
+                continue;
+            if (ctx->entries != NULL)
+            {
+                data = readLoadedEvalData(paths[j][0], *ctx->args, paths[j], loader != NULL ? &files[j * EVAL_FILES] : NULL, NULL);
+                setManifestOutputs(data, &ctx->entries[first + j]);
+            }
+            else
+                data = readLoadedEvalData(ctx->namelist[ctx->numImages - 1 - (first + j)]->d_name, *ctx->args, paths[j],
+                                          loader != NULL ? &files[j * EVAL_FILES] : NULL, NULL);
+            data->position = first + j;
+            if (!pushBlockingQueue(ctx->queue, data, getEvalDataBytes(data)))
+            {
+                destroyEvalData(&data);
+                closed = true;
+            }
+        }
+    }
+
+    freeBatchLoader(&loader);
+    free(paths);
+    free(files);
+
+    // The last I/O thread closes the queue, so the compute threads stop once it is drained
+    if (__atomic_sub_fetch(&ctx->activeThreads, 1, __ATOMIC_ACQ_REL) == 0)
+        closeBlockingQueue(ctx->queue);
+    return NULL;
+}
+
+/*!
+ * \brief       Decode-ahead directory evaluation: --ioThreads threads read
+ *              and decode the next images (of namelist, or the rows of a
+ *              --manifest chunk when entries is not NULL) into a queue of
+ *              --prefetch images (and at most --prefetchMB MB), while
+ *              --threads threads evaluate the decoded ones
+ */
+void runPrefetchPipeline(Args args, struct dirent **namelist, ManifestEntry *entries, int numImages,
+                         ImageResult *results, FILE *dfp, Journal *journal)
+{
+    DecodeContext ctx;
+    pthread_t *io_threads;
+    int next = 0;
+
+    ctx.args = &args;
+    ctx.namelist = namelist;
+    ctx.entries = entries;
+    ctx.results = results;
+    ctx.numImages = numImages;
+    ctx.nextImage = 0;
+    ctx.activeThreads = args.ioThreads;
+    ctx.warned = false;
+    ctx.queue = createBlockingQueue(args.prefetch, (size_t)args.prefetchMB << 20);
+
+    io_threads = (pthread_t *)calloc(args.ioThreads, sizeof(pthread_t));
+    for (int t = 0; t < args.ioThreads; t++)
+        if (pthread_create(&io_threads[t], NULL, decodeImages, &ctx) != 0)
+            printError("runPrefetchPipeline", "Could not create the I/O threads");
+
+#pragma omp parallel num_threads(args.threads) if (args.threads > 1)
+    {
+        EvalData *data;
+
+        while ((data = (EvalData *)popBlockingQueue(ctx.queue)) != NULL)
+        {
+            ImageResult *result = &results[data->position];
+
+            prepareEvalData(data, args);
+            evalMetrics(data, args, result->scores);
+            result->numSuperpixels = data->numSuperpixels;
+            strcpy(result->name, data->name);
+            emitResult(args, results, data->position, numImages, &next, dfp, journal);
+            destroyEvalData(&data);
+        }
+    }
+
+    for (int t = 0; t < args.ioThreads; t++)
+        pthread_join(io_threads[t], NULL);
+    free(io_threads);
+    freeBlockingQueue(&ctx.queue);
+}
+
+// scandir-like listing of a --pack section, sorted by name
+int scanPackSection(char *section, struct dirent ***namelist)
+{
+    PackEntry *entries;
+    int count;
+
+    entries = findPackSection(inputPack, section, &count);
+    *namelist = (struct dirent **)calloc(iftMax(count, 1), sizeof(struct dirent *));
+    for (int i = 0; i < count; i++)
+    {
+        (*namelist)[i] = (struct dirent *)calloc(1, sizeof(struct dirent));
+        snprintf((*namelist)[i]->d_name, sizeof((*namelist)[i]->d_name), "%s", entries[i].name);
+    }
+    return count;
+}
+
+// Shared with the reader thread of runStream
+typedef struct StreamContext
+{
+    Args *args;
+    FILE *fp;
+    BlockingQueue *queue;
+} StreamContext;
+
+// Reads the frames of --stream along with the images (and ground-truths) they are evaluated against
+void *readStreamFrames(void *arg)
+{
+    StreamContext *ctx = (StreamContext *)arg;
+    char id[255];
+    iftImage *labels;
+    EvalPaths paths;
+
+    while (readLabelFrame(ctx->fp, id, sizeof(id), &labels))
+    {
+        EvalData *data;
+
+        getEvalDataPaths(id, *ctx->args, paths);
+        data = readLoadedEvalData(id, *ctx->args, paths, NULL, labels);
+        if (!pushBlockingQueue(ctx->queue, data, getEvalDataBytes(data)))
+        {
+            destroyEvalData(&data);
+            break;
+        }
+    }
+
+    closeBlockingQueue(ctx->queue);
+    return NULL;
+}
+
+/*!
+ * \brief       Evaluates the label frames of --stream (a file, a FIFO or
+ *              "stdin") as they arrive, writing the row of each frame to
+ *              stdout (and --dlog) once it is evaluated. A reader thread
+ *              keeps up to --prefetch frames ready, so the next frame and
+ *              its image are read while the current one is evaluated
+ */
+void runStream(Args args)
+{
+    StreamContext ctx;
+    pthread_t reader;
+    EvalData *data;
+    FILE *dfp = NULL;
+    double sum_num_superpixel = 0, sum_scores[MAX_METRICS] = {0};
+    long numFrames = 0;
+
+    ctx.args = &args;
+    ctx.fp = (strcmp(args.streamPath, "stdin") == 0) ? stdin : fopen(args.streamPath, "rb");
+    if (ctx.fp == NULL)
+        printError("runStream", "Could not open %s", args.streamPath);
+    ctx.queue = createBlockingQueue(iftMax(args.prefetch, 1), (size_t)args.prefetchMB << 20);
+    if (args.dLogFile != NULL)
+        dfp = openLog(args.dLogFile, args, true);
+
+    if (pthread_create(&reader, NULL, readStreamFrames, &ctx) != 0)
+        printError("runStream", "Could not create the reader thread");
+
+    while ((data = (EvalData *)popBlockingQueue(ctx.queue)) != NULL)
+    {
+        ImageResult result;
+
+        prepareEvalData(data, args);
+        evalMetrics(data, args, result.scores);
+        result.numSuperpixels = data->numSuperpixels;
+        strcpy(result.name, data->name);
+        destroyEvalData(&data);
+
+        writeLogRow(stdout, args, &result);
+        fflush(stdout);
+        if (dfp != NULL)
+            writeLogRow(dfp, args, &result);
+
+        sum_num_superpixel += result.numSuperpixels;
+        for (int m = 0; m < args.num_metrics; m++)
+            sum_scores[m] += result.scores[m];
+        numFrames++;
+    }
+
+    pthread_join(reader, NULL);
+    freeBlockingQueue(&ctx.queue);
+    if (ctx.fp != stdin)
+        fclose(ctx.fp);
+    if (dfp != NULL)
+        fclose(dfp);
+
+    if (args.logFile != NULL && numFrames > 0)
+        writeLogMeans(args, sum_num_superpixel, sum_scores, numFrames);
+}
+
+#define DAEMON_MAX_CLIENTS 64
+#define DAEMON_LINE 4096 // longest request line
+
+volatile sig_atomic_t daemonStop = 0; // Set by SIGINT, SIGTERM and the QUIT request
+
+void stopDaemon(int signum)
+{
+    daemonStop = 1;
+}
+
+// Connection of a daemon client, with the part of its next request read so far
+typedef struct DaemonClient
+{
+    int fd;
+    char line[DAEMON_LINE];
+    int length;
+} DaemonClient;
+
+// Shared by the requests of runDaemon
+typedef struct DaemonContext
+{
+    Args *args;
+    ImageCache *cache; // Images and ground-truths decoded by previous requests
+    FILE *dfp;
+    double sum_num_superpixel, sum_scores[MAX_METRICS];
+    long numImages;
+} DaemonContext;
+
+// Image (RGB) or ground-truth of a request, decoded once and then kept in the cache until its file
+// changes. NULL, with the error in reason, if it cannot be decoded
+iftImage *getDaemonInput(ImageCache *cache, char *path, bool rgb, char *reason, size_t reason_size)
+{
+    char key[600];
+    struct stat st;
+    iftImage *img;
+
+    // A file rewritten at the same path gets a new key; pack entries are keyed by their path
+    if (stat(path, &st) == 0)
+        snprintf(key, sizeof(key), "%c:%s:%ld.%09ld:%lld", rgb ? 'i' : 'g', path, (long)st.st_mtim.tv_sec,
+                 (long)st.st_mtim.tv_nsec, (long long)st.st_size);
+    else
+        snprintf(key, sizeof(key), "%c:%s", rgb ? 'i' : 'g', path);
+    img = getCachedImage(cache, key);
+    if (img == NULL)
+    {
+        img = tryReadInputImage(path, reason, reason_size);
+        if (img == NULL)
+            return NULL;
+        if (rgb)
+            img = convertToRGBImage(img);
+        putCachedImage(cache, key, img);
+    }
+    return img;
+}
+
+// False, with the reason, if the decoded inputs of a request would make compactLabelImage, prepareEvalData
+// or evalMetrics fail
+bool checkDaemonData(EvalData *data, Args args, char *reason, size_t reason_size)
+{
+    iftImage *labels = data->labels, *inputs[2] = {data->image, data->gt};
+
+    if (iftIsColorImage(labels) || labels->zsize != 1)
+    {
+        snprintf(reason, reason_size, "The labels of %s must be a 1-channel 2D image", data->name);
+        return false;
+    }
+    for (int i = 0; i < 2; i++)
+        if (inputs[i] != NULL && (inputs[i]->xsize != labels->xsize || inputs[i]->ysize != labels->ysize ||
+                                  inputs[i]->zsize != labels->zsize))
+        {
+            snprintf(reason, reason_size, "The labels of %s do not have the size of its %s", data->name,
+                     i == 0 ? "image" : "ground-truth");
+            return false;
+        }
+
+    if (data->gt != NULL)
+    {
+        int min, max;
+
+        // computeUndersegmentationError indexes its segments by the ground-truth values
+        iftMinMaxValues(data->gt, &min, &max);
+        if (iftIsColorImage(data->gt) || (hasMetric(args, 4) && min < 0))
+        {
+            snprintf(reason, reason_size, "The ground-truth of %s must be 1-channel%s", data->name,
+                     hasMetric(args, 4) ? " with non-negative labels" : "");
+            return false;
+        }
+    }
+
+    for (int p = 0; p < labels->n; p++)
+        if (labels->val[p] >= 0)
+            return true;
+    snprintf(reason, reason_size, "The labels of %s have no superpixel", data->name);
+    return false;
+}
+
+/*!
+ * \brief       Evaluates a request of a daemon client:
+ *                FILE <label path>  label image whose stem names the image in --img
+ *                SHM <name>         label frame (see LabelStream.h) in a POSIX shared
+ *                                   memory object, whose id names the image in --img
+ * \param       reply           "OK <--dlog row>" or "ERROR <reason>", with a newline
+ */
+void evalDaemonRequest(DaemonContext *ctx, char *request, char *reply, size_t reply_size)
+{
+    Args args = *ctx->args;
+    char id[255], reason[512], *image_name, *arg, *missing;
+    iftImage *labels = NULL;
+    ImageResult result;
+    EvalData *data;
+    EvalPaths paths;
+    FILE *fp;
+
+    arg = strchr(request, ' ');
+    if (arg != NULL)
+        *arg++ = '\0';
+    if (arg == NULL || *arg == '\0')
+    {
+        snprintf(reply, reply_size, "ERROR Expected FILE <label path>, SHM <name> or QUIT\n");
+        return;
+    }
+
+    if (strcmp(request, "FILE") == 0)
+    {
+        if (!inputExists(arg))
+        {
+            snprintf(reply, reply_size, "ERROR %s not found\n", arg);
+            return;
+        }
+        if ((labels = tryReadInputImage(arg, reason, sizeof(reason))) == NULL)
+        {
+            snprintf(reply, reply_size, "ERROR %s\n", reason);
+            return;
+        }
+        image_name = arg;
+    }
+    else if (strcmp(request, "SHM") == 0)
+    {
+        if (!readSharedLabelFrame(arg, id, sizeof(id), &labels))
+        {
+            snprintf(reply, reply_size, "ERROR No valid label frame in the shared memory object %s\n", arg);
+            return;
+        }
+        image_name = id;
+    }
+    else
+    {
+        snprintf(reply, reply_size, "ERROR Unknown request %s\n", request);
+        return;
+    }
+
+    getEvalDataPaths(image_name, args, paths);
+    if ((missing = findMissingInput(paths, EVAL_FILES)) != NULL)
+    {
+        snprintf(reply, reply_size, "ERROR %s not found\n", missing);
+        iftDestroyImage(&labels);
+        return;
+    }
+
+    data = (EvalData *)calloc(1, sizeof(EvalData));
+    getImageName(image_name, data->name);
+    data->labels = labels;
+
+    // Only the decoding is trapped (see tryReadInputImage): the checks below reject what would make the
+    // metrics fail, since they must not longjmp out of their C++ objects and OpenMP regions
+    reason[0] = '\0';
+    if (paths[1][0] != '\0')
+        data->image = getDaemonInput(ctx->cache, paths[1], true, reason, sizeof(reason));
+    if (paths[2][0] != '\0' && reason[0] == '\0')
+        data->gt = getDaemonInput(ctx->cache, paths[2], false, reason, sizeof(reason));
+
+    if (reason[0] != '\0' || !checkDaemonData(data, args, reason, sizeof(reason)))
+        snprintf(reply, reply_size, "ERROR %s\n", reason);
+    else
+    {
+        compactLabelImage(data->labels, &data->origLabels, &data->numLabels);
+        prepareEvalData(data, args);
+        if (data->numSuperpixels == 0)
+            snprintf(reply, reply_size, "ERROR The labels of %s have no superpixel\n", data->name);
+        else
+        {
+            evalMetrics(data, args, result.scores);
+            result.numSuperpixels = data->numSuperpixels;
+            strcpy(result.name, data->name);
+
+            fp = fmemopen(reply, reply_size, "w");
+            fprintf(fp, "OK ");
+            writeLogRow(fp, args, &result);
+            fclose(fp);
+
+            if (ctx->dfp != NULL)
+            {
+                writeLogRow(ctx->dfp, args, &result);
+                fflush(ctx->dfp);
+            }
+            ctx->sum_num_superpixel += result.numSuperpixels;
+            for (int m = 0; m < args.num_metrics; m++)
+                ctx->sum_scores[m] += result.scores[m];
+            ctx->numImages++;
+        }
+    }
+
+    // The image and the ground-truth belong to the cache
+    data->image = data->gt = NULL;
+    destroyEvalData(&data);
+    trimImageCache(ctx->cache);
+}
+
+bool sendDaemonReply(int fd, const char *reply)
+{
+    size_t sent = 0, length = strlen(reply);
+
+    while (sent < length)
+    {
+        ssize_t n = send(fd, reply + sent, length - sent, MSG_NOSIGNAL);
+
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        sent += n;
+    }
+    return true;
+}
+
+// Answers the complete request lines of a client, in order. False once the client is gone
+bool serveDaemonClient(DaemonContext *ctx, DaemonClient *client)
+{
+    char reply[1024], *end;
+    ssize_t n;
+
+    n = recv(client->fd, client->line + client->length, DAEMON_LINE - 1 - client->length, 0);
+    if (n <= 0)
+        return n < 0 && errno == EINTR;
+    client->length += n;
+
+    while ((end = (char *)memchr(client->line, '\n', client->length)) != NULL)
+    {
+        int consumed = end - client->line + 1;
+
+        *end = '\0';
+        if (end > client->line && end[-1] == '\r')
+            end[-1] = '\0';
+
+        if (strcmp(client->line, "QUIT") == 0)
+        {
+            daemonStop = 1;
+            sendDaemonReply(client->fd, "OK\n");
+            return false;
+        }
+
+        evalDaemonRequest(ctx, client->line, reply, sizeof(reply));
+        if (!sendDaemonReply(client->fd, reply))
+            return false;
+
+        client->length -= consumed;
+        memmove(client->line, client->line + consumed, client->length);
+    }
+
+    if (client->length == DAEMON_LINE - 1)
+    {
+        sendDaemonReply(client->fd, "ERROR Request too long\n");
+        return false;
+    }
+    return true;
+}
+
+/*!
+ * \brief       Daemon mode: evaluates the requests (see evalDaemonRequest)
+ *              of the clients of the Unix socket --daemon, one line per
+ *              request and per reply, until SIGINT, SIGTERM or a QUIT
+ *              request. The images and ground-truths stay decoded between
+ *              requests, up to --cacheMB MB
+ */
+void runDaemon(Args args)
+{
+    struct pollfd fds[DAEMON_MAX_CLIENTS + 1];
+    DaemonClient *clients;
+    struct sockaddr_un addr;
+    struct sigaction action;
+    DaemonContext ctx;
+    int server, num_clients = 0;
+
+    if (strlen(args.daemonPath) >= sizeof(addr.sun_path))
+        printError("runDaemon", "The socket path %s is too long", args.daemonPath);
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, args.daemonPath);
+
+    // A socket file left by a daemon that did not stop cleanly is replaced
+    server = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (server < 0)
+        printError("runDaemon", "Could not create the socket");
+    if (connect(server, (struct sockaddr *)&addr, sizeof(addr)) == 0)
+        printError("runDaemon", "%s is used by another daemon", args.daemonPath);
+    close(server);
+    unlink(args.daemonPath);
+
+    server = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (bind(server, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(server, 16) != 0)
+        printError("runDaemon", "Could not listen on %s", args.daemonPath);
+
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = stopDaemon; // Without SA_RESTART, so poll returns
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.args = &args;
+    ctx.cache = createImageCache((size_t)args.cacheMB << 20);
+    if (args.dLogFile != NULL)
+        ctx.dfp = openLog(args.dLogFile, args, true);
+    clients = (DaemonClient *)calloc(DAEMON_MAX_CLIENTS, sizeof(DaemonClient));
+
+    printf("Listening on %s\n", args.daemonPath);
+    fflush(stdout);
+
+    while (!daemonStop)
+    {
+        fds[0].fd = server;
+        fds[0].events = POLLIN;
+        for (int i = 0; i < num_clients; i++)
+        {
+            fds[i + 1].fd = clients[i].fd;
+            fds[i + 1].events = POLLIN;
+        }
+
+        if (poll(fds, num_clients + 1, -1) < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            printError("runDaemon", "poll failed");
+        }
+
+        // Backwards, so a closed client can be replaced by the last one
+        for (int i = num_clients - 1; i >= 0 && !daemonStop; i--)
+        {
+            if (fds[i + 1].revents != 0 && !serveDaemonClient(&ctx, &clients[i]))
+            {
+                close(clients[i].fd);
+                clients[i] = clients[--num_clients];
+            }
+        }
+
+        if (!daemonStop && (fds[0].revents & POLLIN))
+        {
+            int fd = accept(server, NULL, NULL);
+
+            if (fd >= 0 && num_clients == DAEMON_MAX_CLIENTS)
+            {
+                sendDaemonReply(fd, "ERROR Too many clients\n");
+                close(fd);
+            }
+            else if (fd >= 0)
+            {
+                clients[num_clients].fd = fd;
+                clients[num_clients].length = 0;
+                num_clients++;
+            }
+        }
+    }
+
+    for (int i = 0; i < num_clients; i++)
+        close(clients[i].fd);
+    free(clients);
+    close(server);
+    unlink(args.daemonPath);
+
+    printf("%ld images evaluated, %ld cached inputs reused\n", ctx.numImages, ctx.cache->hits);
+    freeImageCache(&ctx.cache);
+    if (ctx.dfp != NULL)
+        fclose(ctx.dfp);
+    if (args.logFile != NULL && ctx.numImages > 0)
+        writeLogMeans(args, ctx.sum_num_superpixel, ctx.sum_scores, ctx.numImages);
+}
+
+// Label map queued by the scan of runWatch, as it was then
+typedef struct WatchedFile
+{
+    char name[256];
+    struct timespec mtime;
+    off_t size;
+} WatchedFile;
+
+// Shared with the watcher thread of runWatch
+typedef struct WatchContext
+{
+    Args *args;
+    int fd;       // inotify instance watching --label
+    struct timespec start; // taken after the watch was added, so no file is missed
+    BlockingQueue *queue;
+    WatchedFile *scanned; // Sorted by name
+    int num_scanned;
+} WatchContext;
+
+int compareWatchedFiles(const void *a, const void *b)
+{
+    return strcmp(((const WatchedFile *)a)->name, ((const WatchedFile *)b)->name);
+}
+
+// False for a label map closed after the watch started that the scan already queued unchanged, so it
+// is not evaluated twice
+bool isWatchedLabelChanged(WatchContext *ctx, const char *name)
+{
+    WatchedFile key, *file;
+    char path[512];
+    struct stat st;
+
+    snprintf(key.name, sizeof(key.name), "%s", name);
+    file = (WatchedFile *)bsearch(&key, ctx->scanned, ctx->num_scanned, sizeof(WatchedFile), compareWatchedFiles);
+    if (file == NULL)
+        return true;
+
+    sprintf(path, "%s/%s", ctx->args->label_path, name);
+    if (stat(path, &st) != 0)
+        return true;
+    if (st.st_mtim.tv_sec == file->mtime.tv_sec && st.st_mtim.tv_nsec == file->mtime.tv_nsec && st.st_size == file->size)
+        return false;
+    file->mtime = st.st_mtim;
+    file->size = st.st_size;
+    return true;
+}
+
+// True for the label maps of --label (name.--ext)
+bool isWatchedLabelFile(Args args, const char *name)
+{
+    const char *dot = strrchr(name, '.');
+
+    return dot != NULL && dot != name && strcmp(dot + 1, args.label_ext) == 0;
+}
+
+// Queues a label map with its image and ground-truth. False once the queue is closed
+bool queueWatchedLabels(WatchContext *ctx, char *name)
+{
+    EvalPaths paths;
+    EvalData *data;
+    char reason[512], *missing;
+
+    getEvalDataPaths(name, *ctx->args, paths);
+    if ((missing = findMissingInput(paths, EVAL_FILES)) != NULL)
+    {
+        printWarning("runWatch", "%s skipped, %s not found", name, missing);
+        return true;
+    }
+
+    if ((data = tryReadEvalData(name, *ctx->args, paths, reason, sizeof(reason))) == NULL)
+    {
+        printWarning("runWatch", "%s skipped, %s", name, reason);
+        return true;
+    }
+    if (!pushBlockingQueue(ctx->queue, data, getEvalDataBytes(data)))
+    {
+        destroyEvalData(&data);
+        return false;
+    }
+    return true;
+}
+
+// Label maps last written before the watch started, in alphabetical order, kept in ctx->scanned. True
+// if the sentinel is among them
+bool queueExistingLabels(WatchContext *ctx)
+{
+    struct dirent **namelist;
+    bool sentinel = false;
+    char path[512];
+    struct stat st;
+    int n;
+
+    n = scandir(ctx->args->label_path, &namelist, NULL, alphasort);
+    ctx->scanned = (WatchedFile *)malloc(iftMax(n, 1) * sizeof(WatchedFile));
+    ctx->num_scanned = 0;
+    for (int i = 0; i < n; i++)
+    {
+        char *name = namelist[i]->d_name;
+
+        sprintf(path, "%s/%s", ctx->args->label_path, name);
+        if (strcmp(name, ctx->args->watchSentinel) == 0)
+            sentinel = true;
+        else if (isWatchedLabelFile(*ctx->args, name) && stat(path, &st) == 0 && S_ISREG(st.st_mode) &&
+                 (st.st_mtim.tv_sec < ctx->start.tv_sec ||
+                  (st.st_mtim.tv_sec == ctx->start.tv_sec && st.st_mtim.tv_nsec <= ctx->start.tv_nsec)))
+        {
+            WatchedFile *file = &ctx->scanned[ctx->num_scanned++];
+
+            snprintf(file->name, sizeof(file->name), "%s", name);
+            file->mtime = st.st_mtim;
+            file->size = st.st_size;
+            queueWatchedLabels(ctx, name);
+        }
+        free(namelist[i]);
+    }
+    if (n >= 0)
+        free(namelist);
+    qsort(ctx->scanned, ctx->num_scanned, sizeof(WatchedFile), compareWatchedFiles);
+    return sentinel;
+}
+
+// Queues the label maps of --label as their writers close them (or move them in), until the sentinel appears
+void *watchLabels(void *arg)
+{
+    WatchContext *ctx = (WatchContext *)arg;
+    char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    bool done;
+
+    done = queueExistingLabels(ctx);
+    while (!done)
+    {
+        ssize_t length = read(ctx->fd, buf, sizeof(buf));
+
+        if (length < 0 && errno == EINTR)
+            continue;
+        if (length <= 0)
+            printError("runWatch", "Could not read the inotify events of %s", ctx->args->label_path);
+
+        for (char *ptr = buf; ptr < buf + length && !done;)
+        {
+            struct inotify_event *event = (struct inotify_event *)ptr;
+
+            ptr += sizeof(struct inotify_event) + event->len;
+            if (event->mask & IN_Q_OVERFLOW)
+                printWarning("runWatch", "inotify queue overflow, some label maps were missed");
+            else if (event->mask & (IN_IGNORED | IN_DELETE_SELF))
+                printError("runWatch", "%s was removed", ctx->args->label_path);
+            else if (event->len == 0)
+                continue;
+            else if (strcmp(event->name, ctx->args->watchSentinel) == 0)
+                done = true;
+            else if ((event->mask & (IN_CLOSE_WRITE | IN_MOVED_TO)) && isWatchedLabelFile(*ctx->args, event->name) &&
+                     isWatchedLabelChanged(ctx, event->name))
+                done = !queueWatchedLabels(ctx, event->name); // Complete: not on IN_CREATE
+        }
+    }
+
+    free(ctx->scanned);
+    closeBlockingQueue(ctx->queue);
+    return NULL;
+}
+
+/*!
+ * \brief       Watch-folder mode: evaluates each label map of --label as
+ *              soon as its writer closes it, overlapping the evaluation
+ *              with the segmentation that produces the maps. The label maps
+ *              already in --label are evaluated first. A watcher thread
+ *              decodes up to --prefetch maps (and their images) ahead for
+ *              --threads evaluation threads; each row is written to stdout
+ *              and --dlog when it is ready. Stops once the --watch sentinel
+ *              file is created in --label and the queued maps are evaluated
+ */
+void runWatch(Args args)
+{
+    WatchContext ctx;
+    pthread_t watcher;
+    FILE *dfp = NULL;
+    double sum_num_superpixel = 0, sum_scores[MAX_METRICS] = {0};
+    long numImages = 0;
+
+    if (!iftDirExists(args.label_path))
+        printError("runWatch", "--watch requires --label to be a directory");
+
+    ctx.args = &args;
+    ctx.fd = inotify_init1(IN_CLOEXEC);
+    if (ctx.fd < 0 || inotify_add_watch(ctx.fd, args.label_path, IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE | IN_DELETE_SELF) < 0)
+        printError("runWatch", "Could not watch %s", args.label_path);
+    clock_gettime(CLOCK_REALTIME, &ctx.start);
+    ctx.queue = createBlockingQueue(iftMax(args.prefetch, 1), (size_t)args.prefetchMB << 20);
+    if (args.dLogFile != NULL)
+        dfp = openLog(args.dLogFile, args, true);
+
+    printf("Watching %s until %s is created\n", args.label_path, args.watchSentinel);
+    fflush(stdout);
+    if (pthread_create(&watcher, NULL, watchLabels, &ctx) != 0)
+        printError("runWatch", "Could not create the watcher thread");
+
+#pragma omp parallel num_threads(args.threads) if (args.threads > 1)
+    {
+        EvalData *data;
+
+        while ((data = (EvalData *)popBlockingQueue(ctx.queue)) != NULL)
+        {
+            ImageResult result;
+
+            prepareEvalData(data, args);
+            evalMetrics(data, args, result.scores);
+            result.numSuperpixels = data->numSuperpixels;
+            strcpy(result.name, data->name);
+            destroyEvalData(&data);
+
+#pragma omp critical(dlog)
+            {
+                writeLogRow(stdout, args, &result);
+                fflush(stdout);
+                if (dfp != NULL)
+                {
+                    writeLogRow(dfp, args, &result);
+                    fflush(dfp);
+                }
+                sum_num_superpixel += result.numSuperpixels;
+                for (int m = 0; m < args.num_metrics; m++)
+                    sum_scores[m] += result.scores[m];
+                numImages++;
+            }
+        }
+    }
+
+    pthread_join(watcher, NULL);
+    freeBlockingQueue(&ctx.queue);
+    close(ctx.fd);
+    if (dfp != NULL)
+        fclose(dfp);
+
+    if (args.logFile != NULL && numImages > 0)
+        writeLogMeans(args, sum_num_superpixel, sum_scores, numImages);
+}
+
+// Shard of an image: FNV-1a of its stem modulo --shard n, so every node picks the same images
+// whatever their extension or the other files in the directory
+int getImageShard(char *image_name, int numShards)
+{
+    char stem[255];
+    uint64_t hash = 14695981039346656037ULL;
+
+    getImageName(image_name, stem);
+    for (const char *c = stem; *c != '\0'; c++)
+    {
+        hash ^= (unsigned char)*c;
+        hash *= 1099511628211ULL;
+    }
+    return (int)(hash % (uint64_t)numShards);
+}
+
+// Keeps the images of the --shard in namelist (in order) and returns their number
+int filterShard(Args args, struct dirent **namelist, int n)
+{
+    int kept = 0;
+
+    for (int i = 0; i < n; i++)
+    {
+        if (getImageShard(namelist[i]->d_name, args.numShards) == args.shardIndex)
+            namelist[kept++] = namelist[i];
+        else
+            free(namelist[i]);
+    }
+    return kept;
+}
+
+void runDirectory(Args args)
+{
+    // determine mode : file or path
+    struct stat sb;
+    bool inPack;
+    int count;
+
+    inPack = inputPack != NULL && findPackSection(inputPack, args.img_path, &count) != NULL;
+    if (inPack)
+        sb.st_mode = S_IFDIR; // The section is processed as a directory
+    else if (stat(args.img_path, &sb) == -1)
+    {
+        perror("stat");
+        exit(EXIT_SUCCESS);
+    }
+
+    int type;
+    switch (sb.st_mode & S_IFMT)
+    {
+    case S_IFDIR:
+        printf("Directory processing: ");
+        type = 0;
+        break;
+    case S_IFREG:
+        printf("Single file processing\n");
+        type = 1;
+        break;
+    default:
+        type = -1;
+        break;
+    }
+
+    if (type == -1)
+        exit(EXIT_SUCCESS);
+    else if (type == 1)
+    {
+        ImageResult result;
+
+        evalImage(args.img_path, args, &result);
+
+        // ************************
+        if (args.metric != 8)
+        {
+            if (args.dLogFile != NULL)
+            {
+                FILE *fp = openLog(args.dLogFile, args, true);
+                writeLogRow(fp, args, &result);
+                fclose(fp);
+            }
+            printResult(args, &result);
+        }
+    }
+    else if (type == 0)
+    {
+        // get file list
+        struct dirent **namelist;
+        ImageResult *results;
+        Journal *journal = NULL;
+        FILE *dfp = NULL;
+        int n, next = 0;
+
+        if (inPack)
+            n = scanPackSection(args.img_path, &namelist);
+        else if (args.img_path != NULL)
+            n = scandir(args.img_path, &namelist, &filterDir, alphasort);
+        else
+            n = scandir(args.label_path, &namelist, &filterDir, alphasort);
+
+        if (n == -1)
+        {
+            printf("No images found.\n");
+            perror("scandir");
+            exit(EXIT_FAILURE);
+        }
+
+        if (n == 0)
+        {
+            printf("No images found.\n");
+            exit(EXIT_SUCCESS);
+        }
+        else if (args.numShards > 1)
+        {
+            int total = n;
+
+            n = filterShard(args, namelist, total);
+            printf("%d Images found, %d in shard %d/%d.\n", total, n, args.shardIndex, args.numShards);
+            if (n == 0)
+                exit(EXIT_SUCCESS);
+        }
+        else
+            printf("%d Images found.\n", n);
+
+        // process file list
+
+        int numImages = n;
+
+        results = (ImageResult *)calloc(numImages, sizeof(ImageResult));
+        if (args.dLogFile != NULL && args.metric != 8)
+        {
+            dfp = openLog(args.dLogFile, args, true);
+            setvbuf(dfp, NULL, _IOFBF, 1 << 16);
+        }
+        if (args.journalPath != NULL)
+            journal = openJournal(args, namelist, numImages, results, dfp);
+
+        // Images are evaluated concurrently with --threads (intra-image parallelism otherwise). The
+        // rows are written in the sequential order (reverse alphabetical): a finished image waits
+        // in results until all the previous ones are written
+        if (args.prefetch > 0 && canReadEvalData(args))
+            runPrefetchPipeline(args, namelist, NULL, numImages, results, dfp, journal);
+        else
+        {
+            if (args.prefetch > 0)
+                printWarning("runDirectory", "--prefetch is only available for metrics 1,2,3,4,5,9");
+            if (args.uring > 0)
+                printWarning("runDirectory", "--uring is only used by the --prefetch I/O threads");
+
+#pragma omp parallel for schedule(dynamic) num_threads(args.threads) if (args.threads > 1)
+            for (int i = 0; i < numImages; i++)
+            {
+                if (results[i].resumed)
+                    continue;
+                // ********
+                evalImage(namelist[numImages - 1 - i]->d_name, args, &results[i]);
+                // ********
+                emitResult(args, results, i, numImages, &next, dfp, journal);
+            }
+        }
+
+        closeJournal(&journal); // before the --dlog, which gets its pending rows
+        if (dfp != NULL)
+            fclose(dfp);
+
+        for (int i = 0; i < numImages; i++)
+            free(namelist[i]);
+        free(namelist);
+
+        if (args.logFile != NULL)
+        {
+            double sum_num_superpixel = 0, sum_scores[MAX_METRICS] = {0};
+
+            // Reduced in image order, so the means do not depend on the number of threads
+            for (int i = 0; i < numImages; i++)
+            {
+                sum_num_superpixel += results[i].numSuperpixels;
+                for (int m = 0; m < args.num_metrics; m++)
+                    sum_scores[m] += results[i].scores[m];
+            }
+            writeLogMeans(args, sum_num_superpixel, sum_scores, numImages);
+        }
+
+        free(results);
+    }
+}
+
+
+#define MANIFEST_CHUNK 4096 // --manifest rows read (and evaluated) at a time
+
+// evalImage of a --manifest row
+void evalManifestEntry(ManifestEntry *entry, Args args, ImageResult *result)
+{
+    EvalPaths paths;
+    EvalData *data;
+
+    getManifestPaths(entry, args, paths);
+    data = readLoadedEvalData(paths[0], args, paths, NULL, NULL);
+    setManifestOutputs(data, entry);
+    prepareEvalData(data, args);
+    evalMetrics(data, args, result->scores);
+    result->numSuperpixels = data->numSuperpixels;
+    strcpy(result->name, data->name);
+    destroyEvalData(&data);
+}
+
+/*!
+ * \brief       Evaluates the rows of --manifest, read MANIFEST_CHUNK rows at
+ *              a time. Each chunk runs on the executor of runDirectory
+ *              (--threads, or the --prefetch pipeline) and its --dlog rows
+ *              keep the manifest order; the means of --log are reduced over
+ *              all the chunks
+ */
+void runManifest(Args args)
+{
+    Manifest *manifest = openManifest(args.manifestPath);
+    ManifestEntry *entries = (ManifestEntry *)calloc(MANIFEST_CHUNK, sizeof(ManifestEntry));
+    ImageResult *results = (ImageResult *)calloc(MANIFEST_CHUNK, sizeof(ImageResult));
+    double sum_num_superpixel = 0, sum_scores[MAX_METRICS] = {0};
+    long numImages = 0, numRows = 0;
+    FILE *dfp = NULL;
+    int n;
+
+    if (args.dLogFile != NULL)
+    {
+        dfp = openLog(args.dLogFile, args, true);
+        setvbuf(dfp, NULL, _IOFBF, 1 << 16);
+    }
+    if (args.uring > 0 && args.prefetch == 0)
+        printWarning("runManifest", "--uring is only used by the --prefetch I/O threads");
+
+    while ((n = readManifestChunk(manifest, entries, MANIFEST_CHUNK)) > 0)
+    {
+        int total = n, next = 0;
+
+        numRows += n;
+        if (args.numShards > 1)
+        {
+            n = 0;
+            for (int i = 0; i < total; i++)
+            {
+                if (getImageShard(entries[i].id, args.numShards) == args.shardIndex)
+                {
+                    if (n != i)
+                    {
+                        ManifestEntry tmp = entries[n];
+
+                        entries[n] = entries[i];
+                        entries[i] = tmp; // Freed with the chunk
+                    }
+                    n++;
+                }
+            }
+        }
+
+        memset(results, 0, n * sizeof(ImageResult));
+        if (args.prefetch > 0)
+            runPrefetchPipeline(args, NULL, entries, n, results, dfp, NULL);
+        else
+        {
+#pragma omp parallel for schedule(dynamic) num_threads(args.threads) if (args.threads > 1)
+            for (int i = 0; i < n; i++)
+            {
+                evalManifestEntry(&entries[i], args, &results[i]);
+                emitResult(args, results, i, n, &next, dfp, NULL);
+            }
+        }
+
+        for (int i = 0; i < n; i++)
+        {
+            sum_num_superpixel += results[i].numSuperpixels;
+            for (int m = 0; m < args.num_metrics; m++)
+                sum_scores[m] += results[i].scores[m];
+        }
+        numImages += n;
+        clearManifestEntries(entries, total);
+    }
+
+    if (args.numShards > 1)
+        printf("%ld rows in %s, %ld in shard %d/%d.\n", numRows, args.manifestPath, numImages, args.shardIndex,
+               args.numShards);
+    else
+        printf("%ld rows in %s.\n", numRows, args.manifestPath);
+
+    if (dfp != NULL)
+        fclose(dfp);
+    if (args.logFile != NULL && numImages > 0)
+        writeLogMeans(args, sum_num_superpixel, sum_scores, numImages);
+
+    closeManifest(&manifest);
+    free(entries);
+    free(results);
+}
+
+// Name of a method of a --label list: the last component of its directory
+void getMethodName(char *dir, char *name)
+{
+    char tmp[512], *base;
+    size_t length;
+
+    snprintf(tmp, sizeof(tmp), "%s", dir);
+    length = strlen(tmp);
+    while (length > 1 && tmp[length - 1] == '/')
+        tmp[--length] = '\0';
+    base = strrchr(tmp, '/');
+    strcpy(name, (base != NULL && base[1] != '\0') ? base + 1 : tmp);
+}
+
+// Means of the label maps of a --sweep K value
+typedef struct SweepPoint
+{
+    const char *k;
+    double numSuperpixels;
+    double scores[MAX_METRICS];
+} SweepPoint;
+
+int compareSweepPoints(const void *a, const void *b)
+{
+    double x = ((const SweepPoint *)a)->numSuperpixels, y = ((const SweepPoint *)b)->numSuperpixels;
+
+    return (x > y) - (x < y);
+}
+
+/*!
+ * \brief       Appends the curve of a --sweep to --curve: the means of each
+ *              K value or, with --kGrid, the scores at each grid number of
+ *              superpixels, linearly interpolated between the two K values
+ *              whose actual mean numbers of superpixels surround it. Grid
+ *              values outside the measured range are skipped
+ */
+void writeSweepCurve(Args args, char (*names)[255], double *sum_num_superpixel, double (*sum_scores)[MAX_METRICS],
+                     long *numImages)
+{
+    SweepPoint *points = (SweepPoint *)calloc(args.num_methods, sizeof(SweepPoint));
+    int num_points = 0;
+    FILE *fp;
+
+    for (int m = 0; m < args.num_methods; m++)
+    {
+        if (numImages[m] == 0)
+            continue;
+        points[num_points].k = names[m];
+        points[num_points].numSuperpixels = sum_num_superpixel[m] / (double)numImages[m];
+        for (int k = 0; k < args.num_metrics; k++)
+            points[num_points].scores[k] = sum_scores[m][k] / (double)numImages[m];
+        num_points++;
+    }
+
+    fp = openPrefixedLog(args.curvePath, args, "Sweep K ", false);
+    if (args.num_kGrid == 0)
+    {
+        for (int p = 0; p < num_points; p++)
+        {
+            fprintf(fp, "%s %s ", args.sweepPath, points[p].k);
+            writeMeansRow(fp, args, points[p].numSuperpixels, points[p].scores, 1);
+        }
+    }
+    else
+    {
+        qsort(points, num_points, sizeof(SweepPoint), compareSweepPoints);
+        for (int g = 0; g < args.num_kGrid; g++)
+        {
+            double x = args.kGrid[g], scores[MAX_METRICS], t;
+            int p = 0;
+
+            if (num_points == 0 || x < points[0].numSuperpixels || x > points[num_points - 1].numSuperpixels)
+            {
+                printWarning("writeSweepCurve", "%d superpixels is outside the curve of %s, skipped", args.kGrid[g],
+                             args.sweepPath);
+                continue;
+            }
+
+            while (p < num_points - 1 && points[p + 1].numSuperpixels < x)
+                p++;
+            // the last point (e.g. a single K value) or a duplicated number of superpixels has no
+            // segment to interpolate on
+            if (p == num_points - 1 || points[p + 1].numSuperpixels == points[p].numSuperpixels)
+                t = 0;
+            else
+                t = (x - points[p].numSuperpixels) / (points[p + 1].numSuperpixels - points[p].numSuperpixels);
+            for (int k = 0; k < args.num_metrics; k++)
+                scores[k] = (t == 0) ? points[p].scores[k] : (1 - t) * points[p].scores[k] + t * points[p + 1].scores[k];
+
+            fprintf(fp, "%s %d ", args.sweepPath, args.kGrid[g]);
+            writeMeansRow(fp, args, x, scores, 1);
+        }
+    }
+    fclose(fp);
+    free(points);
+}
+
+/*!
+ * \brief       Evaluates the label directories of args.methodPaths (the
+ *              methods of a --label list or the K values of a --sweep).
+ *              Each image and its ground-truth are decoded once, with the
+ *              RBD buckets of SIRS and the ground-truth edges of BR, and
+ *              shared by the label maps of every directory. The --dlog has
+ *              one row per image and directory, --deltaLog the differences
+ *              between every pair of directories on each image, --log the
+ *              means of each directory and --curve those of the --sweep
+ * \param       args            Command line arguments
+ * \param       names           Name of each directory in the logs
+ * \param       column          Header of the names (e.g. "Method")
+ */
+void runMethods(Args args, char (*names)[255], const char *column)
+{
+    struct dirent **namelist;
+    ImageResult *results; // num_methods per image; done = the label map exists
+    double *sum_num_superpixel, (*sum_scores)[MAX_METRICS];
+    long *numImages;
+    char prefix[64];
+    bool inPack;
+    int n, count;
+
+    inPack = inputPack != NULL && findPackSection(inputPack, args.img_path, &count) != NULL;
+    if (!inPack && !iftDirExists(args.img_path))
+        printError("runMethods", "--img must be a directory");
+
+    n = inPack ? scanPackSection(args.img_path, &namelist) : scandir(args.img_path, &namelist, &filterDir, alphasort);
+    if (n <= 0)
+    {
+        printf("No images found.\n");
+        exit(n == 0 ? EXIT_SUCCESS : EXIT_FAILURE);
+    }
+    if (args.numShards > 1)
+    {
+        int total = n;
+
+        n = filterShard(args, namelist, total);
+        printf("%d Images found, %d in shard %d/%d, %d label directories.\n", total, n, args.shardIndex, args.numShards,
+               args.num_methods);
+        if (n == 0)
+            exit(EXIT_SUCCESS);
+    }
+    else
+        printf("%d Images found, %d label directories.\n", n, args.num_methods);
+    if (args.prefetch > 0)
+        printWarning("runMethods", "--prefetch is not used with a --label list or --sweep");
+
+    results = (ImageResult *)calloc((size_t)n * args.num_methods, sizeof(ImageResult));
+
+#pragma omp parallel for schedule(dynamic) num_threads(args.threads) if (args.threads > 1)
+    for (int i = 0; i < n; i++)
+    {
+        char *image_name = namelist[n - 1 - i]->d_name, labels_path[512], stem[255];
+        ImageResult *imageResults = &results[(size_t)i * args.num_methods];
+        iftImage *image = NULL, *gt = NULL;
+        int *rbdBuckets = NULL;
+        unsigned char *gtEdges = NULL;
+        EvalPaths paths;
+        int found = 0;
+
+        getImageName(image_name, stem);
+        for (int m = 0; m < args.num_methods; m++)
+        {
+            readFileInDir(stem, args.methodPaths[m], args.label_ext, labels_path);
+            imageResults[m].done = inputExists(labels_path);
+            if (imageResults[m].done)
+                found++;
+            else
+                printWarning("runMethods", "%s not found, skipped", labels_path);
+        }
+        if (found == 0)
+            continue;
+
+        // Shared by the label maps of every method
+        getEvalDataPaths(image_name, args, paths);
+        if (paths[1][0] != '\0')
+        {
+            image = convertToRGBImage(readInputImage(paths[1]));
+            if (hasMetric(args, 1))
+                rbdBuckets = computeRBDBuckets(image, args.buckets);
+        }
+        if (paths[2][0] != '\0')
+        {
+            gt = readInputImage(paths[2]);
+            if (hasMetric(args, 3))
+                gtEdges = computeGTEdges(gt);
+        }
+
+        for (int m = 0; m < args.num_methods; m++)
+        {
+            EvalData *data;
+
+            if (!imageResults[m].done)
+                continue;
+
+            readFileInDir(stem, args.methodPaths[m], args.label_ext, labels_path);
+            data = (EvalData *)calloc(1, sizeof(EvalData));
+            snprintf(data->name, sizeof(data->name), "%.127s_%.126s", stem, names[m]); // --recon and --imgScores of each method
+            data->labels = compactLabelImage(readInputImage(labels_path), &data->origLabels, &data->numLabels);
+            data->image = image;
+            data->gt = gt;
+            data->rbdBuckets = rbdBuckets;
+            data->gtEdges = gtEdges;
+            if ((image != NULL && (image->xsize != data->labels->xsize || image->ysize != data->labels->ysize ||
+                                   image->zsize != data->labels->zsize)) ||
+                (gt != NULL && (gt->xsize != data->labels->xsize || gt->ysize != data->labels->ysize ||
+                                gt->zsize != data->labels->zsize)))
+            {
+                // like a missing label map, only this method is skipped on this image
+                printWarning("runMethods", "%s and its image must have the same size, skipped", labels_path);
+                imageResults[m].done = false;
+            }
+            else
+            {
+                prepareEvalData(data, args);
+                evalMetrics(data, args, imageResults[m].scores);
+                imageResults[m].numSuperpixels = data->numSuperpixels;
+                strcpy(imageResults[m].name, stem);
+            }
+
+            data->image = data->gt = NULL; // Shared by the methods
+            destroyEvalData(&data);
+        }
+
+        if (image != NULL)
+            iftDestroyImage(&image);
+        if (gt != NULL)
+            iftDestroyImage(&gt);
+        free(rbdBuckets);
+        free(gtEdges);
+    }
+
+    // Rows in the order of runDirectory, the directories of an image in the order of args.methodPaths
+    if (args.dLogFile != NULL)
+    {
+        FILE *dfp;
+
+        snprintf(prefix, sizeof(prefix), "%s ", column);
+        dfp = openPrefixedLog(args.dLogFile, args, prefix, true);
+
+        for (int i = 0; i < n; i++)
+        {
+            for (int m = 0; m < args.num_methods; m++)
+            {
+                if (!results[(size_t)i * args.num_methods + m].done)
+                    continue;
+                fprintf(dfp, "%s ", names[m]);
+                writeLogRow(dfp, args, &results[(size_t)i * args.num_methods + m]);
+            }
+        }
+        fclose(dfp);
+    }
+
+    if (args.deltaLogPath != NULL)
+    {
+        FILE *dfp;
+
+        snprintf(prefix, sizeof(prefix), "%sA %sB ", column, column);
+        dfp = openPrefixedLog(args.deltaLogPath, args, prefix, true);
+
+        for (int i = 0; i < n; i++)
+        {
+            ImageResult *imageResults = &results[(size_t)i * args.num_methods];
+
+            for (int a = 0; a < args.num_methods; a++)
+            {
+                for (int b = a + 1; b < args.num_methods; b++)
+                {
+                    ImageResult delta = imageResults[a];
+
+                    if (!imageResults[a].done || !imageResults[b].done)
+                        continue;
+                    delta.numSuperpixels -= imageResults[b].numSuperpixels;
+                    for (int m = 0; m < args.num_metrics; m++)
+                        delta.scores[m] -= imageResults[b].scores[m];
+                    fprintf(dfp, "%s %s ", names[a], names[b]);
+                    writeLogRow(dfp, args, &delta);
+                }
+            }
+        }
+        fclose(dfp);
+    }
+
+    // Reduced in image order, so the means do not depend on the number of threads
+    sum_num_superpixel = (double *)calloc(args.num_methods, sizeof(double));
+    sum_scores = (double (*)[MAX_METRICS])calloc(args.num_methods, sizeof(*sum_scores));
+    numImages = (long *)calloc(args.num_methods, sizeof(long));
+    for (int m = 0; m < args.num_methods; m++)
+    {
+        for (int i = 0; i < n; i++)
+        {
+            ImageResult *result = &results[(size_t)i * args.num_methods + m];
+
+            if (!result->done)
+                continue;
+            sum_num_superpixel[m] += result->numSuperpixels;
+            for (int k = 0; k < args.num_metrics; k++)
+                sum_scores[m][k] += result->scores[k];
+            numImages[m]++;
+        }
+    }
+
+    if (args.logFile != NULL)
+    {
+        FILE *fp;
+
+        snprintf(prefix, sizeof(prefix), "%s Images ", column);
+        fp = openPrefixedLog(args.logFile, args, prefix, false);
+        for (int m = 0; m < args.num_methods; m++)
+        {
+            if (numImages[m] == 0)
+                continue;
+            fprintf(fp, "%s %ld ", names[m], numImages[m]);
+            writeMeansRow(fp, args, sum_num_superpixel[m], sum_scores[m], numImages[m]);
+        }
+        fclose(fp);
+    }
+    if (args.curvePath != NULL)
+        writeSweepCurve(args, names, sum_num_superpixel, sum_scores, numImages);
+
+    for (int i = 0; i < n; i++)
+        free(namelist[i]);
+    free(namelist);
+    free(results);
+    free(sum_num_superpixel);
+    free(sum_scores);
+    free(numImages);
+}
+
+// runMethods of a --label list, named by the last component of their directories
+void runMethodList(Args args)
+{
+    char (*names)[255] = (char (*)[255])calloc(args.num_methods, sizeof(*names));
+
+    for (int m = 0; m < args.num_methods; m++)
+    {
+        getMethodName(args.methodPaths[m], names[m]);
+        for (int o = 0; o < m; o++)
+            if (strcmp(names[o], names[m]) == 0)
+                printError("runMethodList", "The directories of --label must have distinct names (%s)", names[m]);
+    }
+
+    runMethods(args, names, "Method");
+    free(names);
+}
+
+// K directories of a --sweep: the entries named by a positive integer
+int filterSweepDir(const struct dirent *entry)
+{
+    char *end;
+
+    return strtol(entry->d_name, &end, 10) > 0 && *end == '\0';
+}
+
+// K values in increasing order
+int compareSweepDirs(const struct dirent **a, const struct dirent **b)
+{
+    long x = atol((*a)->d_name), y = atol((*b)->d_name);
+
+    return (x > y) - (x < y);
+}
+
+// runMethods of the K directories of --sweep, in increasing order of K
+void runSweep(Args args)
+{
+    struct dirent **namelist;
+    char (*names)[255];
+    int n;
+
+    n = scandir(args.sweepPath, &namelist, &filterSweepDir, &compareSweepDirs);
+    if (n < 0)
+        printError("runSweep", "Could not list %s", args.sweepPath);
+
+    names = (char (*)[255])calloc(iftMax(n, 1), sizeof(*names));
+    args.methodPaths = (char **)calloc(iftMax(n, 1), sizeof(char *));
+    args.num_methods = 0;
+    for (int i = 0; i < n; i++)
+    {
+        char *path = iftCopyString("%s/%s", args.sweepPath, namelist[i]->d_name);
+
+        if (iftDirExists(path))
+        {
+            strcpy(names[args.num_methods], namelist[i]->d_name);
+            args.methodPaths[args.num_methods++] = path;
+        }
+        else
+            free(path);
+        free(namelist[i]);
+    }
+    free(namelist);
+
+    if (args.num_methods == 0)
+        printError("runSweep", "%s has no K directory (named by a number)", args.sweepPath);
+    printf("Sweep of %s: K = %s ... %s\n", args.sweepPath, names[0], names[args.num_methods - 1]);
+
+    args.label_path = args.methodPaths[0];
+    runMethods(args, names, "K");
+
+    for (int m = 0; m < args.num_methods; m++)
+        free(args.methodPaths[m]);
+    free(args.methodPaths);
+    free(names);
+}
+
+
+void runOvlayDir(char *orig_path, char *labels_path, char *gt_path, char *save_path)
+{
+    if (!iftDirExists(labels_path))
+        iftError("Labels directory not found", __func__);
+    if (!iftDirExists(gt_path))
+        iftError("Ground truth directory not found", __func__);
+    if (!iftDirExists(orig_path))
+        iftError("Images directory not found", __func__);
+    if (!iftDirExists(save_path))
+        iftMakeDir(save_path);
+
+    iftColor spxColor, gtColor, overlapColor;
+    // YCbCr = (210, 16, 146)
+    spxColor.val[0] = 210;
+    spxColor.val[1] = 16;
+    spxColor.val[2] = 146;
+
+    // (82, 90, 240);
+    gtColor.val[0] = 82;
+    gtColor.val[1] = 90;
+    gtColor.val[2] = 240;
+
+    // YCbCr =  (41, 240, 110);
+    overlapColor.val[0] = 41;
+    overlapColor.val[1] = 240;
     overlapColor.val[2] = 110;
 
     char ext_labels[10];
@@ -3449,6 +6097,530 @@ void runOvlayDir(char *orig_path, char *labels_path, char *gt_path, char *save_p
     iftDestroyFileSet(&orig_files);
 }
 
+// File added to the pack by runPack
+typedef struct PackJob
+{
+    char stem[256], path[1024];
+    int section; // argv index of its <section>=<dir>
+} PackJob;
+
+// Reverse alphabetical stems (the order of runDirectory), then sections in the command line order
+int comparePackJobs(const void *a, const void *b)
+{
+    const PackJob *x = (const PackJob *)a, *y = (const PackJob *)b;
+    int cmp = strcmp(y->stem, x->stem);
+
+    return (cmp != 0) ? cmp : x->section - y->section;
+}
+
+/*!
+ * \brief       Pack subcommand: adds the images of each <section>=<dir> to
+ *              the pack, decoded in parallel. The files of all the sections
+ *              are interleaved by stem, in the order of runDirectory, so an
+ *              evaluation reads the pack sequentially
+ */
+int runPack(int argc, char *argv[])
+{
+    PackFile *pack;
+    PackJob *jobs = NULL;
+    int num_jobs = 0;
+
+    if (argc < 2)
+        usage();
+
+    for (int s = 1; s < argc; s++)
+    {
+        struct dirent **namelist;
+        char *dir = strchr(argv[s], '=');
+        int n;
+
+        if (dir == NULL || dir == argv[s])
+            printError("runPack", "Expected <section>=<dir>, got %s", argv[s]);
+        n = scandir(dir + 1, &namelist, &filterDir, alphasort);
+        if (n == -1)
+            printError("runPack", "Could not list %s", dir + 1);
+
+        jobs = (PackJob *)realloc(jobs, (num_jobs + n) * sizeof(PackJob));
+        for (int i = 0; i < n; i++)
+        {
+            PackJob *job = &jobs[num_jobs++];
+
+            getImageName(namelist[i]->d_name, job->stem);
+            snprintf(job->path, sizeof(job->path), "%s/%s", dir + 1, namelist[i]->d_name);
+            job->section = s;
+            free(namelist[i]);
+        }
+        free(namelist);
+    }
+
+    qsort(jobs, num_jobs, sizeof(PackJob), comparePackJobs);
+
+    pack = appendPackFile(argv[0]);
+
+#pragma omp parallel for ordered schedule(dynamic)
+    for (int i = 0; i < num_jobs; i++)
+    {
+        iftImage *img = iftReadImageByExt(jobs[i].path);
+        char section[256];
+
+        sprintf(section, "%.*s", (int)(strchr(argv[jobs[i].section], '=') - argv[jobs[i].section]), argv[jobs[i].section]);
+#pragma omp ordered
+        addPackImage(pack, section, strrchr(jobs[i].path, '/') + 1, img);
+        iftDestroyImage(&img);
+    }
+
+    printf("%d images added to %s (%d entries).\n", num_jobs, argv[0], pack->num_entries);
+    closePackFile(&pack);
+    free(jobs);
+    return 0;
+}
+
+// Row of a --dlog file read by runMerge
+typedef struct DlogRow
+{
+    char name[255];
+    double values[MAX_METRICS + 1]; // The columns after the image name
+} DlogRow;
+
+// Reverse alphabetical, the order of runDirectory
+int compareDlogRows(const void *a, const void *b)
+{
+    return strcmp(((const DlogRow *)b)->name, ((const DlogRow *)a)->name);
+}
+
+// Arguments whose per-image log header (see writeLogHeader) is header. False if there are none
+bool getDlogArgs(char *header, Args *args)
+{
+    char *tmp, *tok;
+
+    memset(args, 0, sizeof(Args));
+    args->num_metrics = 1;
+    if (strcmp(header, "Image Superpixels Score") == 0)
+        args->metric = 1;
+    else if (strcmp(header, "Image Superpixels ConnectedSpx") == 0)
+        args->metric = 6;
+    else if (strcmp(header, "Image DesiredSpx Superpixels") == 0)
+        args->metric = 7;
+    else if (strncmp(header, "Image Superpixels ", 18) == 0)
+    {
+        args->num_metrics = 0;
+        tmp = iftCopyString("%s", header + 18);
+        for (tok = strtok(tmp, " "); tok != NULL && args->num_metrics < MAX_METRICS; tok = strtok(NULL, " "))
+        {
+            for (int m = 1; m <= 10; m++)
+                if (getMetricName(m) != NULL && strcmp(getMetricName(m), tok) == 0)
+                    args->metrics[args->num_metrics++] = m;
+        }
+        free(tmp);
+        if (args->num_metrics < 2)
+            return false;
+        args->metric = args->metrics[0];
+        return true;
+    }
+    else
+        return false;
+
+    args->metrics[0] = args->metric;
+    return true;
+}
+
+/*!
+ * \brief       Merge subcommand: appends to <log> the --log row of a run
+ *              over the images of the --dlog or --journal files (e.g. of
+ *              the --shard runs of a dataset). The means are computed from
+ *              the totals of the per-image rows, summed in the order of a
+ *              single run, so they do not depend on how the images were
+ *              sharded. An image listed twice is only counted once
+ */
+int runMerge(int argc, char *argv[])
+{
+    char header[1024] = "", line[4096];
+    double sum_num_superpixel = 0, sum_scores[MAX_METRICS] = {0};
+    DlogRow *rows = NULL;
+    int num_rows = 0, capacity = 0, numImages = 0, num_values;
+    Args args;
+
+    if (argc < 2)
+        usage();
+
+    for (int f = 1; f < argc; f++)
+    {
+        FILE *fp = fopen(argv[f], "r");
+
+        if (fp == NULL)
+            printError("runMerge", "Could not open %s", argv[f]);
+        if (fgets(line, sizeof(line), fp) == NULL)
+        {
+            fclose(fp);
+            continue;
+        }
+        line[strcspn(line, "\r\n")] = '\0';
+        if (header[0] == '\0')
+        {
+            if (!getDlogArgs(line, &args))
+                printError("runMerge", "%s is not a --dlog file", argv[f]);
+            strcpy(header, line);
+        }
+        else if (strcmp(line, header) != 0)
+            printError("runMerge", "%s has other columns than %s", argv[f], argv[1]);
+
+        num_values = (args.num_metrics > 1) ? args.num_metrics + 1 : 2;
+        while (fgets(line, sizeof(line), fp) != NULL)
+        {
+            char *tok = strtok(line, " \r\n");
+            DlogRow *row;
+            int v = 0;
+
+            if (tok == NULL)
+                continue;
+            if (num_rows == capacity)
+            {
+                capacity = iftMax(2 * capacity, 256);
+                rows = (DlogRow *)realloc(rows, capacity * sizeof(DlogRow));
+            }
+            row = &rows[num_rows];
+            snprintf(row->name, sizeof(row->name), "%s", tok);
+            for (tok = strtok(NULL, " \r\n"); tok != NULL && v < num_values; tok = strtok(NULL, " \r\n"))
+                row->values[v++] = atof(tok);
+            if (v != num_values)
+                printError("runMerge", "Invalid row of %s in %s", row->name, argv[f]);
+            // older builds also wrote this header for --eval 9 and 10, whose scores are not integers
+            if (args.metric == 7 && (row->values[0] != floor(row->values[0]) || row->values[1] != floor(row->values[1])))
+                printError("runMerge", "%s of %s has a score, not the numbers of superpixels of --eval 7", row->name,
+                           argv[f]);
+            num_rows++;
+        }
+        fclose(fp);
+    }
+
+    if (num_rows == 0)
+        printError("runMerge", "No images in the --dlog files");
+
+    qsort(rows, num_rows, sizeof(DlogRow), compareDlogRows);
+    for (int i = 0; i < num_rows; i++)
+    {
+        if (i > 0 && strcmp(rows[i].name, rows[i - 1].name) == 0)
+        {
+            printWarning("runMerge", "%s is listed more than once, only its first row is used", rows[i].name);
+            continue;
+        }
+
+        if (args.metric == 7)
+        {
+            args.k = (int)rows[i].values[0];
+            sum_num_superpixel += rows[i].values[1];
+        }
+        else
+        {
+            sum_num_superpixel += rows[i].values[0];
+            for (int m = 0; m < args.num_metrics; m++)
+                sum_scores[m] += rows[i].values[m + 1];
+        }
+        numImages++;
+    }
+
+    args.logFile = argv[0];
+    writeLogMeans(args, sum_num_superpixel, sum_scores, numImages);
+    printf("%d images of %d files merged into %s.\n", numImages, argc - 1, argv[0]);
+    free(rows);
+    return 0;
+}
+
+// Scores of a label map of runJob
+typedef struct JobResult
+{
+    int numSuperpixels;
+    double scores[MAX_METRICS];
+    bool planned; // The label map exists
+} JobResult;
+
+// Planned (and executed) work of runJob
+typedef struct JobCounts
+{
+    long images, gts, labels, evaluations;
+} JobCounts;
+
+// Label maps of a job dataset: one directory per method and K value
+typedef struct JobGroup
+{
+    JobMethod *method;
+    const char *k;
+    char dir[512];
+} JobGroup;
+
+// Appends the header of a job log (per label map or per group), unless the file already exists
+FILE *openJobLog(char *path, Args args, bool perImage)
+{
+    return openPrefixedLog(path, args, perImage ? "Dataset Method K " : "Dataset Method K Images ", perImage);
+}
+
+/*!
+ * \brief       Job subcommand: evaluates the campaign of a job spec (see
+ *              JobSpec.h). The plan has one task per image of each dataset,
+ *              which decodes the image and its ground-truth once and then
+ *              spawns one task per label map (method and K value) that
+ *              exists, all of them sharing the decoded inputs. The tasks
+ *              run on a pool of threads (OpenMP tasks), and the planned
+ *              and the executed work are reported at the end
+ */
+int runJob(int argc, char *argv[])
+{
+    JobSpec *spec;
+    JobGroup *groups; // num_groups per dataset
+    JobCounts planned = {0, 0, 0, 0}, executed = {0, 0, 0, 0};
+    long skipped = 0; // label maps of another size than their image
+    struct dirent ***namelists;
+    JobResult **results; // num_groups per image of each dataset
+    Args args, *dsArgs;
+    int *numImages, num_groups, missing = 0, totalImages = 0;
+    char **jobArgv, ext[] = "pgm";
+    int jobArgc = 9;
+    FILE *fp, *dfp;
+    double start;
+
+    if (argc != 1)
+        usage();
+    spec = readJobSpec(argv[0]);
+
+    // The [eval] keys are parsed (and validated) as command line options
+    jobArgv = (char **)calloc(spec->num_options + 11, sizeof(char *));
+    jobArgv[0] = (char *)"job";
+    jobArgv[1] = (char *)"--eval";
+    jobArgv[2] = spec->metrics;
+    jobArgv[3] = (char *)"--img";
+    jobArgv[4] = spec->datasets[0].img;
+    jobArgv[5] = (char *)"--label";
+    jobArgv[6] = spec->methods[0].labels;
+    jobArgv[7] = (char *)"--ext";
+    jobArgv[8] = ext;
+    if (spec->datasets[0].gt != NULL)
+    {
+        jobArgv[jobArgc++] = (char *)"--gt";
+        jobArgv[jobArgc++] = spec->datasets[0].gt;
+    }
+    for (int i = 0; i < spec->num_options; i++)
+        jobArgv[jobArgc++] = spec->options[i];
+    if (!initArgs(&args, jobArgc, jobArgv))
+        printError("runJob", "Invalid [eval] options in %s", argv[0]);
+    free(jobArgv);
+    for (int m = 0; m < args.num_metrics; m++)
+        if (getMetricName(args.metrics[m]) == NULL)
+            printError("runJob", "Jobs evaluate the metrics 1,2,3,4,5,9");
+    args.threads = (spec->threads <= 0) ? omp_get_max_threads() : spec->threads;
+
+    num_groups = spec->num_methods * iftMax(spec->num_ks, 1);
+    groups = (JobGroup *)calloc(spec->num_datasets * num_groups, sizeof(JobGroup));
+    dsArgs = (Args *)calloc(spec->num_datasets, sizeof(Args));
+    namelists = (struct dirent ***)calloc(spec->num_datasets, sizeof(struct dirent **));
+    numImages = (int *)calloc(spec->num_datasets, sizeof(int));
+    results = (JobResult **)calloc(spec->num_datasets, sizeof(JobResult *));
+
+    // Plan: the label maps of each image that exist, and the inputs they need
+    for (int d = 0; d < spec->num_datasets; d++)
+    {
+        JobDataset *dataset = &spec->datasets[d];
+
+        dsArgs[d] = args;
+        dsArgs[d].img_path = dataset->img;
+        dsArgs[d].gt_path = dataset->gt;
+        if ((hasMetric(args, 3) || hasMetric(args, 4) || args.removeColor != -1) && getGTDir(dsArgs[d]) == NULL)
+            printError("runJob", "Dataset %s needs a gt", dataset->name);
+
+        numImages[d] = scandir(dataset->img, &namelists[d], &filterDir, alphasort);
+        if (numImages[d] < 0)
+            printError("runJob", "Could not list %s", dataset->img);
+        results[d] = (JobResult *)calloc((size_t)iftMax(numImages[d], 1) * num_groups, sizeof(JobResult));
+        totalImages += numImages[d];
+
+        for (int g = 0; g < num_groups; g++)
+        {
+            JobGroup *group = &groups[d * num_groups + g];
+
+            group->method = &spec->methods[g / iftMax(spec->num_ks, 1)];
+            group->k = (spec->num_ks > 0) ? spec->ks[g % spec->num_ks] : NULL;
+            expandJobPath(group->method->labels, dataset->name, group->method->name, group->k, group->dir, sizeof(group->dir));
+        }
+
+        for (int i = 0; i < numImages[d]; i++)
+        {
+            char stem[255], path[1024];
+            int found = 0;
+
+            getImageName(namelists[d][numImages[d] - 1 - i]->d_name, stem);
+            for (int g = 0; g < num_groups; g++)
+            {
+                JobGroup *group = &groups[d * num_groups + g];
+
+                snprintf(path, sizeof(path), "%s/%s.%s", group->dir, stem, group->method->ext);
+                results[d][(size_t)i * num_groups + g].planned = file_exists(path);
+                if (file_exists(path))
+                    found++;
+                else
+                    missing++;
+            }
+
+            planned.labels += found;
+            if (found > 0 && (hasMetric(args, 1) || hasMetric(args, 2)))
+                planned.images++;
+            if (found > 0 && (hasMetric(args, 3) || hasMetric(args, 4) || args.removeColor != -1))
+                planned.gts++;
+        }
+    }
+    planned.evaluations = planned.labels;
+
+    printf("Plan: %d datasets, %d images, %d methods x %d K values = %d label maps per image\n",
+           spec->num_datasets, totalImages, spec->num_methods, iftMax(spec->num_ks, 1), num_groups);
+    printf("      decodes: %ld images, %ld ground-truths and %ld label maps (%d missing); %ld evaluations of %d metrics\n",
+           planned.images, planned.gts, planned.labels, missing, planned.evaluations, args.num_metrics);
+    printf("      one run per label map would decode %ld images and %ld ground-truths\n",
+           (planned.images > 0) ? planned.labels : 0, (planned.gts > 0) ? planned.labels : 0);
+    fflush(stdout);
+
+    start = omp_get_wtime();
+#pragma omp parallel num_threads(args.threads)
+#pragma omp single
+    for (int d = 0; d < spec->num_datasets; d++)
+    {
+        for (int i = 0; i < numImages[d]; i++)
+        {
+#pragma omp task firstprivate(d, i)
+            {
+                char *image_name = namelists[d][numImages[d] - 1 - i]->d_name, path[1024], stem[255];
+                JobResult *imageResults = &results[d][(size_t)i * num_groups];
+                iftImage *image = NULL, *gt = NULL;
+                int found = 0;
+
+                for (int g = 0; g < num_groups; g++)
+                    found += imageResults[g].planned;
+
+                // Shared by the tasks of its label maps
+                if (found > 0 && (hasMetric(args, 1) || hasMetric(args, 2)))
+                {
+                    getInputPath(dsArgs[d].img_path, image_name, path);
+                    image = convertToRGBImage(readInputImage(path));
+                    __atomic_add_fetch(&executed.images, 1, __ATOMIC_RELAXED);
+                }
+                if (found > 0 && (hasMetric(args, 3) || hasMetric(args, 4) || args.removeColor != -1))
+                {
+                    getInputPath(getGTDir(dsArgs[d]), image_name, path);
+                    gt = readInputImage(path);
+                    __atomic_add_fetch(&executed.gts, 1, __ATOMIC_RELAXED);
+                }
+                getImageName(image_name, stem);
+
+                for (int g = 0; g < num_groups; g++)
+                {
+                    if (!imageResults[g].planned)
+                        continue;
+#pragma omp task firstprivate(g) shared(image, gt, stem)
+                    {
+                        EvalData *data = (EvalData *)calloc(1, sizeof(EvalData));
+                        JobGroup *group = &groups[d * num_groups + g];
+                        JobResult *result = &imageResults[g];
+                        char labels_path[1024];
+
+                        snprintf(labels_path, sizeof(labels_path), "%s/%s.%s", group->dir, stem, group->method->ext);
+                        strcpy(data->name, stem);
+                        data->labels = compactLabelImage(readInputImage(labels_path), &data->origLabels, &data->numLabels);
+                        data->image = image;
+                        data->gt = gt;
+                        if ((image != NULL && (image->xsize != data->labels->xsize || image->ysize != data->labels->ysize ||
+                                               image->zsize != data->labels->zsize)) ||
+                            (gt != NULL && (gt->xsize != data->labels->xsize || gt->ysize != data->labels->ysize ||
+                                            gt->zsize != data->labels->zsize)))
+                        {
+                            // Like in runMethods, only this label map is skipped, not the campaign
+                            printWarning("runJob", "%s and its image must have the same size, skipped", labels_path);
+                            result->planned = false;
+                            __atomic_add_fetch(&skipped, 1, __ATOMIC_RELAXED);
+                        }
+                        __atomic_add_fetch(&executed.labels, 1, __ATOMIC_RELAXED);
+
+                        if (result->planned)
+                        {
+                            prepareEvalData(data, dsArgs[d]);
+                            evalMetrics(data, dsArgs[d], result->scores);
+                            result->numSuperpixels = data->numSuperpixels;
+                            __atomic_add_fetch(&executed.evaluations, 1, __ATOMIC_RELAXED);
+                        }
+
+                        data->image = data->gt = NULL; // Owned by the image task
+                        destroyEvalData(&data);
+                    }
+                }
+#pragma omp taskwait
+                iftDestroyImage(&image);
+                iftDestroyImage(&gt);
+            }
+        }
+    }
+
+    printf("Executed in %.2f s on %d threads: decoded %ld images, %ld ground-truths and %ld label maps; %ld evaluations",
+           omp_get_wtime() - start, args.threads, executed.images, executed.gts, executed.labels, executed.evaluations);
+    if (skipped > 0)
+        printf(" (%ld label maps skipped)", skipped);
+    printf("\n");
+
+    // Rows in the order of runDirectory, for each dataset, method and K value
+    fp = openJobLog(spec->log, args, false);
+    dfp = (spec->dlog != NULL) ? openJobLog(spec->dlog, args, true) : NULL;
+    for (int d = 0; d < spec->num_datasets; d++)
+    {
+        for (int g = 0; g < num_groups; g++)
+        {
+            JobGroup *group = &groups[d * num_groups + g];
+            double sum_num_superpixel = 0, sum_scores[MAX_METRICS] = {0};
+            const char *k = (group->k != NULL) ? group->k : "-";
+            long count = 0;
+
+            for (int i = 0; i < numImages[d]; i++)
+            {
+                JobResult *result = &results[d][(size_t)i * num_groups + g];
+                ImageResult row;
+
+                if (!result->planned)
+                    continue;
+                getImageName(namelists[d][numImages[d] - 1 - i]->d_name, row.name);
+                row.numSuperpixels = result->numSuperpixels;
+                memcpy(row.scores, result->scores, sizeof(row.scores));
+                if (dfp != NULL)
+                {
+                    fprintf(dfp, "%s %s %s ", spec->datasets[d].name, group->method->name, k);
+                    writeLogRow(dfp, args, &row);
+                }
+                sum_num_superpixel += result->numSuperpixels;
+                for (int m = 0; m < args.num_metrics; m++)
+                    sum_scores[m] += result->scores[m];
+                count++;
+            }
+
+            if (count > 0)
+            {
+                fprintf(fp, "%s %s %s %ld ", spec->datasets[d].name, group->method->name, k, count);
+                writeMeansRow(fp, args, sum_num_superpixel, sum_scores, count);
+            }
+        }
+    }
+    fclose(fp);
+    if (dfp != NULL)
+        fclose(dfp);
+
+    for (int d = 0; d < spec->num_datasets; d++)
+    {
+        for (int i = 0; i < numImages[d]; i++)
+            free(namelists[d][i]);
+        free(namelists[d]);
+        free(results[d]);
+    }
+    free(namelists);
+    free(results);
+    free(numImages);
+    free(dsArgs);
+    free(groups);
+    freeJobSpec(&spec);
+    return 0;
+}
+
 int main(int argc, char *argv[])
 {
 
@@ -3456,9 +6628,40 @@ int main(int argc, char *argv[])
     printf("DEGUB true\n");
 #endif
 
+    if (argc > 1 && strcmp(argv[1], "pack") == 0)
+        return runPack(argc - 2, &argv[2]);
+    if (argc > 1 && strcmp(argv[1], "merge") == 0)
+        return runMerge(argc - 2, &argv[2]);
+    if (argc > 1 && strcmp(argv[1], "job") == 0)
+        return runJob(argc - 2, &argv[2]);
+
     Args args;
     if (initArgs(&args, argc, argv))
-        runDirectory(args);
+    {
+        if (args.packPath != NULL)
+            inputPack = openPackFile(args.packPath);
+        if (args.writers > 0)
+            outputWriter = createImageWriter(args.writers, args.writeQueue, 0);
+        iftSetPNGCompression(args.pngLevel);
+        iftSetPGMAscii(args.pgmAscii);
+        outputPngLevel = args.pngLevel;
+        if (args.streamPath != NULL)
+            runStream(args);
+        else if (args.daemonPath != NULL)
+            runDaemon(args);
+        else if (args.watchSentinel != NULL)
+            runWatch(args);
+        else if (args.num_methods > 1)
+            runMethodList(args);
+        else if (args.sweepPath != NULL)
+            runSweep(args);
+        else if (args.manifestPath != NULL)
+            runManifest(args);
+        else
+            runDirectory(args);
+        freeImageWriter(&outputWriter); // Waits for the pending outputs
+        closePackFile(&inputPack);
+    }
     else
         usage();
 
@@ -1,4 +1,7 @@
+import io
 import os
+import socket
+import struct
 import subprocess
 
 class SuperpixelEvaluator:
@@ -36,3 +39,66 @@ class SuperpixelEvaluator:
         if result.stderr:
             print("Error:")
             print(result.stderr)
+
+
+def write_label_frame(stream, image_id, labels):
+    """Writes a label map (2D/3D integer numpy array) as a --stream frame."""
+    import numpy as np
+
+    labels = np.asarray(labels)
+    if labels.min() >= 0 and labels.max() < 256:
+        width, dtype = 1, "<u1"
+    elif labels.min() >= 0 and labels.max() < 65536:
+        width, dtype = 2, "<u2"
+    else:
+        width, dtype = 4, "<i4"
+    ysize, xsize = labels.shape[-2:]
+    zsize = labels.shape[0] if labels.ndim == 3 else 1
+    name = image_id.encode()
+
+    stream.write(struct.pack("<4sB3xIIII", b"LBLF", width, xsize, ysize, zsize, len(name)))
+    stream.write(name)
+    stream.write(labels.astype(dtype).tobytes())
+
+
+class EvaluationDaemonClient:
+    """Client of `bin/main --daemon <socket>`, which keeps the images decoded between requests.
+
+    Each evaluation returns (image name, [superpixels, score, ...]) with the
+    scores in the --eval order of the daemon.
+    """
+
+    def __init__(self, socket_path):
+        self.sock = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+        self.sock.connect(socket_path)
+        self.reader = self.sock.makefile("r")
+
+    def _request(self, line):
+        self.sock.sendall((line + "\n").encode())
+        reply = self.reader.readline().rstrip("\n")
+        if not reply.startswith("OK "):
+            raise RuntimeError(reply or "The daemon closed the connection")
+        fields = reply[3:].split()
+        return fields[0], [float(v) for v in fields[1:]]
+
+    def evaluate_file(self, label_path):
+        return self._request("FILE " + os.path.abspath(label_path))
+
+    def evaluate_labels(self, image_id, labels):
+        """Passes the label map through shared memory instead of a file."""
+        from multiprocessing import shared_memory
+
+        frame = io.BytesIO()
+        write_label_frame(frame, image_id, labels)
+        frame = frame.getvalue()
+        shm = shared_memory.SharedMemory(create=True, size=len(frame))
+        try:
+            shm.buf[:len(frame)] = frame
+            return self._request("SHM " + shm.name)
+        finally:
+            shm.close()
+            shm.unlink()
+
+    def close(self):
+        self.reader.close()
+        self.sock.close()
@@ -0,0 +1,432 @@
+#include "BatchLoader.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define BATCH_IO_URING 1
+#include <linux/io_uring.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+#endif
+
+#define BATCH_BUFFER_ALIGN 4096
+
+//=============================================================================
+// Private Structures
+//=============================================================================
+#ifdef BATCH_IO_URING
+typedef struct
+{
+    int fd;
+    unsigned entries;
+    unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    void *sq_ptr, *cq_ptr;
+    size_t sq_size, cq_size, sqes_size;
+} UringQueue;
+#endif
+
+//=============================================================================
+// Private Prototypes
+//=============================================================================
+void *getBatchBuffer(BatchLoader *loader, int i, size_t size);
+void readFileBlocking(int fd, LoadedFile *file, size_t done);
+#ifdef BATCH_IO_URING
+UringQueue *createUringQueue(unsigned entries);
+void freeUringQueue(UringQueue **ring);
+void prepareUringRead(UringQueue *ring, int fd, struct iovec *iov, uint64_t offset, int index);
+bool loadFilesUring(BatchLoader *loader, LoadedFile *files, int *fds, int n);
+#endif
+
+//=============================================================================
+// Constructors & Deconstructors
+//=============================================================================
+BatchLoader *createBatchLoader(int queue_depth)
+{
+    BatchLoader *loader;
+
+    if (queue_depth <= 0)
+        printError("createBatchLoader", "The queue depth must be positive");
+
+    loader = (BatchLoader *)calloc(1, sizeof(BatchLoader));
+    loader->queue_depth = queue_depth;
+#ifdef BATCH_IO_URING
+    loader->ring = createUringQueue(queue_depth);
+#endif
+
+    return loader;
+}
+
+void freeBatchLoader(BatchLoader **loader)
+{
+    if (*loader != NULL)
+    {
+        BatchLoader *tmp;
+
+        tmp = *loader;
+
+#ifdef BATCH_IO_URING
+        UringQueue *ring = (UringQueue *)tmp->ring;
+        freeUringQueue(&ring);
+#endif
+        for (int i = 0; i < tmp->num_buffers; i++)
+            free(tmp->buffers[i]);
+        free(tmp->buffers);
+        free(tmp->capacity);
+        free(tmp);
+
+        *loader = NULL;
+    }
+}
+
+//=============================================================================
+// Private Functions
+//=============================================================================
+// Buffer i of the pool, grown to size bytes if needed
+void *getBatchBuffer(BatchLoader *loader, int i, size_t size)
+{
+    if (i >= loader->num_buffers)
+    {
+        loader->buffers = (void **)realloc(loader->buffers, (i + 1) * sizeof(void *));
+        loader->capacity = (size_t *)realloc(loader->capacity, (i + 1) * sizeof(size_t));
+        for (int j = loader->num_buffers; j <= i; j++)
+        {
+            loader->buffers[j] = NULL;
+            loader->capacity[j] = 0;
+        }
+        loader->num_buffers = i + 1;
+    }
+
+    if (loader->capacity[i] < size || loader->buffers[i] == NULL)
+    {
+        size_t capacity = (size + BATCH_BUFFER_ALIGN) / BATCH_BUFFER_ALIGN * BATCH_BUFFER_ALIGN; // Never 0
+
+        free(loader->buffers[i]);
+        if (posix_memalign(&loader->buffers[i], BATCH_BUFFER_ALIGN, capacity) != 0)
+            printError("getBatchBuffer", "Could not allocate %zu bytes", capacity);
+        loader->capacity[i] = capacity;
+    }
+
+    return loader->buffers[i];
+}
+
+// Reads the rest of the file, from byte done
+void readFileBlocking(int fd, LoadedFile *file, size_t done)
+{
+    while (done < file->size)
+    {
+        ssize_t n = pread(fd, (char *)file->data + done, file->size - done, done);
+
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0)
+        {
+            file->error = errno;
+            return;
+        }
+        if (n == 0)
+            break; // Truncated since the fstat
+        done += n;
+    }
+    file->size = done;
+}
+
+#ifdef BATCH_IO_URING
+UringQueue *createUringQueue(unsigned entries)
+{
+    struct io_uring_params params;
+    UringQueue *ring;
+    int fd;
+
+    memset(&params, 0, sizeof(params));
+    fd = (int)syscall(__NR_io_uring_setup, entries, &params);
+    if (fd < 0)
+        return NULL; // ENOSYS, EPERM (seccomp), ...
+
+    ring = (UringQueue *)calloc(1, sizeof(UringQueue));
+    ring->fd = fd;
+    ring->entries = params.sq_entries;
+    ring->sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->cq_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+
+    // Since 5.4 both rings share a single mapping
+    if (params.features & IORING_FEAT_SINGLE_MMAP)
+        ring->sq_size = ring->cq_size = (ring->sq_size > ring->cq_size) ? ring->sq_size : ring->cq_size;
+
+    ring->sq_ptr = mmap(NULL, ring->sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    if (ring->sq_ptr == MAP_FAILED)
+    {
+        close(fd);
+        free(ring);
+        return NULL;
+    }
+    if (params.features & IORING_FEAT_SINGLE_MMAP)
+        ring->cq_ptr = ring->sq_ptr;
+    else
+        ring->cq_ptr = mmap(NULL, ring->cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+    ring->sqes = (struct io_uring_sqe *)mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    if (ring->cq_ptr == MAP_FAILED || ring->sqes == MAP_FAILED)
+    {
+        if (ring->cq_ptr == MAP_FAILED)
+            ring->cq_ptr = NULL;
+        if (ring->sqes == MAP_FAILED)
+            ring->sqes = NULL;
+        freeUringQueue(&ring);
+        return NULL;
+    }
+
+    ring->sq_head = (unsigned *)((char *)ring->sq_ptr + params.sq_off.head);
+    ring->sq_tail = (unsigned *)((char *)ring->sq_ptr + params.sq_off.tail);
+    ring->sq_mask = (unsigned *)((char *)ring->sq_ptr + params.sq_off.ring_mask);
+    ring->sq_array = (unsigned *)((char *)ring->sq_ptr + params.sq_off.array);
+    ring->cq_head = (unsigned *)((char *)ring->cq_ptr + params.cq_off.head);
+    ring->cq_tail = (unsigned *)((char *)ring->cq_ptr + params.cq_off.tail);
+    ring->cq_mask = (unsigned *)((char *)ring->cq_ptr + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *)((char *)ring->cq_ptr + params.cq_off.cqes);
+
+    return ring;
+}
+
+void freeUringQueue(UringQueue **ring)
+{
+    if (*ring != NULL)
+    {
+        UringQueue *tmp;
+
+        tmp = *ring;
+
+        if (tmp->sqes != NULL)
+            munmap(tmp->sqes, tmp->sqes_size);
+        if (tmp->cq_ptr != NULL && tmp->cq_ptr != tmp->sq_ptr)
+            munmap(tmp->cq_ptr, tmp->cq_size);
+        munmap(tmp->sq_ptr, tmp->sq_size);
+        close(tmp->fd);
+        free(tmp);
+
+        *ring = NULL;
+    }
+}
+
+// Queues the read of iov at offset; only this thread produces submissions
+void prepareUringRead(UringQueue *ring, int fd, struct iovec *iov, uint64_t offset, int index)
+{
+    unsigned tail = *ring->sq_tail, slot = tail & *ring->sq_mask;
+    struct io_uring_sqe *sqe = &ring->sqes[slot];
+
+    memset(sqe, 0, sizeof(struct io_uring_sqe));
+    sqe->opcode = IORING_OP_READV; // Available since 5.1, unlike IORING_OP_READ
+    sqe->fd = fd;
+    sqe->addr = (uint64_t)(uintptr_t)iov;
+    sqe->len = 1;
+    sqe->off = offset;
+    sqe->user_data = index;
+
+    ring->sq_array[slot] = slot;
+    __atomic_store_n(ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+}
+
+// One read per file in flight, at most ring->entries at once; short reads are resubmitted.
+// Returns false if the ring failed, leaving the unfinished files for the blocking path
+bool loadFilesUring(BatchLoader *loader, LoadedFile *files, int *fds, int n)
+{
+    UringQueue *ring = (UringQueue *)loader->ring;
+    struct iovec *iov = (struct iovec *)calloc(n, sizeof(struct iovec));
+    size_t *done = (size_t *)calloc(n, sizeof(size_t));
+    bool *queued = (bool *)calloc(n, sizeof(bool)); // read prepared and not completed yet
+    unsigned in_flight = 0, to_submit = 0;
+    bool ok = true;
+    int next = 0;
+
+    while (next < n || in_flight > 0)
+    {
+        unsigned head, tail;
+        int ret;
+
+        for (; next < n && in_flight < ring->entries; next++)
+        {
+            if (fds[next] == -1 || files[next].size == 0)
+                continue;
+            iov[next].iov_base = (void *)files[next].data;
+            iov[next].iov_len = files[next].size;
+            prepareUringRead(ring, fds[next], &iov[next], 0, next);
+            queued[next] = true;
+            in_flight++;
+            to_submit++;
+        }
+        if (in_flight == 0)
+            break;
+
+        ret = (int)syscall(__NR_io_uring_enter, ring->fd, to_submit, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+        if (ret < 0)
+        {
+            // EBUSY: the completions below must be reaped first. EAGAIN: short of kernel memory for now
+            if (errno == EAGAIN)
+                sched_yield();
+            else if (errno != EINTR && errno != EBUSY)
+            {
+                ok = false;
+                break;
+            }
+        }
+        if (ret > 0)
+            to_submit -= ((unsigned)ret < to_submit) ? (unsigned)ret : to_submit;
+
+        head = *ring->cq_head;
+        tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+        for (; head != tail; head++)
+        {
+            struct io_uring_cqe *cqe = &ring->cqes[head & *ring->cq_mask];
+            int i = (int)cqe->user_data, res = cqe->res;
+
+            in_flight--;
+            queued[i] = false;
+            if (res < 0 && res != -EINTR && res != -EAGAIN)
+            {
+                files[i].error = -res;
+                continue;
+            }
+            if (res == 0)
+            {
+                files[i].size = done[i]; // Truncated since the fstat
+                continue;
+            }
+
+            // Short or interrupted reads continue from done[i]
+            if (res > 0)
+                done[i] += res;
+            if (done[i] < files[i].size)
+            {
+                iov[i].iov_base = (char *)files[i].data + done[i];
+                iov[i].iov_len = files[i].size - done[i];
+                prepareUringRead(ring, fds[i], &iov[i], done[i], i);
+                queued[i] = true;
+                in_flight++;
+                to_submit++;
+            }
+        }
+        __atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+    }
+
+    if (!ok)
+    {
+        // The SQEs the kernel never received point at iov: drop them from the ring. Their files
+        // are finished by the blocking reads below
+        __atomic_store_n(ring->sq_tail, __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE), __ATOMIC_RELEASE);
+        in_flight -= to_submit;
+
+        // Requests still in the kernel may complete into the buffers: drain them first
+        while (in_flight > 0)
+        {
+            unsigned head, tail;
+
+            if (syscall(__NR_io_uring_enter, ring->fd, 0, in_flight, IORING_ENTER_GETEVENTS, NULL, 0) < 0 &&
+                errno != EINTR && errno != EAGAIN && errno != EBUSY)
+                break;
+            head = *ring->cq_head;
+            tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+
+            for (; head != tail; head++)
+            {
+                struct io_uring_cqe *cqe = &ring->cqes[head & *ring->cq_mask];
+                if (cqe->res > 0)
+                    done[cqe->user_data] += cqe->res;
+                queued[cqe->user_data] = false;
+                in_flight--;
+            }
+            __atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+        }
+
+        // The ring cannot be waited on: the kernel may still write into the buffers (and read iov) of
+        // the queued files, so they are abandoned to it and these files are read again into new buffers
+        if (in_flight > 0)
+        {
+            for (int i = 0; i < n; i++)
+                if (queued[i])
+                {
+                    loader->buffers[i] = NULL;
+                    files[i].data = getBatchBuffer(loader, i, files[i].size);
+                    done[i] = 0;
+                }
+            iov = NULL;
+        }
+
+        for (int i = 0; i < n; i++)
+            if (fds[i] != -1 && files[i].error == 0 && done[i] < files[i].size)
+                readFileBlocking(fds[i], &files[i], done[i]);
+    }
+
+    free(iov);
+    free(done);
+    free(queued);
+    return ok;
+}
+#endif
+
+//=============================================================================
+// Functions
+//=============================================================================
+bool usesIoUring(BatchLoader *loader)
+{
+    return loader->ring != NULL;
+}
+
+void loadFileBatch(BatchLoader *loader, LoadedFile *files, int n)
+{
+    int *fds = (int *)malloc((n > 0 ? n : 1) * sizeof(int));
+
+    for (int i = 0; i < n; i++)
+    {
+        struct stat st;
+
+        fds[i] = -1;
+        files[i].data = NULL;
+        files[i].size = 0;
+        files[i].error = 0;
+        if (files[i].path == NULL)
+            continue;
+
+        fds[i] = open(files[i].path, O_RDONLY | O_CLOEXEC);
+        if (fds[i] == -1 || fstat(fds[i], &st) == -1)
+        {
+            files[i].error = errno;
+            if (fds[i] != -1)
+                close(fds[i]);
+            fds[i] = -1;
+            continue;
+        }
+
+        files[i].size = st.st_size;
+        files[i].data = getBatchBuffer(loader, i, files[i].size);
+    }
+
+#ifdef BATCH_IO_URING
+    if (loader->ring != NULL && !loadFilesUring(loader, files, fds, n))
+    {
+        // The ring is unusable (e.g. the kernel rejects the operation): blocking reads from now on
+        UringQueue *ring = (UringQueue *)loader->ring;
+        freeUringQueue(&ring);
+        loader->ring = NULL;
+    }
+    else if (loader->ring == NULL)
+#endif
+    {
+        for (int i = 0; i < n; i++)
+            if (fds[i] != -1)
+                readFileBlocking(fds[i], &files[i], 0);
+    }
+
+    for (int i = 0; i < n; i++)
+        if (fds[i] != -1)
+            close(fds[i]);
+    free(fds);
+}
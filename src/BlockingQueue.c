@@ -0,0 +1,108 @@
+#include "BlockingQueue.h"
+
+//=============================================================================
+// Constructors & Deconstructors
+//=============================================================================
+BlockingQueue *createBlockingQueue(int capacity, size_t max_bytes)
+{
+    BlockingQueue *queue;
+
+    if (capacity <= 0)
+        printError("createBlockingQueue", "The capacity must be positive");
+
+    queue = (BlockingQueue *)calloc(1, sizeof(BlockingQueue));
+
+    queue->item = (void **)calloc(capacity, sizeof(void *));
+    queue->bytes = (size_t *)calloc(capacity, sizeof(size_t));
+    queue->capacity = capacity;
+    queue->max_bytes = max_bytes;
+
+    pthread_mutex_init(&queue->lock, NULL);
+    pthread_cond_init(&queue->not_empty, NULL);
+    pthread_cond_init(&queue->not_full, NULL);
+
+    return queue;
+}
+
+void freeBlockingQueue(BlockingQueue **queue)
+{
+    if (*queue != NULL)
+    {
+        BlockingQueue *tmp;
+
+        tmp = *queue;
+
+        pthread_mutex_destroy(&tmp->lock);
+        pthread_cond_destroy(&tmp->not_empty);
+        pthread_cond_destroy(&tmp->not_full);
+        free(tmp->item);
+        free(tmp->bytes);
+        free(tmp);
+
+        *queue = NULL;
+    }
+}
+
+//=============================================================================
+// Functions
+//=============================================================================
+bool pushBlockingQueue(BlockingQueue *queue, void *item, size_t bytes)
+{
+    int last;
+
+    pthread_mutex_lock(&queue->lock);
+    while (!queue->closed &&
+           (queue->count == queue->capacity ||
+            (queue->count > 0 && queue->max_bytes > 0 && queue->total_bytes + bytes > queue->max_bytes)))
+        pthread_cond_wait(&queue->not_full, &queue->lock);
+
+    if (queue->closed)
+    {
+        pthread_mutex_unlock(&queue->lock);
+        return false;
+    }
+
+    last = (queue->first + queue->count) % queue->capacity;
+    queue->item[last] = item;
+    queue->bytes[last] = bytes;
+    queue->count++;
+    queue->total_bytes += bytes;
+
+    pthread_cond_signal(&queue->not_empty);
+    pthread_mutex_unlock(&queue->lock);
+    return true;
+}
+
+void *popBlockingQueue(BlockingQueue *queue)
+{
+    void *item;
+
+    pthread_mutex_lock(&queue->lock);
+    while (!queue->closed && queue->count == 0)
+        pthread_cond_wait(&queue->not_empty, &queue->lock);
+
+    if (queue->count == 0)
+    {
+        pthread_mutex_unlock(&queue->lock);
+        return NULL;
+    }
+
+    item = queue->item[queue->first];
+    queue->total_bytes -= queue->bytes[queue->first];
+    queue->first = (queue->first + 1) % queue->capacity;
+    queue->count--;
+
+    // Several producers may fit in the freed bytes
+    pthread_cond_broadcast(&queue->not_full);
+    pthread_mutex_unlock(&queue->lock);
+    return item;
+}
+
+void closeBlockingQueue(BlockingQueue *queue)
+{
+    pthread_mutex_lock(&queue->lock);
+    queue->closed = true;
+    pthread_cond_broadcast(&queue->not_empty);
+    pthread_cond_broadcast(&queue->not_full);
+    pthread_mutex_unlock(&queue->lock);
+}
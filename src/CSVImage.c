@@ -0,0 +1,243 @@
+#include "CSVImage.h"
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <omp.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#define CSV_BLOCK_BYTES (1 << 18) // Approximate size of the blocks parsed in parallel
+
+// Mapped CSV file, unmapped by unmapCSVOnError if it cannot be parsed
+typedef struct
+{
+    void *map;
+    size_t size;
+} CSVMapping;
+
+//=============================================================================
+// Private Prototypes
+//=============================================================================
+size_t countCSVLineEnds(const char *s, const char *end);
+const char *findCSVLineEnd(const char *s, const char *end);
+int parseCSVLine(const char *s, const char *end, int *vals, int max_vals);
+void unmapCSVOnError(void *mapping);
+
+//=============================================================================
+// Private Functions
+//=============================================================================
+// ErrorCleanup of a CSVMapping (see pushErrorCleanup)
+void unmapCSVOnError(void *mapping)
+{
+    munmap(((CSVMapping *)mapping)->map, ((CSVMapping *)mapping)->size);
+}
+
+// Number of '\n' in [s, end)
+size_t countCSVLineEnds(const char *s, const char *end)
+{
+    size_t count = 0;
+
+#ifdef __SSE2__
+    const __m128i nl = _mm_set1_epi8('\n');
+
+    for (; end - s >= 16; s += 16)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i *)s);
+        count += __builtin_popcount(_mm_movemask_epi8(_mm_cmpeq_epi8(v, nl)));
+    }
+#endif
+    for (; s < end; s++)
+        count += (*s == '\n');
+
+    return count;
+}
+
+// First '\n' in [s, end), or end
+const char *findCSVLineEnd(const char *s, const char *end)
+{
+#ifdef __SSE2__
+    const __m128i nl = _mm_set1_epi8('\n');
+
+    for (; end - s >= 16; s += 16)
+    {
+        int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)s), nl));
+        if (mask != 0)
+            return s + __builtin_ctz(mask);
+    }
+#endif
+    for (; s < end; s++)
+        if (*s == '\n')
+            return s;
+
+    return end;
+}
+
+// Parses the line [s, end), storing up to max_vals values. Returns the number
+// of values in the line, or -1 if it is malformed
+int parseCSVLine(const char *s, const char *end, int *vals, int max_vals)
+{
+    int n = 0;
+
+    if (end > s && end[-1] == '\r')
+        end--;
+
+    while (true)
+    {
+        const char *digits;
+        bool neg = false;
+        long v = 0;
+
+        while (s < end && (*s == ' ' || *s == '\t'))
+            s++;
+        if (s < end && (*s == '-' || *s == '+'))
+            neg = (*s++ == '-');
+
+        digits = s;
+        while (s < end && (unsigned)(*s - '0') < 10 && v <= INT_MAX)
+            v = 10 * v + (*s++ - '0');
+        if (s == digits || v > INT_MAX)
+            return -1;
+
+        while (s < end && (*s == ' ' || *s == '\t'))
+            s++;
+
+        if (n < max_vals)
+            vals[n] = neg ? (int)-v : (int)v;
+        n++;
+
+        if (s == end)
+            return n;
+        if (*s++ != ',')
+            return -1;
+    }
+}
+
+//=============================================================================
+// Functions
+//=============================================================================
+iftImage *readCSVLabels(const char *path)
+{
+    iftImage *labels;
+    CSVMapping mapping;
+    struct stat st;
+    int fd;
+
+    fd = open(path, O_RDONLY);
+    if (fd == -1)
+        printError("readCSVLabels", "Could not open %s", path);
+    if (fstat(fd, &st) == -1 || st.st_size == 0)
+    {
+        close(fd);
+        printError("readCSVLabels", "Empty CSV file %s", path);
+    }
+
+    mapping.map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    mapping.size = st.st_size;
+    close(fd); // The mapping keeps the file
+    if (mapping.map == MAP_FAILED)
+        printError("readCSVLabels", "Could not map %s", path);
+
+    madvise(mapping.map, mapping.size, MADV_SEQUENTIAL);
+    pushErrorCleanup(unmapCSVOnError, &mapping);
+    labels = parseCSVLabels((const char *)mapping.map, mapping.size, path);
+    popErrorCleanup();
+    munmap(mapping.map, mapping.size);
+
+    return labels;
+}
+
+iftImage *parseCSVLabels(const char *buf, size_t size, const char *name)
+{
+    const char *end = buf + size, **start;
+    int xsize, ysize, num_blocks, bad_line = INT_MAX;
+    long *first_row, num_lines;
+    iftImage *labels;
+
+    // Trailing line ends (and blanks) do not make rows
+    while (end > buf && isspace((unsigned char)end[-1]))
+        end--;
+    if (end == buf)
+        printError("parseCSVLabels", "Empty CSV file %s", name);
+
+    xsize = parseCSVLine(buf, findCSVLineEnd(buf, end), NULL, 0);
+    if (xsize <= 0)
+        printError("parseCSVLabels", "Malformed line 1 in %s", name);
+
+    // Blocks of whole lines: block b starts after the first line end at or after byte b * CSV_BLOCK_BYTES - 1
+    num_blocks = (int)((end - buf + CSV_BLOCK_BYTES - 1) / CSV_BLOCK_BYTES);
+    start = (const char **)malloc((num_blocks + 1) * sizeof(const char *));
+    first_row = (long *)calloc(num_blocks + 1, sizeof(long));
+    start[0] = buf;
+    start[num_blocks] = end;
+
+#pragma omp parallel for
+    for (int b = 1; b < num_blocks; b++)
+    {
+        const char *nl = findCSVLineEnd(buf + (size_t)b * CSV_BLOCK_BYTES - 1, end);
+        start[b] = (nl < end) ? nl + 1 : end;
+    }
+
+    // Every line ends with '\n' except the last one (trimmed), so a block has one row per line end,
+    // plus the last row if it reaches the end
+#pragma omp parallel for schedule(dynamic, 1)
+    for (int b = 0; b < num_blocks; b++)
+        if (start[b] < start[b + 1])
+            first_row[b + 1] = countCSVLineEnds(start[b], start[b + 1]) + (start[b + 1] == end);
+
+    for (int b = 0; b < num_blocks; b++)
+        first_row[b + 1] += first_row[b];
+    num_lines = first_row[num_blocks];
+    if (num_lines * xsize > INT_MAX)
+    {
+        free(start);
+        free(first_row);
+        printError("parseCSVLabels", "CSV file %s is too large: %ld lines of %d values", name, num_lines, xsize);
+    }
+    ysize = (int)num_lines;
+
+    labels = iftCreateImage(xsize, ysize, 1);
+    labels->dz = 0.0;
+
+    // Each line is parsed straight into its row and must have xsize values
+#pragma omp parallel for schedule(dynamic, 1) reduction(min : bad_line)
+    for (int b = 0; b < num_blocks; b++)
+    {
+        const char *s = start[b];
+
+        for (long r = first_row[b]; r < first_row[b + 1]; r++)
+        {
+            const char *nl = findCSVLineEnd(s, start[b + 1]);
+
+            if (parseCSVLine(s, nl, &labels->val[r * xsize], xsize) != xsize)
+            {
+                if (r < bad_line)
+                    bad_line = (int)r;
+                break;
+            }
+            s = nl + 1;
+        }
+    }
+
+    if (bad_line != INT_MAX)
+    {
+        // Located again serially, only to report it
+        const char *s = buf, *nl;
+        int n;
+
+        for (int r = 0; r < bad_line; r++)
+            s = findCSVLineEnd(s, end) + 1;
+        nl = findCSVLineEnd(s, end);
+        n = parseCSVLine(s, nl, NULL, 0);
+
+        free(start);
+        free(first_row);
+        iftDestroyImage(&labels);
+        if (n < 0)
+            printError("parseCSVLabels", "Malformed line %d in %s", bad_line + 1, name);
+        printError("parseCSVLabels", "Line %d in %s has %d values, expected %d", bad_line + 1, name, n, xsize);
+    }
+
+    free(start);
+    free(first_row);
+    return labels;
+}
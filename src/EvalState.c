@@ -0,0 +1,460 @@
+#include "EvalState.h"
+
+//=============================================================================
+// Private Prototypes
+//=============================================================================
+void growEvalState(EvalState *state, int num_labels);
+double colorTermEvalState(EvalState *state, int label);
+double compactnessTermEvalState(EvalState *state, int label);
+int countBoundaryEvalState(EvalState *state, int pixel, int label);
+void markDirtyEvalState(EvalState *state, int label);
+void updateMaxIntersectionEvalState(EvalState *state);
+void addAreaEvalState(EvalState *state, int area);
+void removeAreaEvalState(EvalState *state, int area);
+int addIntersectionEvalState(LabelIntersection *intersection, int segment, int delta);
+
+//=============================================================================
+// Constructors & Deconstructors
+//=============================================================================
+EvalState *createEvalState(const iftImage *image, const iftImage *labels, const iftImage *gt)
+{
+    EvalState *state;
+    int max_label;
+
+    if (iftIsColorImage(labels))
+        printError(__func__, "The label image must be 1-channel grayscale");
+    if (image != NULL && (image->n != labels->n || !iftIsColorImage(image)))
+        printError(__func__, "The original image must be color and of the same size as the labels");
+    if (gt != NULL && gt->n != labels->n)
+        printError(__func__, "The ground-truth must be of the same size as the labels");
+
+    state = (EvalState *)calloc(1, sizeof(EvalState));
+
+    state->num_rows = labels->ysize;
+    state->num_cols = labels->xsize;
+    state->num_pixels = labels->n;
+    state->image = image;
+
+    state->labels = (int *)malloc(labels->n * sizeof(int));
+    memcpy(state->labels, labels->val, labels->n * sizeof(int));
+
+    max_label = -1;
+    for (int p = 0; p < state->num_pixels; p++)
+    {
+        if (state->labels[p] < -1)
+            state->labels[p] = -1;
+        if (state->labels[p] > max_label)
+            max_label = state->labels[p];
+        if (state->labels[p] >= 0)
+            state->num_valid_pixels++;
+    }
+
+    if (gt != NULL)
+    {
+        // Dense segment ids, as computeIntersectionMatrix indexes by value
+        int max_gt = 0, *segment_id;
+
+        for (int p = 0; p < gt->n; p++)
+            if (gt->val[p] > max_gt)
+                max_gt = gt->val[p];
+
+        segment_id = (int *)malloc((max_gt + 1) * sizeof(int));
+        for (int i = 0; i <= max_gt; i++)
+            segment_id[i] = -1;
+
+        state->gt = (int *)malloc(gt->n * sizeof(int));
+        for (int p = 0; p < gt->n; p++)
+        {
+            int value = iftMax(gt->val[p], 0);
+            if (segment_id[value] < 0)
+                segment_id[value] = state->num_gt_segments++;
+            state->gt[p] = segment_id[value];
+        }
+        free(segment_id);
+    }
+
+    growEvalState(state, max_label + 1);
+
+    for (int p = 0; p < state->num_pixels; p++)
+    {
+        int label = state->labels[p];
+
+        if (label < 0)
+            continue;
+
+        state->area[label]++;
+        state->perimeter[label] += countBoundaryEvalState(state, p, label);
+
+        if (state->gt != NULL)
+            addIntersectionEvalState(&state->intersections[label], state->gt[p], 1);
+    }
+
+    if (image != NULL && state->num_valid_pixels > 0)
+    {
+        double sum[3] = {0, 0, 0};
+
+        for (int p = 0; p < state->num_pixels; p++)
+        {
+            if (state->labels[p] < 0)
+                continue;
+            sum[0] += image->val[p];
+            sum[1] += image->Cb[p];
+            sum[2] += image->Cr[p];
+        }
+        for (int c = 0; c < 3; c++)
+            state->overall_mean[c] = sum[c] / state->num_valid_pixels;
+
+        // The color sums are centered on the overall mean, so the terms of EV do not come from the
+        // difference of large sums. The labeled pixel set never changes, so the bottom sum is constant
+        for (int p = 0; p < state->num_pixels; p++)
+        {
+            int label = state->labels[p];
+            double diff[3];
+
+            if (label < 0)
+                continue;
+            diff[0] = image->val[p] - state->overall_mean[0];
+            diff[1] = image->Cb[p] - state->overall_mean[1];
+            diff[2] = image->Cr[p] - state->overall_mean[2];
+            for (int c = 0; c < 3; c++)
+            {
+                state->sum_color[label * 3 + c] += diff[c];
+                state->sum_bottom += diff[c] * diff[c];
+            }
+        }
+    }
+
+    for (int label = 0; label < state->num_labels; label++)
+    {
+        if (state->area[label] == 0)
+            continue;
+
+        addAreaEvalState(state, state->area[label]);
+        state->sum_compactness += compactnessTermEvalState(state, label);
+        if (image != NULL)
+            state->sum_top += colorTermEvalState(state, label);
+        if (state->gt != NULL)
+            markDirtyEvalState(state, label);
+    }
+    updateMaxIntersectionEvalState(state);
+
+    return state;
+}
+
+void freeEvalState(EvalState **state)
+{
+    if (*state != NULL)
+    {
+        EvalState *tmp;
+
+        tmp = *state;
+
+        free(tmp->labels);
+        free(tmp->area);
+        free(tmp->sum_color);
+        free(tmp->perimeter);
+        free(tmp->gt);
+        if (tmp->intersections != NULL)
+        {
+            for (int label = 0; label < tmp->capacity; label++)
+            {
+                free(tmp->intersections[label].segments);
+                free(tmp->intersections[label].counts);
+            }
+            free(tmp->intersections);
+        }
+        free(tmp->dirty);
+        free(tmp->dirty_list);
+        free(tmp);
+
+        *state = NULL;
+    }
+}
+
+//=============================================================================
+// Private Functions
+//=============================================================================
+void growEvalState(EvalState *state, int num_labels)
+{
+    int old_capacity;
+
+    if (num_labels > state->capacity)
+    {
+        old_capacity = state->capacity;
+        state->capacity = iftMax(num_labels, 2 * old_capacity);
+
+        state->area = (int *)realloc(state->area, state->capacity * sizeof(int));
+        state->perimeter = (int *)realloc(state->perimeter, state->capacity * sizeof(int));
+        state->sum_color = (double *)realloc(state->sum_color, 3 * state->capacity * sizeof(double));
+        memset(state->area + old_capacity, 0, (state->capacity - old_capacity) * sizeof(int));
+        memset(state->perimeter + old_capacity, 0, (state->capacity - old_capacity) * sizeof(int));
+        memset(state->sum_color + 3 * old_capacity, 0, 3 * (state->capacity - old_capacity) * sizeof(double));
+
+        if (state->gt != NULL)
+        {
+            state->intersections = (LabelIntersection *)realloc(state->intersections, state->capacity * sizeof(LabelIntersection));
+            state->dirty = (bool *)realloc(state->dirty, state->capacity * sizeof(bool));
+            state->dirty_list = (int *)realloc(state->dirty_list, state->capacity * sizeof(int));
+            memset(state->intersections + old_capacity, 0, (state->capacity - old_capacity) * sizeof(LabelIntersection));
+            memset(state->dirty + old_capacity, 0, (state->capacity - old_capacity) * sizeof(bool));
+        }
+    }
+    state->num_labels = iftMax(state->num_labels, num_labels);
+}
+
+// Sum over the channels of n_s * (mean_s - overall_mean)^2, i.e. (centered sum)^2 / n_s
+double colorTermEvalState(EvalState *state, int label)
+{
+    double term = 0;
+    int area = state->area[label];
+
+    if (area == 0)
+        return 0;
+
+    for (int c = 0; c < 3; c++)
+        term += state->sum_color[label * 3 + c] * state->sum_color[label * 3 + c];
+    return term / area;
+}
+
+double compactnessTermEvalState(EvalState *state, int label)
+{
+    double area = state->area[label], perimeter = state->perimeter[label];
+
+    if (area > 0 && perimeter > 0)
+        return area * (4 * IFT_PI * area) / (perimeter * perimeter);
+    return 0;
+}
+
+// Number of 4-neighbors of pixel (or image borders) not labeled as label
+int countBoundaryEvalState(EvalState *state, int pixel, int label)
+{
+    int count = 0, row = pixel / state->num_cols, col = pixel % state->num_cols;
+
+    count += (row == 0 || state->labels[pixel - state->num_cols] != label);
+    count += (row == state->num_rows - 1 || state->labels[pixel + state->num_cols] != label);
+    count += (col == 0 || state->labels[pixel - 1] != label);
+    count += (col == state->num_cols - 1 || state->labels[pixel + 1] != label);
+
+    return count;
+}
+
+void markDirtyEvalState(EvalState *state, int label)
+{
+    if (!state->dirty[label])
+    {
+        state->dirty[label] = true;
+        state->dirty_list[state->num_dirty++] = label;
+    }
+}
+
+void updateMaxIntersectionEvalState(EvalState *state)
+{
+    for (int i = 0; i < state->num_dirty; i++)
+    {
+        int label = state->dirty_list[i], max = 0;
+        LabelIntersection *intersection = &state->intersections[label];
+
+        for (int s = 0; s < intersection->num_segments; s++)
+            if (intersection->counts[s] > max)
+                max = intersection->counts[s];
+
+        state->sum_max_intersection += max - intersection->max_count;
+        intersection->max_count = max;
+        state->dirty[label] = false;
+    }
+    state->num_dirty = 0;
+}
+
+// Welford's update of the mean and squared deviations with a new nonempty area
+void addAreaEvalState(EvalState *state, int area)
+{
+    double delta = area - state->mean_area;
+
+    state->num_nonempty++;
+    state->mean_area += delta / state->num_nonempty;
+    state->sq_dev_area += delta * (area - state->mean_area);
+}
+
+// Inverse of addAreaEvalState
+void removeAreaEvalState(EvalState *state, int area)
+{
+    double delta = area - state->mean_area;
+
+    if (--state->num_nonempty == 0)
+    {
+        state->mean_area = state->sq_dev_area = 0;
+        return;
+    }
+    state->mean_area -= delta / state->num_nonempty;
+    state->sq_dev_area = iftMax(state->sq_dev_area - delta * (area - state->mean_area), 0);
+}
+
+// Adds delta to the pixels of a superpixel in a ground-truth segment and returns their new number.
+// Segments left without pixels are removed
+int addIntersectionEvalState(LabelIntersection *intersection, int segment, int delta)
+{
+    int s = 0, count;
+
+    while (s < intersection->num_segments && intersection->segments[s] != segment)
+        s++;
+    if (s == intersection->num_segments)
+    {
+        if (intersection->num_segments == intersection->capacity)
+        {
+            intersection->capacity = iftMax(4, 2 * intersection->capacity);
+            intersection->segments = (int *)realloc(intersection->segments, intersection->capacity * sizeof(int));
+            intersection->counts = (int *)realloc(intersection->counts, intersection->capacity * sizeof(int));
+        }
+        intersection->segments[s] = segment;
+        intersection->counts[s] = 0;
+        intersection->num_segments++;
+    }
+
+    count = (intersection->counts[s] += delta);
+    if (count == 0)
+    {
+        intersection->num_segments--;
+        intersection->segments[s] = intersection->segments[intersection->num_segments];
+        intersection->counts[s] = intersection->counts[intersection->num_segments];
+    }
+    return count;
+}
+
+//=============================================================================
+// Functions
+//=============================================================================
+int applyEvalStateMoves(EvalState *state, const PixelMove *moves, int num_moves)
+{
+    int num_applied = 0;
+
+    for (int m = 0; m < num_moves; m++)
+    {
+        int p = moves[m].pixel, old_label = moves[m].old_label, new_label = moves[m].new_label;
+        int row, col, num_touched, touched[6], neighbors[4], num_neighbors;
+
+        if (p < 0 || p >= state->num_pixels || old_label < 0 || new_label < 0 ||
+            state->labels[p] != old_label || old_label == new_label)
+            continue;
+
+        growEvalState(state, new_label + 1);
+
+        row = p / state->num_cols;
+        col = p % state->num_cols;
+        num_neighbors = 0;
+        if (row > 0) neighbors[num_neighbors++] = p - state->num_cols;
+        if (row < state->num_rows - 1) neighbors[num_neighbors++] = p + state->num_cols;
+        if (col > 0) neighbors[num_neighbors++] = p - 1;
+        if (col < state->num_cols - 1) neighbors[num_neighbors++] = p + 1;
+
+        // Superpixels whose area or perimeter may change
+        num_touched = 0;
+        touched[num_touched++] = old_label;
+        touched[num_touched++] = new_label;
+        for (int i = 0; i < num_neighbors; i++)
+        {
+            int label = state->labels[neighbors[i]];
+            bool seen = (label < 0);
+
+            for (int j = 0; j < num_touched && !seen; j++)
+                seen = (touched[j] == label);
+            if (!seen)
+                touched[num_touched++] = label;
+        }
+
+        for (int i = 0; i < num_touched; i++)
+        {
+            int label = touched[i];
+
+            state->sum_compactness -= compactnessTermEvalState(state, label);
+            if (state->area[label] > 0)
+                removeAreaEvalState(state, state->area[label]);
+        }
+        if (state->image != NULL)
+            state->sum_top -= colorTermEvalState(state, old_label) + colorTermEvalState(state, new_label);
+
+        // Perimeter: the pixel itself and each neighbor's boundary count
+        state->perimeter[old_label] -= countBoundaryEvalState(state, p, old_label);
+        state->perimeter[new_label] += countBoundaryEvalState(state, p, new_label);
+        for (int i = 0; i < num_neighbors; i++)
+        {
+            int label = state->labels[neighbors[i]];
+
+            if (label >= 0)
+                state->perimeter[label] += (label != new_label) - (label != old_label);
+        }
+
+        state->labels[p] = new_label;
+        state->area[old_label]--;
+        state->area[new_label]++;
+
+        if (state->image != NULL)
+        {
+            double diff[3] = {state->image->val[p] - state->overall_mean[0], state->image->Cb[p] - state->overall_mean[1],
+                              state->image->Cr[p] - state->overall_mean[2]};
+
+            for (int c = 0; c < 3; c++)
+            {
+                state->sum_color[old_label * 3 + c] -= diff[c];
+                state->sum_color[new_label * 3 + c] += diff[c];
+            }
+            state->sum_top += colorTermEvalState(state, old_label) + colorTermEvalState(state, new_label);
+        }
+
+        for (int i = 0; i < num_touched; i++)
+        {
+            int label = touched[i];
+
+            state->sum_compactness += compactnessTermEvalState(state, label);
+            if (state->area[label] > 0)
+                addAreaEvalState(state, state->area[label]);
+        }
+
+        if (state->gt != NULL)
+        {
+            LabelIntersection *old_intersection = &state->intersections[old_label];
+            LabelIntersection *new_intersection = &state->intersections[new_label];
+            int new_count;
+
+            // The maximum of the new label can only grow by one; the old
+            // label's maximum is recomputed lazily if it may have dropped
+            if (addIntersectionEvalState(old_intersection, state->gt[p], -1) + 1 == old_intersection->max_count)
+                markDirtyEvalState(state, old_label);
+            new_count = addIntersectionEvalState(new_intersection, state->gt[p], 1);
+            if (new_count > new_intersection->max_count)
+            {
+                state->sum_max_intersection += new_count - new_intersection->max_count;
+                new_intersection->max_count = new_count;
+            }
+        }
+
+        num_applied++;
+    }
+
+    return num_applied;
+}
+
+EvalScores getEvalStateScores(EvalState *state)
+{
+    EvalScores scores;
+
+    scores.num_superpixels = state->num_nonempty;
+    scores.ev = scores.ue = -1;
+    scores.co = scores.regularity = 0;
+
+    if (state->num_valid_pixels == 0)
+        return scores;
+
+    scores.co = state->sum_compactness / state->num_valid_pixels;
+    scores.regularity = sqrt(state->sq_dev_area / state->num_nonempty);
+
+    if (state->image != NULL)
+        scores.ev = state->sum_top / state->sum_bottom;
+
+    if (state->gt != NULL)
+    {
+        updateMaxIntersectionEvalState(state);
+        scores.ue = (state->num_valid_pixels - state->sum_max_intersection) / state->num_valid_pixels;
+    }
+
+    return scores;
+}
@@ -0,0 +1,103 @@
+#include "ImageCache.h"
+
+//=============================================================================
+// Private Prototypes
+//=============================================================================
+size_t getCachedImageBytes(iftImage *img);
+
+//=============================================================================
+// Private Functions
+//=============================================================================
+size_t getCachedImageBytes(iftImage *img)
+{
+    return (size_t)img->n * sizeof(int) * (img->Cb != NULL ? 3 : 1);
+}
+
+//=============================================================================
+// Constructors & Deconstructors
+//=============================================================================
+ImageCache *createImageCache(size_t max_bytes)
+{
+    ImageCache *cache;
+
+    cache = (ImageCache *)calloc(1, sizeof(ImageCache));
+    cache->capacity = 16;
+    cache->entries = (CachedImage *)calloc(cache->capacity, sizeof(CachedImage));
+    cache->max_bytes = max_bytes;
+
+    return cache;
+}
+
+void freeImageCache(ImageCache **cache)
+{
+    if (*cache != NULL)
+    {
+        ImageCache *tmp;
+
+        tmp = *cache;
+
+        for (int i = 0; i < tmp->num_entries; i++)
+        {
+            free(tmp->entries[i].key);
+            iftDestroyImage(&tmp->entries[i].img);
+        }
+        free(tmp->entries);
+        free(tmp);
+
+        *cache = NULL;
+    }
+}
+
+//=============================================================================
+// Functions
+//=============================================================================
+iftImage *getCachedImage(ImageCache *cache, const char *key)
+{
+    for (int i = 0; i < cache->num_entries; i++)
+    {
+        if (strcmp(cache->entries[i].key, key) == 0)
+        {
+            cache->entries[i].last_use = ++cache->clock;
+            cache->hits++;
+            return cache->entries[i].img;
+        }
+    }
+
+    cache->misses++;
+    return NULL;
+}
+
+void putCachedImage(ImageCache *cache, const char *key, iftImage *img)
+{
+    CachedImage *entry;
+
+    if (cache->num_entries == cache->capacity)
+    {
+        cache->capacity *= 2;
+        cache->entries = (CachedImage *)realloc(cache->entries, cache->capacity * sizeof(CachedImage));
+    }
+
+    entry = &cache->entries[cache->num_entries++];
+    entry->key = iftCopyString("%s", key);
+    entry->img = img;
+    entry->bytes = getCachedImageBytes(img);
+    entry->last_use = ++cache->clock;
+    cache->bytes += entry->bytes;
+}
+
+void trimImageCache(ImageCache *cache)
+{
+    while (cache->max_bytes > 0 && cache->bytes > cache->max_bytes && cache->num_entries > 0)
+    {
+        int lru = 0;
+
+        for (int i = 1; i < cache->num_entries; i++)
+            if (cache->entries[i].last_use < cache->entries[lru].last_use)
+                lru = i;
+
+        cache->bytes -= cache->entries[lru].bytes;
+        free(cache->entries[lru].key);
+        iftDestroyImage(&cache->entries[lru].img);
+        cache->entries[lru] = cache->entries[--cache->num_entries];
+    }
+}
@@ -0,0 +1,147 @@
+#include "ImageWriter.h"
+#include <fcntl.h>
+
+//=============================================================================
+// Private Structures
+//=============================================================================
+typedef struct
+{
+    void *data;
+    WriteFunction write;
+    char *path;
+} WriteJob;
+
+//=============================================================================
+// Private Prototypes
+//=============================================================================
+void *runImageWriter(void *arg);
+void writeIftImage(void *data, const char *path);
+void syncFile(const char *path);
+
+//=============================================================================
+// Constructors & Deconstructors
+//=============================================================================
+ImageWriter *createImageWriter(int num_threads, int capacity, size_t max_bytes)
+{
+    ImageWriter *writer;
+
+    if (num_threads <= 0)
+        printError("createImageWriter", "The number of threads must be positive");
+
+    writer = (ImageWriter *)calloc(1, sizeof(ImageWriter));
+
+    writer->queue = createBlockingQueue(capacity, max_bytes);
+    writer->num_threads = num_threads;
+    writer->threads = (pthread_t *)calloc(num_threads, sizeof(pthread_t));
+    pthread_mutex_init(&writer->lock, NULL);
+
+    for (int t = 0; t < num_threads; t++)
+        if (pthread_create(&writer->threads[t], NULL, runImageWriter, writer) != 0)
+            printError("createImageWriter", "Could not create the writer threads");
+
+    return writer;
+}
+
+void freeImageWriter(ImageWriter **writer)
+{
+    if (*writer != NULL)
+    {
+        ImageWriter *tmp;
+
+        tmp = *writer;
+
+        // The threads drain the queue before leaving
+        closeBlockingQueue(tmp->queue);
+        for (int t = 0; t < tmp->num_threads; t++)
+            pthread_join(tmp->threads[t], NULL);
+
+        for (int i = 0; i < tmp->num_written; i++)
+        {
+            syncFile(tmp->written[i]);
+            free(tmp->written[i]);
+        }
+
+        pthread_mutex_destroy(&tmp->lock);
+        freeBlockingQueue(&tmp->queue);
+        free(tmp->written);
+        free(tmp->threads);
+        free(tmp);
+
+        *writer = NULL;
+    }
+}
+
+//=============================================================================
+// Private Functions
+//=============================================================================
+void *runImageWriter(void *arg)
+{
+    ImageWriter *writer = (ImageWriter *)arg;
+    WriteJob *job;
+
+    while ((job = (WriteJob *)popBlockingQueue(writer->queue)) != NULL)
+    {
+        job->write(job->data, job->path);
+
+        pthread_mutex_lock(&writer->lock);
+        if (writer->num_written == writer->max_written)
+        {
+            writer->max_written = iftMax(2 * writer->max_written, 64);
+            writer->written = (char **)realloc(writer->written, writer->max_written * sizeof(char *));
+        }
+        writer->written[writer->num_written++] = job->path;
+        pthread_mutex_unlock(&writer->lock);
+
+        free(job);
+    }
+    return NULL;
+}
+
+void writeIftImage(void *data, const char *path)
+{
+    iftImage *img = (iftImage *)data;
+
+    iftWriteImageByExt(img, "%s", path);
+    iftDestroyImage(&img);
+}
+
+void syncFile(const char *path)
+{
+    int fd = open(path, O_RDONLY);
+
+    if (fd == -1 || fsync(fd) == -1)
+        printWarning("syncFile", "Could not sync %s", path);
+    if (fd != -1)
+        close(fd);
+}
+
+//=============================================================================
+// Functions
+//=============================================================================
+void submitWriteJob(ImageWriter *writer, void *data, WriteFunction write, const char *path, size_t bytes)
+{
+    WriteJob *job;
+
+    if (writer == NULL)
+    {
+        write(data, path);
+        return;
+    }
+
+    job = (WriteJob *)malloc(sizeof(WriteJob));
+    job->data = data;
+    job->write = write;
+    job->path = iftCopyString("%s", path);
+
+    if (!pushBlockingQueue(writer->queue, job, bytes))
+        printError("submitWriteJob", "The writer is closed");
+}
+
+void writeImageAsync(ImageWriter *writer, iftImage **img, const char *path)
+{
+    iftImage *tmp = *img;
+
+    *img = NULL;
+    submitWriteJob(writer, tmp, writeIftImage, path,
+                   (size_t)tmp->n * sizeof(int) * (tmp->Cb != NULL ? 3 : 1));
+}
@@ -0,0 +1,263 @@
+#include "JobSpec.h"
+#include <ctype.h>
+
+//=============================================================================
+// Private Prototypes
+//=============================================================================
+char *trimJobString(char *s);
+void stripJobComment(char *s);
+char *copyJobString(const char *s);
+void appendJobString(char ***list, int *n, const char *s);
+void setJobKey(JobSpec *spec, int section, const char *key, const char *value, const char *path, int line);
+
+#define JOB_NO_SECTION 0
+#define JOB_EVAL 1
+#define JOB_DATASET 2
+#define JOB_METHOD 3
+
+//=============================================================================
+// Private Functions
+//=============================================================================
+// Removes the leading and trailing blanks in place
+char *trimJobString(char *s)
+{
+    char *end;
+
+    while (isspace((unsigned char)*s))
+        s++;
+    end = s + strlen(s);
+    while (end > s && isspace((unsigned char)end[-1]))
+        end--;
+    *end = '\0';
+    return s;
+}
+
+// Cuts s at a ; or # that starts the line or follows a blank, so paths may contain both characters
+void stripJobComment(char *s)
+{
+    for (char *c = s; *c != '\0'; c++)
+    {
+        if ((*c == ';' || *c == '#') && (c == s || isspace((unsigned char)c[-1])))
+        {
+            *c = '\0';
+            return;
+        }
+    }
+}
+
+char *copyJobString(const char *s)
+{
+    char *copy = (char *)malloc(strlen(s) + 1);
+
+    strcpy(copy, s);
+    return copy;
+}
+
+void appendJobString(char ***list, int *n, const char *s)
+{
+    *list = (char **)realloc(*list, (*n + 1) * sizeof(char *));
+    (*list)[(*n)++] = copyJobString(s);
+}
+
+void setJobKey(JobSpec *spec, int section, const char *key, const char *value, const char *path, int line)
+{
+    if (section == JOB_EVAL)
+    {
+        if (strcmp(key, "metrics") == 0)
+            spec->metrics = copyJobString(value);
+        else if (strcmp(key, "log") == 0)
+            spec->log = copyJobString(value);
+        else if (strcmp(key, "dlog") == 0)
+            spec->dlog = copyJobString(value);
+        else if (strcmp(key, "threads") == 0)
+            spec->threads = atoi(value);
+        else if (strcmp(key, "k") == 0)
+        {
+            char *tmp = copyJobString(value), *tok;
+
+            for (tok = strtok(tmp, ","); tok != NULL; tok = strtok(NULL, ","))
+                if (*trimJobString(tok) != '\0')
+                    appendJobString(&spec->ks, &spec->num_ks, trimJobString(tok));
+            free(tmp);
+        }
+        else
+        {
+            char option[256];
+
+            snprintf(option, sizeof(option), "--%s", key);
+            appendJobString(&spec->options, &spec->num_options, option);
+            appendJobString(&spec->options, &spec->num_options, value);
+        }
+    }
+    else if (section == JOB_DATASET)
+    {
+        JobDataset *dataset = &spec->datasets[spec->num_datasets - 1];
+
+        if (strcmp(key, "img") == 0)
+            dataset->img = copyJobString(value);
+        else if (strcmp(key, "gt") == 0)
+            dataset->gt = copyJobString(value);
+        else
+            printError("readJobSpec", "%s:%d: unknown dataset key %s", path, line, key);
+    }
+    else if (section == JOB_METHOD)
+    {
+        JobMethod *method = &spec->methods[spec->num_methods - 1];
+
+        if (strcmp(key, "labels") == 0)
+            method->labels = copyJobString(value);
+        else if (strcmp(key, "ext") == 0)
+            method->ext = copyJobString(value);
+        else
+            printError("readJobSpec", "%s:%d: unknown method key %s", path, line, key);
+    }
+    else
+        printError("readJobSpec", "%s:%d: %s is outside a section", path, line, key);
+}
+
+//=============================================================================
+// Constructors & Deconstructors
+//=============================================================================
+JobSpec *readJobSpec(const char *path)
+{
+    JobSpec *spec;
+    char buf[4096], *line, *eq;
+    int section = JOB_NO_SECTION, num_line = 0;
+    FILE *fp;
+
+    fp = fopen(path, "r");
+    if (fp == NULL)
+        printError("readJobSpec", "Could not open %s", path);
+
+    spec = (JobSpec *)calloc(1, sizeof(JobSpec)); // threads = 0: one per core
+
+    while (fgets(buf, sizeof(buf), fp) != NULL)
+    {
+        num_line++;
+        stripJobComment(buf);
+        line = trimJobString(buf);
+        if (*line == '\0')
+            continue;
+
+        if (*line == '[')
+        {
+            char *end = strchr(line, ']'), *name;
+
+            if (end == NULL)
+                printError("readJobSpec", "%s:%d: missing ]", path, num_line);
+            *end = '\0';
+            line = trimJobString(line + 1);
+            name = strchr(line, ' ');
+            if (name != NULL)
+                *name++ = '\0';
+
+            if (strcmp(line, "eval") == 0 && name == NULL)
+                section = JOB_EVAL;
+            else if (strcmp(line, "dataset") == 0 && name != NULL)
+            {
+                section = JOB_DATASET;
+                spec->datasets = (JobDataset *)realloc(spec->datasets, (spec->num_datasets + 1) * sizeof(JobDataset));
+                memset(&spec->datasets[spec->num_datasets], 0, sizeof(JobDataset));
+                spec->datasets[spec->num_datasets++].name = copyJobString(trimJobString(name));
+            }
+            else if (strcmp(line, "method") == 0 && name != NULL)
+            {
+                section = JOB_METHOD;
+                spec->methods = (JobMethod *)realloc(spec->methods, (spec->num_methods + 1) * sizeof(JobMethod));
+                memset(&spec->methods[spec->num_methods], 0, sizeof(JobMethod));
+                spec->methods[spec->num_methods++].name = copyJobString(trimJobString(name));
+            }
+            else
+                printError("readJobSpec", "%s:%d: expected [eval], [dataset <name>] or [method <name>]", path, num_line);
+            continue;
+        }
+
+        eq = strchr(line, '=');
+        if (eq == NULL)
+            printError("readJobSpec", "%s:%d: expected <key> = <value>", path, num_line);
+        *eq = '\0';
+        setJobKey(spec, section, trimJobString(line), trimJobString(eq + 1), path, num_line);
+    }
+    fclose(fp);
+
+    if (spec->metrics == NULL || spec->log == NULL)
+        printError("readJobSpec", "%s: [eval] needs metrics and log", path);
+    if (spec->num_datasets == 0 || spec->num_methods == 0)
+        printError("readJobSpec", "%s: at least one dataset and one method are needed", path);
+    for (int d = 0; d < spec->num_datasets; d++)
+        if (spec->datasets[d].img == NULL)
+            printError("readJobSpec", "%s: dataset %s has no img", path, spec->datasets[d].name);
+    for (int m = 0; m < spec->num_methods; m++)
+    {
+        if (spec->methods[m].labels == NULL || spec->methods[m].ext == NULL)
+            printError("readJobSpec", "%s: method %s needs labels and ext", path, spec->methods[m].name);
+        if (spec->num_ks == 0 && strstr(spec->methods[m].labels, "{k}") != NULL)
+            printError("readJobSpec", "%s: method %s uses {k}, but [eval] has no k", path, spec->methods[m].name);
+    }
+
+    return spec;
+}
+
+void freeJobSpec(JobSpec **spec)
+{
+    if (*spec != NULL)
+    {
+        JobSpec *tmp;
+
+        tmp = *spec;
+
+        for (int i = 0; i < tmp->num_ks; i++)
+            free(tmp->ks[i]);
+        for (int i = 0; i < tmp->num_options; i++)
+            free(tmp->options[i]);
+        for (int d = 0; d < tmp->num_datasets; d++)
+        {
+            free(tmp->datasets[d].name);
+            free(tmp->datasets[d].img);
+            free(tmp->datasets[d].gt);
+        }
+        for (int m = 0; m < tmp->num_methods; m++)
+        {
+            free(tmp->methods[m].name);
+            free(tmp->methods[m].labels);
+            free(tmp->methods[m].ext);
+        }
+        free(tmp->ks);
+        free(tmp->options);
+        free(tmp->datasets);
+        free(tmp->methods);
+        free(tmp->metrics);
+        free(tmp->log);
+        free(tmp->dlog);
+        free(tmp);
+
+        *spec = NULL;
+    }
+}
+
+//=============================================================================
+// Functions
+//=============================================================================
+void expandJobPath(const char *pattern, const char *dataset, const char *method, const char *k, char *output, size_t size)
+{
+    const char *keys[3] = {"{dataset}", "{method}", "{k}"}, *values[3] = {dataset, method, k != NULL ? k : ""};
+    size_t n = 0;
+
+    while (*pattern != '\0' && n + 1 < size)
+    {
+        int i;
+
+        for (i = 0; i < 3; i++)
+            if (strncmp(pattern, keys[i], strlen(keys[i])) == 0)
+                break;
+
+        if (i < 3)
+        {
+            n += snprintf(output + n, size - n, "%s", values[i]);
+            pattern += strlen(keys[i]);
+        }
+        else
+            output[n++] = *pattern++;
+    }
+    output[n < size ? n : size - 1] = '\0';
+}
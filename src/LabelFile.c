@@ -0,0 +1,507 @@
+#include "LabelFile.h"
+#include "Labels.h"
+#include <stdint.h>
+
+#define LABEL_FILE_MAGIC "LBL1"
+#define LABEL_FILE_HEADER 36     // Bytes before the block index
+#define LABEL_BLOCK_INDEX 16     // Bytes per block in the index
+#define LABEL_BLOCK_PIXELS 65536 // Approximate number of pixels per block
+
+#define LZ_MIN_MATCH 4
+#define LZ_HASH_BITS 14
+#define LZ_MAX_OFFSET 65535
+
+//=============================================================================
+// Private Prototypes
+//=============================================================================
+void putLE32(uint8_t *buf, uint32_t val);
+uint32_t getLE32(const uint8_t *buf);
+size_t encodeLabelRows(const int *labels, int num_rows, int xsize, int min_label, int width, uint8_t *out);
+bool decodeLabelRows(const uint8_t *in, size_t n, int num_rows, int xsize, int min_label, int width, int *labels);
+size_t compressLZ(const uint8_t *src, size_t n, uint8_t *dst);
+bool decompressLZ(const uint8_t *src, size_t n, uint8_t *dst, size_t dst_len);
+bool readLabelBlock(LabelFile *file, int block, int *labels);
+void closeLabelFileOnError(void *file);
+
+//=============================================================================
+// Constructors & Deconstructors
+//=============================================================================
+LabelFile *openLabelFile(const char *path)
+{
+    LabelFile *file;
+    uint8_t header[LABEL_FILE_HEADER], *index;
+    unsigned long long data_start;
+    struct stat st;
+    int rows;
+
+    file = (LabelFile *)calloc(1, sizeof(LabelFile));
+    pushErrorCleanup(closeLabelFileOnError, &file);
+    file->fp = fopen(path, "rb");
+    if (file->fp == NULL)
+        printError("openLabelFile", "Could not open %s", path);
+
+    if (fread(header, 1, LABEL_FILE_HEADER, file->fp) != LABEL_FILE_HEADER || memcmp(header, LABEL_FILE_MAGIC, 4) != 0)
+        printError("openLabelFile", "%s is not a label file", path);
+
+    file->xsize = (int)getLE32(&header[4]);
+    file->ysize = (int)getLE32(&header[8]);
+    file->zsize = (int)getLE32(&header[12]);
+    file->width = header[16];
+    file->min_label = (int)getLE32(&header[20]);
+    file->num_labels = (int)getLE32(&header[24]);
+    file->rows_per_block = (int)getLE32(&header[28]);
+    file->num_blocks = (int)getLE32(&header[32]);
+
+    // The image must fit an iftImage, and the block index the file, before anything is allocated
+    if (file->xsize <= 0 || file->ysize <= 0 || file->zsize <= 0 || file->rows_per_block <= 0 ||
+        (long long)file->xsize * file->ysize * file->zsize > INT_MAX ||
+        (file->width != 1 && file->width != 2 && file->width != 4))
+        printError("openLabelFile", "Invalid header in %s", path);
+    rows = file->ysize * file->zsize;
+    data_start = LABEL_FILE_HEADER + (unsigned long long)file->num_blocks * LABEL_BLOCK_INDEX;
+    if (file->rows_per_block > rows || file->num_blocks != (rows + file->rows_per_block - 1) / file->rows_per_block ||
+        fstat(fileno(file->fp), &st) == -1 || data_start > (unsigned long long)st.st_size)
+        printError("openLabelFile", "Invalid header in %s", path);
+
+    index = (uint8_t *)malloc((size_t)file->num_blocks * LABEL_BLOCK_INDEX);
+    if (fread(index, LABEL_BLOCK_INDEX, file->num_blocks, file->fp) != (size_t)file->num_blocks)
+    {
+        free(index);
+        printError("openLabelFile", "Truncated block index in %s", path);
+    }
+
+    file->index = (LabelBlock *)calloc(file->num_blocks, sizeof(LabelBlock));
+    for (int b = 0; b < file->num_blocks; b++)
+    {
+        uint8_t *entry = &index[(size_t)b * LABEL_BLOCK_INDEX];
+
+        LabelBlock *block = &file->index[b];
+        unsigned long long num_rows = iftMin(file->rows_per_block, rows - b * file->rows_per_block);
+
+        block->offset = getLE32(entry) | ((unsigned long long)getLE32(&entry[4]) << 32);
+        block->size = getLE32(&entry[8]);
+        block->raw_size = getLE32(&entry[12]);
+
+        // Bounds of encodeLabelRows (a run of width + 1 to width + 5 bytes per pixel at most, one per row
+        // at least) and compressLZ, which also bound the buffers of readLabelBlock
+        if (block->offset < data_start || block->offset + block->size > (unsigned long long)st.st_size ||
+            block->raw_size < num_rows * (file->width + 1) ||
+            block->raw_size > num_rows * file->xsize * (file->width + 5) ||
+            block->size > (unsigned long long)block->raw_size + block->raw_size / 255 + 16)
+        {
+            free(index);
+            printError("openLabelFile", "Invalid block %d in the index of %s", b, path);
+        }
+    }
+    free(index);
+
+    popErrorCleanup();
+    return file;
+}
+
+void closeLabelFile(LabelFile **file)
+{
+    if (*file != NULL)
+    {
+        LabelFile *tmp;
+
+        tmp = *file;
+
+        if (tmp->fp != NULL)
+            fclose(tmp->fp);
+        free(tmp->index);
+        free(tmp);
+
+        *file = NULL;
+    }
+}
+
+//=============================================================================
+// Private Functions
+//=============================================================================
+// ErrorCleanup of a label file being opened (see pushErrorCleanup)
+void closeLabelFileOnError(void *file)
+{
+    closeLabelFile((LabelFile **)file);
+}
+
+void putLE32(uint8_t *buf, uint32_t val)
+{
+    buf[0] = val & 0xFF;
+    buf[1] = (val >> 8) & 0xFF;
+    buf[2] = (val >> 16) & 0xFF;
+    buf[3] = (val >> 24) & 0xFF;
+}
+
+uint32_t getLE32(const uint8_t *buf)
+{
+    return (uint32_t)buf[0] | ((uint32_t)buf[1] << 8) | ((uint32_t)buf[2] << 16) | ((uint32_t)buf[3] << 24);
+}
+
+// Runs of each row: the label minus min_label (width bytes) and the run length (LEB128).
+// Runs do not cross rows. Returns the number of written bytes (at most num_rows * xsize * (width + 5))
+size_t encodeLabelRows(const int *labels, int num_rows, int xsize, int min_label, int width, uint8_t *out)
+{
+    uint8_t *ptr = out;
+
+    for (int y = 0; y < num_rows; y++)
+    {
+        const int *row = &labels[(size_t)y * xsize];
+        int x = 0;
+
+        while (x < xsize)
+        {
+            uint32_t value = (uint32_t)((int64_t)row[x] - min_label), run = 1; // Up to UINT32_MAX
+
+            while (x + (int)run < xsize && row[x + run] == row[x])
+                run++;
+            x += run;
+
+            for (int i = 0; i < width; i++)
+                *ptr++ = (value >> (8 * i)) & 0xFF;
+            while (run >= 128)
+            {
+                *ptr++ = (run & 0x7F) | 0x80;
+                run >>= 7;
+            }
+            *ptr++ = run;
+        }
+    }
+    return ptr - out;
+}
+
+bool decodeLabelRows(const uint8_t *in, size_t n, int num_rows, int xsize, int min_label, int width, int *labels)
+{
+    size_t i = 0, p = 0, total = (size_t)num_rows * xsize;
+
+    while (p < total)
+    {
+        uint32_t value = 0, run = 0;
+        int shift = 0;
+
+        if (i + width > n)
+            return false;
+        for (int b = 0; b < width; b++)
+            value |= (uint32_t)in[i++] << (8 * b);
+
+        do
+        {
+            if (i >= n || shift > 28)
+                return false;
+            run |= (uint32_t)(in[i] & 0x7F) << shift;
+            shift += 7;
+        } while (in[i++] & 0x80);
+
+        if (run == 0 || p + run > total || (p % xsize) + run > (size_t)xsize)
+            return false;
+        for (uint32_t k = 0; k < run; k++)
+            labels[p++] = (int)((int64_t)value + min_label);
+    }
+    return i == n;
+}
+
+/*
+ * LZ77 with LZ4-like sequences: a token (literal length << 4 | match length - 4),
+ * extra length bytes (255, ..., < 255) when a nibble is 15, the literals, and a
+ * 16-bit offset followed by the extra match length bytes. The last sequence has
+ * only literals. The output takes at most n + n / 255 + 16 bytes
+ */
+static uint32_t hashLZ(const uint8_t *p)
+{
+    uint32_t v;
+
+    memcpy(&v, p, 4);
+    return (v * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+static uint8_t *putLengthLZ(uint8_t *out, size_t len)
+{
+    while (len >= 255)
+    {
+        *out++ = 255;
+        len -= 255;
+    }
+    *out++ = (uint8_t)len;
+    return out;
+}
+
+static uint8_t *putSequenceLZ(uint8_t *out, const uint8_t *literals, size_t num_literals, size_t offset, size_t match)
+{
+    uint8_t *token = out++;
+    size_t extra = (match > 0) ? match - LZ_MIN_MATCH : 0;
+
+    *token = (uint8_t)((iftMin(num_literals, 15) << 4) | iftMin(extra, 15));
+    if (num_literals >= 15)
+        out = putLengthLZ(out, num_literals - 15);
+    memcpy(out, literals, num_literals);
+    out += num_literals;
+
+    if (match > 0)
+    {
+        *out++ = offset & 0xFF;
+        *out++ = (offset >> 8) & 0xFF;
+        if (extra >= 15)
+            out = putLengthLZ(out, extra - 15);
+    }
+    return out;
+}
+
+size_t compressLZ(const uint8_t *src, size_t n, uint8_t *dst)
+{
+    int *table = (int *)malloc((1 << LZ_HASH_BITS) * sizeof(int));
+    uint8_t *out = dst;
+    size_t i = 0, anchor = 0;
+
+    memset(table, -1, (1 << LZ_HASH_BITS) * sizeof(int));
+
+    while (i + LZ_MIN_MATCH <= n)
+    {
+        uint32_t h = hashLZ(&src[i]);
+        int candidate = table[h];
+
+        table[h] = (int)i;
+        if (candidate >= 0 && i - candidate <= LZ_MAX_OFFSET && memcmp(&src[candidate], &src[i], LZ_MIN_MATCH) == 0)
+        {
+            size_t len = LZ_MIN_MATCH;
+
+            while (i + len < n && src[candidate + len] == src[i + len])
+                len++;
+            out = putSequenceLZ(out, &src[anchor], i - anchor, i - candidate, len);
+            i += len;
+            anchor = i;
+        }
+        else
+            i++;
+    }
+    out = putSequenceLZ(out, &src[anchor], n - anchor, 0, 0);
+
+    free(table);
+    return out - dst;
+}
+
+bool decompressLZ(const uint8_t *src, size_t n, uint8_t *dst, size_t dst_len)
+{
+    size_t i = 0, o = 0;
+
+    while (i < n)
+    {
+        uint8_t token = src[i++], b;
+        size_t num_literals = token >> 4, match = token & 15, offset;
+
+        if (num_literals == 15)
+        {
+            do
+            {
+                if (i >= n)
+                    return false;
+                b = src[i++];
+                num_literals += b;
+            } while (b == 255);
+        }
+        if (num_literals > n - i || num_literals > dst_len - o)
+            return false;
+        memcpy(&dst[o], &src[i], num_literals);
+        i += num_literals;
+        o += num_literals;
+
+        if (i == n) // Last sequence
+            break;
+
+        if (i + 2 > n)
+            return false;
+        offset = src[i] | ((size_t)src[i + 1] << 8);
+        i += 2;
+        if (match == 15)
+        {
+            do
+            {
+                if (i >= n)
+                    return false;
+                b = src[i++];
+                match += b;
+            } while (b == 255);
+        }
+        match += LZ_MIN_MATCH;
+
+        if (offset == 0 || offset > o || match > dst_len - o)
+            return false;
+        for (size_t k = 0; k < match; k++) // Byte by byte: the match may overlap its copy
+            dst[o + k] = dst[o - offset + k];
+        o += match;
+    }
+    return o == dst_len;
+}
+
+// False if the block is truncated or corrupted. It runs on the threads of the callers' parallel loops,
+// so the callers report the error once the loop is over
+bool readLabelBlock(LabelFile *file, int block, int *labels)
+{
+    LabelBlock *entry = &file->index[block];
+    int first = block * file->rows_per_block;
+    int num_rows = iftMin(file->rows_per_block, file->ysize * file->zsize - first);
+    uint8_t *payload, *raw;
+    bool ok;
+
+    payload = (uint8_t *)malloc(iftMax(entry->size, 1));
+    raw = (uint8_t *)malloc(iftMax(entry->raw_size, 1));
+
+    // pread keeps the blocks independent, so they can be read by several threads
+    ok = pread(fileno(file->fp), payload, entry->size, (off_t)entry->offset) == (ssize_t)entry->size &&
+         decompressLZ(payload, entry->size, raw, entry->raw_size) &&
+         decodeLabelRows(raw, entry->raw_size, num_rows, file->xsize, file->min_label, file->width, labels);
+
+    free(payload);
+    free(raw);
+    return ok;
+}
+
+//=============================================================================
+// Functions
+//=============================================================================
+void writeLabelFile(const iftImage *labels, const char *path)
+{
+    int xsize = labels->xsize, rows = labels->ysize * labels->zsize;
+    int min_label, max_label, width, K, rows_per_block, num_blocks;
+    uint8_t header[LABEL_FILE_HEADER], *index, **payload;
+    unsigned int *size, *raw_size;
+    unsigned long long offset;
+    int *copy;
+    FILE *fp;
+
+    if (iftIsColorImage(labels))
+        printError("writeLabelFile", "The label image must be 1-channel grayscale");
+
+    iftMinMaxValues(labels, &min_label, &max_label);
+    if ((long)max_label - (long)min_label > (long)UINT32_MAX)
+        printError("writeLabelFile", "Label range too large");
+    width = ((long)max_label - min_label < 256) ? 1 : ((long)max_label - min_label < 65536) ? 2 : 4;
+
+    copy = (int *)malloc(labels->n * sizeof(int));
+    memcpy(copy, labels->val, labels->n * sizeof(int));
+    free(compactLabelArray(copy, labels->n, &K));
+    free(copy);
+
+    rows_per_block = iftMax(LABEL_BLOCK_PIXELS / xsize, 1);
+    num_blocks = (rows + rows_per_block - 1) / rows_per_block;
+
+    payload = (uint8_t **)calloc(num_blocks, sizeof(uint8_t *));
+    size = (unsigned int *)calloc(num_blocks, sizeof(unsigned int));
+    raw_size = (unsigned int *)calloc(num_blocks, sizeof(unsigned int));
+
+#pragma omp parallel for schedule(dynamic)
+    for (int b = 0; b < num_blocks; b++)
+    {
+        int first = b * rows_per_block, num_rows = iftMin(rows_per_block, rows - first);
+        size_t max_raw = (size_t)num_rows * xsize * (width + 5);
+        uint8_t *raw = (uint8_t *)malloc(max_raw);
+
+        raw_size[b] = encodeLabelRows(&labels->val[(size_t)first * xsize], num_rows, xsize, min_label, width, raw);
+        payload[b] = (uint8_t *)malloc(raw_size[b] + raw_size[b] / 255 + 16);
+        size[b] = compressLZ(raw, raw_size[b], payload[b]);
+        free(raw);
+    }
+
+    fp = fopen(path, "wb");
+    if (fp == NULL)
+        printError("writeLabelFile", "Could not open %s", path);
+
+    memcpy(header, LABEL_FILE_MAGIC, 4);
+    putLE32(&header[4], labels->xsize);
+    putLE32(&header[8], labels->ysize);
+    putLE32(&header[12], labels->zsize);
+    header[16] = width;
+    header[17] = header[18] = header[19] = 0;
+    putLE32(&header[20], min_label);
+    putLE32(&header[24], K);
+    putLE32(&header[28], rows_per_block);
+    putLE32(&header[32], num_blocks);
+    fwrite(header, 1, LABEL_FILE_HEADER, fp);
+
+    index = (uint8_t *)malloc((size_t)num_blocks * LABEL_BLOCK_INDEX);
+    offset = LABEL_FILE_HEADER + (unsigned long long)num_blocks * LABEL_BLOCK_INDEX;
+    for (int b = 0; b < num_blocks; b++)
+    {
+        uint8_t *entry = &index[(size_t)b * LABEL_BLOCK_INDEX];
+
+        putLE32(entry, offset & 0xFFFFFFFF);
+        putLE32(&entry[4], offset >> 32);
+        putLE32(&entry[8], size[b]);
+        putLE32(&entry[12], raw_size[b]);
+        offset += size[b];
+    }
+    fwrite(index, LABEL_BLOCK_INDEX, num_blocks, fp);
+
+    for (int b = 0; b < num_blocks; b++)
+    {
+        fwrite(payload[b], 1, size[b], fp);
+        free(payload[b]);
+    }
+    if (fclose(fp) != 0)
+        printError("writeLabelFile", "Could not write %s", path);
+
+    free(index);
+    free(payload);
+    free(size);
+    free(raw_size);
+}
+
+iftImage *readLabelFile(const char *path)
+{
+    LabelFile *file = openLabelFile(path);
+    iftImage *labels = iftCreateImage(file->xsize, file->ysize, file->zsize);
+    int failed = -1; // A block that could not be read
+
+#pragma omp parallel for schedule(dynamic)
+    for (int b = 0; b < file->num_blocks; b++)
+        if (!readLabelBlock(file, b, &labels->val[(size_t)b * file->rows_per_block * file->xsize]))
+            __atomic_store_n(&failed, b, __ATOMIC_RELAXED);
+
+    closeLabelFile(&file);
+    if (failed != -1)
+    {
+        iftDestroyImage(&labels);
+        printError("readLabelFile", "Block %d of %s is truncated or corrupted", failed, path);
+    }
+    return labels;
+}
+
+void readLabelFileRows(LabelFile *file, int first, int num_rows, int *labels)
+{
+    int rows = file->ysize * file->zsize;
+
+    if (first < 0 || num_rows < 0 || first + num_rows > rows)
+        printError("readLabelFileRows", "Rows %d to %d out of range", first, first + num_rows - 1);
+    if (num_rows == 0)
+        return;
+
+    int first_block = first / file->rows_per_block, last_block = (first + num_rows - 1) / file->rows_per_block;
+    int failed = -1; // A block that could not be read
+
+#pragma omp parallel for schedule(dynamic)
+    for (int b = first_block; b <= last_block; b++)
+    {
+        int block_first = b * file->rows_per_block;
+        int block_rows = iftMin(file->rows_per_block, rows - block_first);
+        int from = iftMax(first, block_first), to = iftMin(first + num_rows, block_first + block_rows);
+
+        if (from == block_first && to == block_first + block_rows) // Whole block: decode in place
+        {
+            if (!readLabelBlock(file, b, &labels[(size_t)(from - first) * file->xsize]))
+                __atomic_store_n(&failed, b, __ATOMIC_RELAXED);
+        }
+        else
+        {
+            int *tmp = (int *)malloc((size_t)block_rows * file->xsize * sizeof(int));
+
+            if (readLabelBlock(file, b, tmp))
+                memcpy(&labels[(size_t)(from - first) * file->xsize], &tmp[(size_t)(from - block_first) * file->xsize],
+                       (size_t)(to - from) * file->xsize * sizeof(int));
+            else
+                __atomic_store_n(&failed, b, __ATOMIC_RELAXED);
+            free(tmp);
+        }
+    }
+
+    if (failed != -1)
+        printError("readLabelFileRows", "Block %d is truncated or corrupted", failed);
+}
@@ -0,0 +1,192 @@
+#include "LabelStream.h"
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+//=============================================================================
+// Private Prototypes
+//=============================================================================
+uint32_t getFrame32(const uint8_t *buf);
+void putFrame32(uint8_t *buf, uint32_t val);
+bool parseFrameHeader(const uint8_t *header, size_t id_size, int *width, int *size, size_t *id_len);
+iftImage *createFrameImage(const uint8_t *header);
+void widenFrameLabels(const uint8_t *payload, int width, iftImage *img);
+
+//=============================================================================
+// Private Functions
+//=============================================================================
+uint32_t getFrame32(const uint8_t *buf)
+{
+    return (uint32_t)buf[0] | ((uint32_t)buf[1] << 8) | ((uint32_t)buf[2] << 16) | ((uint32_t)buf[3] << 24);
+}
+
+void putFrame32(uint8_t *buf, uint32_t val)
+{
+    for (int i = 0; i < 4; i++)
+        buf[i] = (uint8_t)(val >> (8 * i));
+}
+
+// False if the header is invalid or its id does not fit in id_size bytes (with the '\0')
+bool parseFrameHeader(const uint8_t *header, size_t id_size, int *width, int *size, size_t *id_len)
+{
+    int64_t n = (int64_t)getFrame32(&header[8]) * getFrame32(&header[12]) * getFrame32(&header[16]);
+
+    *width = header[4];
+    *size = (int)n;
+    *id_len = getFrame32(&header[20]);
+    return memcmp(header, LABEL_FRAME_MAGIC, 4) == 0 && (*width == 1 || *width == 2 || *width == 4) &&
+           n > 0 && n <= INT_MAX && (int)getFrame32(&header[8]) > 0 && (int)getFrame32(&header[12]) > 0 &&
+           (int)getFrame32(&header[16]) > 0 && *id_len > 0 && *id_len < id_size;
+}
+
+iftImage *createFrameImage(const uint8_t *header)
+{
+    iftImage *img = iftCreateImage((int)getFrame32(&header[8]), (int)getFrame32(&header[12]), (int)getFrame32(&header[16]));
+
+    if (img->zsize == 1)
+        img->dz = 0.0;
+    return img;
+}
+
+// Labels of the payload; it may be img->val itself (width 4)
+void widenFrameLabels(const uint8_t *payload, int width, iftImage *img)
+{
+    if (width == 1)
+    {
+#pragma omp parallel for
+        for (int p = 0; p < img->n; p++)
+            img->val[p] = payload[p];
+    }
+    else if (width == 2)
+    {
+#pragma omp parallel for
+        for (int p = 0; p < img->n; p++)
+            img->val[p] = payload[2 * p] | (payload[2 * p + 1] << 8);
+    }
+    else
+    {
+#pragma omp parallel for
+        for (int p = 0; p < img->n; p++)
+            img->val[p] = (int32_t)getFrame32(&payload[4 * (size_t)p]); // In place: same bytes
+    }
+}
+
+//=============================================================================
+// Functions
+//=============================================================================
+bool readLabelFrame(FILE *fp, char *id, size_t id_size, iftImage **labels)
+{
+    uint8_t header[LABEL_FRAME_HEADER], *payload;
+    size_t read, id_len;
+    int width, size;
+    iftImage *img;
+
+    read = fread(header, 1, LABEL_FRAME_HEADER, fp);
+    if (read == 0 && feof(fp))
+        return false;
+    if (read != LABEL_FRAME_HEADER || !parseFrameHeader(header, id_size, &width, &size, &id_len))
+        printError("readLabelFrame", "Invalid frame header");
+
+    if (fread(id, 1, id_len, fp) != id_len)
+        printError("readLabelFrame", "Truncated frame id");
+    id[id_len] = '\0';
+
+    // Read as is, then widened in parallel
+    img = createFrameImage(header);
+    payload = (width == 4) ? (uint8_t *)img->val : (uint8_t *)malloc((size_t)size * width);
+    if (fread(payload, width, size, fp) != (size_t)size)
+        printError("readLabelFrame", "Truncated labels of frame %s", id);
+
+    widenFrameLabels(payload, width, img);
+    if (width != 4)
+        free(payload);
+
+    *labels = img;
+    return true;
+}
+
+bool parseLabelFrame(const void *buf, size_t size, char *id, size_t id_size, iftImage **labels)
+{
+    const uint8_t *frame = (const uint8_t *)buf;
+    size_t id_len;
+    int width, n;
+
+    if (size < LABEL_FRAME_HEADER || !parseFrameHeader(frame, id_size, &width, &n, &id_len))
+        return false;
+    if (size - LABEL_FRAME_HEADER < id_len || (size - LABEL_FRAME_HEADER - id_len) / width < (size_t)n)
+        return false;
+
+    memcpy(id, &frame[LABEL_FRAME_HEADER], id_len);
+    id[id_len] = '\0';
+
+    *labels = createFrameImage(frame);
+    widenFrameLabels(&frame[LABEL_FRAME_HEADER + id_len], width, *labels);
+    return true;
+}
+
+bool readSharedLabelFrame(const char *name, char *id, size_t id_size, iftImage **labels)
+{
+    char shm_name[256];
+    struct stat st;
+    void *map;
+    bool valid;
+    int fd;
+
+    snprintf(shm_name, sizeof(shm_name), "%s%s", (name[0] == '/') ? "" : "/", name);
+    fd = shm_open(shm_name, O_RDONLY, 0);
+    if (fd < 0)
+        return false;
+    if (fstat(fd, &st) != 0 || st.st_size == 0)
+    {
+        close(fd);
+        return false;
+    }
+
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        return false;
+
+    valid = parseLabelFrame(map, st.st_size, id, id_size, labels);
+    munmap(map, st.st_size);
+    return valid;
+}
+
+void writeLabelFrame(FILE *fp, const char *id, iftImage *labels)
+{
+    uint8_t header[LABEL_FRAME_HEADER] = {0}, *payload;
+    int min_val, max_val, width;
+    size_t id_len = strlen(id);
+
+    iftMinMaxValues(labels, &min_val, &max_val);
+    width = (min_val >= 0 && max_val < 256) ? 1 : (min_val >= 0 && max_val < 65536) ? 2 : 4;
+
+    memcpy(header, LABEL_FRAME_MAGIC, 4);
+    header[4] = (uint8_t)width;
+    putFrame32(&header[8], labels->xsize);
+    putFrame32(&header[12], labels->ysize);
+    putFrame32(&header[16], labels->zsize);
+    putFrame32(&header[20], (uint32_t)id_len);
+
+    payload = (uint8_t *)malloc((size_t)labels->n * width);
+#pragma omp parallel for
+    for (int p = 0; p < labels->n; p++)
+    {
+        if (width == 1)
+            payload[p] = (uint8_t)labels->val[p];
+        else if (width == 2)
+        {
+            payload[2 * p] = (uint8_t)labels->val[p];
+            payload[2 * p + 1] = (uint8_t)(labels->val[p] >> 8);
+        }
+        else
+            putFrame32(&payload[4 * (size_t)p], (uint32_t)labels->val[p]);
+    }
+
+    if (fwrite(header, 1, LABEL_FRAME_HEADER, fp) != LABEL_FRAME_HEADER || fwrite(id, 1, id_len, fp) != id_len ||
+        fwrite(payload, width, labels->n, fp) != (size_t)labels->n)
+        printError("writeLabelFrame", "Could not write the frame of %s", id);
+    free(payload);
+}
@@ -0,0 +1,328 @@
+#include "Labels.h"
+#include <omp.h>
+
+//=============================================================================
+// Private Structures
+//=============================================================================
+// Open-addressing hash set/map of non-negative labels (-1 = empty slot)
+typedef struct
+{
+    int *key, *value;
+    int size, count; // size is a power of two
+} LabelHash;
+
+//=============================================================================
+// Private Prototypes
+//=============================================================================
+void initLabelHash(LabelHash *hash, int size, bool with_values);
+void freeLabelHash(LabelHash *hash);
+int findLabelHashSlot(LabelHash *hash, int key);
+void insertLabelHash(LabelHash *hash, int key);
+int compareLabels(const void *a, const void *b);
+
+//=============================================================================
+// Constructors & Deconstructors
+//=============================================================================
+LabelIndex *createLabelIndex(iftImage *labels)
+{
+    LabelIndex *index;
+    int num_threads, K = 0, *count;
+
+    index = (LabelIndex *)calloc(1, sizeof(LabelIndex));
+
+#pragma omp parallel for reduction(max : K)
+    for (int p = 0; p < labels->n; p++)
+        if (labels->val[p] + 1 > K)
+            K = labels->val[p] + 1;
+
+    num_threads = omp_get_max_threads();
+    index->num_labels = K;
+    index->offsets = (int *)calloc(K + 1, sizeof(int));
+
+    // count[t * K + l]: pixels of label l in the chunk of thread t, then its first position
+    count = (int *)calloc((size_t)num_threads * iftMax(K, 1), sizeof(int));
+
+#pragma omp parallel num_threads(num_threads)
+    {
+        int *local = &count[(size_t)omp_get_thread_num() * K];
+
+#pragma omp single
+        num_threads = omp_get_num_threads(); // May be smaller, e.g. in nested regions
+
+#pragma omp for schedule(static)
+        for (int p = 0; p < labels->n; p++)
+            if (labels->val[p] >= 0)
+                local[labels->val[p]]++;
+    }
+
+    // Exclusive prefix sum in (label, thread) order keeps each label in raster order
+    int total = 0;
+    for (int l = 0; l < K; l++)
+    {
+        index->offsets[l] = total;
+        for (int t = 0; t < num_threads; t++)
+        {
+            int c = count[(size_t)t * K + l];
+            count[(size_t)t * K + l] = total;
+            total += c;
+        }
+    }
+    index->offsets[K] = total;
+    index->num_pixels = total;
+    index->pixels = (int *)malloc(iftMax(total, 1) * sizeof(int));
+
+    // Same static schedule, so each thread scatters the chunk it counted
+#pragma omp parallel num_threads(num_threads)
+    {
+        int *local = &count[(size_t)omp_get_thread_num() * K];
+
+#pragma omp for schedule(static)
+        for (int p = 0; p < labels->n; p++)
+            if (labels->val[p] >= 0)
+                index->pixels[local[labels->val[p]]++] = p;
+    }
+
+    free(count);
+    return index;
+}
+
+void freeLabelIndex(LabelIndex **index)
+{
+    if (*index != NULL)
+    {
+        LabelIndex *tmp;
+
+        tmp = *index;
+
+        free(tmp->offsets);
+        free(tmp->pixels);
+        free(tmp);
+
+        *index = NULL;
+    }
+}
+
+//=============================================================================
+// Private Functions
+//=============================================================================
+void initLabelHash(LabelHash *hash, int size, bool with_values)
+{
+    hash->size = 64;
+    while (hash->size < 2 * size)
+        hash->size <<= 1;
+    hash->count = 0;
+    hash->key = (int *)malloc(hash->size * sizeof(int));
+    hash->value = with_values ? (int *)malloc(hash->size * sizeof(int)) : NULL;
+    memset(hash->key, -1, hash->size * sizeof(int));
+}
+
+void freeLabelHash(LabelHash *hash)
+{
+    free(hash->key);
+    free(hash->value);
+    hash->key = hash->value = NULL;
+}
+
+int findLabelHashSlot(LabelHash *hash, int key)
+{
+    unsigned int slot = ((unsigned int)key * 2654435761u) & (hash->size - 1);
+
+    while (hash->key[slot] != -1 && hash->key[slot] != key)
+        slot = (slot + 1) & (hash->size - 1);
+    return slot;
+}
+
+void insertLabelHash(LabelHash *hash, int key)
+{
+    int slot = findLabelHashSlot(hash, key);
+
+    if (hash->key[slot] == key)
+        return;
+
+    hash->key[slot] = key;
+    hash->count++;
+
+    // Keep the load factor below 1/2
+    if (2 * hash->count > hash->size)
+    {
+        LabelHash tmp;
+
+        initLabelHash(&tmp, hash->size, false);
+        for (int i = 0; i < hash->size; i++)
+            if (hash->key[i] != -1)
+                tmp.key[findLabelHashSlot(&tmp, hash->key[i])] = hash->key[i];
+        tmp.count = hash->count;
+        freeLabelHash(hash);
+        *hash = tmp;
+    }
+}
+
+int compareLabels(const void *a, const void *b)
+{
+    int x = *(const int *)a, y = *(const int *)b;
+    return (x > y) - (x < y);
+}
+
+//=============================================================================
+// Functions
+//=============================================================================
+int *compactLabelArray(int *labels, int n, int *num_labels)
+{
+    int max_label = -1, K = 0, *orig_labels;
+
+#pragma omp parallel for reduction(max : max_label)
+    for (int p = 0; p < n; p++)
+        if (labels[p] > max_label)
+            max_label = labels[p];
+
+    if ((long)max_label < 2 * (long)n + 1024)
+    {
+        // Dense enough: direct table indexed by label (counting pass)
+        int *table = (int *)calloc(max_label + 1, sizeof(int));
+
+#pragma omp parallel for
+        for (int p = 0; p < n; p++)
+            if (labels[p] >= 0)
+                table[labels[p]] = 1; // Benign race: every writer stores 1
+
+        for (int l = 0; l <= max_label; l++)
+            K += table[l];
+
+        orig_labels = (int *)malloc(iftMax(K, 1) * sizeof(int));
+        K = 0;
+        for (int l = 0; l <= max_label; l++)
+        {
+            if (table[l])
+            {
+                orig_labels[K] = l;
+                table[l] = K++;
+            }
+        }
+
+#pragma omp parallel for
+        for (int p = 0; p < n; p++)
+            labels[p] = (labels[p] >= 0) ? table[labels[p]] : -1;
+
+        free(table);
+    }
+    else
+    {
+        // Sparse labels: per-thread hash sets, merged and sorted
+        int num_threads = omp_get_max_threads(), total = 0, *offset;
+        LabelHash *local, map;
+
+        local = (LabelHash *)calloc(num_threads, sizeof(LabelHash));
+        offset = (int *)calloc(num_threads + 1, sizeof(int));
+
+#pragma omp parallel num_threads(num_threads)
+        {
+            int t = omp_get_thread_num();
+
+            initLabelHash(&local[t], 1024, false);
+#pragma omp for schedule(static)
+            for (int p = 0; p < n; p++)
+                if (labels[p] >= 0)
+                    insertLabelHash(&local[t], labels[p]);
+        }
+
+        for (int t = 0; t < num_threads; t++)
+        {
+            offset[t] = total;
+            total += local[t].count;
+        }
+        offset[num_threads] = total;
+
+        orig_labels = (int *)malloc(iftMax(total, 1) * sizeof(int));
+        for (int t = 0; t < num_threads; t++)
+        {
+            int j = offset[t];
+            for (int i = 0; i < local[t].size; i++)
+                if (local[t].key[i] != -1)
+                    orig_labels[j++] = local[t].key[i];
+            freeLabelHash(&local[t]);
+        }
+
+        qsort(orig_labels, total, sizeof(int), compareLabels);
+        for (int i = 0; i < total; i++)
+            if (K == 0 || orig_labels[i] != orig_labels[K - 1])
+                orig_labels[K++] = orig_labels[i];
+
+        initLabelHash(&map, K, true);
+        for (int l = 0; l < K; l++)
+        {
+            int slot = findLabelHashSlot(&map, orig_labels[l]);
+            map.key[slot] = orig_labels[l];
+            map.value[slot] = l;
+        }
+
+#pragma omp parallel for
+        for (int p = 0; p < n; p++)
+            labels[p] = (labels[p] >= 0) ? map.value[findLabelHashSlot(&map, labels[p])] : -1;
+
+        freeLabelHash(&map);
+        free(local);
+        free(offset);
+    }
+
+    *num_labels = K;
+    return orig_labels;
+}
+
+int *compactLabels(iftImage *labels, int *num_labels)
+{
+    if (iftIsColorImage(labels))
+        printError(__func__, "The label image must be 1-channel grayscale");
+
+    return compactLabelArray(labels->val, labels->n, num_labels);
+}
+
+void restoreLabelIds(iftImage *labels, const iftImage *dense, const int *orig_labels, int num_labels)
+{
+    int num_regions = 0, next_id = 0, j = 0, *ids;
+    bool *taken;
+
+    for (int p = 0; p < labels->n; p++)
+        num_regions = iftMax(num_regions, labels->val[p] + 1);
+    ids = (int *)malloc((num_regions > 0 ? num_regions : 1) * sizeof(int));
+    taken = (bool *)calloc(num_labels > 0 ? num_labels : 1, sizeof(bool));
+    for (int r = 0; r < num_regions; r++)
+        ids[r] = -1;
+
+    for (int p = 0; p < labels->n; p++)
+    {
+        int r = labels->val[p], d = dense->val[p];
+
+        if (r < 0 || ids[r] != -1)
+            continue;
+        if (d >= 0 && !taken[d])
+        {
+            ids[r] = orig_labels[d];
+            taken[d] = true;
+        }
+        else
+        {
+            // orig_labels is increasing: skip its values to find the next unused id
+            while (j < num_labels && orig_labels[j] < next_id)
+                j++;
+            while (j < num_labels && orig_labels[j] == next_id)
+            {
+                next_id++;
+                j++;
+            }
+            ids[r] = next_id++;
+        }
+    }
+
+#pragma omp parallel for
+    for (int p = 0; p < labels->n; p++)
+        if (labels->val[p] >= 0)
+            labels->val[p] = ids[labels->val[p]];
+
+    free(ids);
+    free(taken);
+}
+
+int getLabelSize(LabelIndex *index, int label)
+{
+    return index->offsets[label + 1] - index->offsets[label];
+}
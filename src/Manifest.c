@@ -0,0 +1,202 @@
+#include "Manifest.h"
+#include <ctype.h>
+
+//=============================================================================
+// Private Prototypes
+//=============================================================================
+char *trimManifestField(char *s);
+int splitManifestLine(char *line, char **fields, int max_fields);
+bool readManifestLine(Manifest *manifest, char **fields, int *num_fields);
+char *copyManifestField(char **fields, int field);
+void getManifestStem(const char *path, char *stem, size_t size);
+
+static const char *manifestColumns[MANIFEST_COLUMNS] = {"id", "image", "labels", "gt", "recon", "imgScores"};
+
+#define MANIFEST_MAX_FIELDS 16
+
+//=============================================================================
+// Private Functions
+//=============================================================================
+// Removes the leading and trailing blanks (and the line break) in place
+char *trimManifestField(char *s)
+{
+    char *end;
+
+    while (isspace((unsigned char)*s))
+        s++;
+    end = s + strlen(s);
+    while (end > s && isspace((unsigned char)end[-1]))
+        end--;
+    *end = '\0';
+    return s;
+}
+
+// Splits line in place at the commas, returning the number of fields (max_fields + 1 if there are more)
+int splitManifestLine(char *line, char **fields, int max_fields)
+{
+    int n = 0;
+
+    while (line != NULL)
+    {
+        char *comma = strchr(line, ',');
+
+        if (comma != NULL)
+            *comma = '\0';
+        if (n == max_fields)
+            return max_fields + 1;
+        fields[n++] = trimManifestField(line);
+        line = (comma != NULL) ? comma + 1 : NULL;
+    }
+    return n;
+}
+
+// Next line that is neither empty nor a comment, split into fields; false at the end of the file
+bool readManifestLine(Manifest *manifest, char **fields, int *num_fields)
+{
+    while (getline(&manifest->buf, &manifest->buf_size, manifest->fp) >= 0)
+    {
+        char *line = trimManifestField(manifest->buf);
+
+        manifest->line++;
+        if (*line == '\0' || *line == '#')
+            continue;
+
+        *num_fields = splitManifestLine(line, fields, MANIFEST_MAX_FIELDS);
+        return true;
+    }
+    return false;
+}
+
+char *copyManifestField(char **fields, int field)
+{
+    char *copy;
+
+    if (field < 0 || fields[field][0] == '\0')
+        return NULL;
+    copy = (char *)malloc(strlen(fields[field]) + 1);
+    strcpy(copy, fields[field]);
+    return copy;
+}
+
+// File name of path without its extension
+void getManifestStem(const char *path, char *stem, size_t size)
+{
+    const char *base = strrchr(path, '/'), *ext;
+    size_t length;
+
+    base = (base != NULL) ? base + 1 : path;
+    ext = strrchr(base, '.');
+    length = (ext != NULL && ext != base) ? (size_t)(ext - base) : strlen(base);
+    snprintf(stem, size, "%.*s", (int)length, base);
+}
+
+//=============================================================================
+// Constructors & Deconstructors
+//=============================================================================
+Manifest *openManifest(const char *path)
+{
+    Manifest *manifest;
+    char *fields[MANIFEST_MAX_FIELDS];
+
+    manifest = (Manifest *)calloc(1, sizeof(Manifest));
+    manifest->fp = fopen(path, "r");
+    if (manifest->fp == NULL)
+        printError("openManifest", "Could not open %s", path);
+    manifest->path = (char *)malloc(strlen(path) + 1);
+    strcpy(manifest->path, path);
+
+    if (!readManifestLine(manifest, fields, &manifest->num_fields))
+        printError("openManifest", "%s has no header", path);
+    if (manifest->num_fields > MANIFEST_MAX_FIELDS)
+        printError("openManifest", "%s:%ld: too many columns", path, manifest->line);
+
+    for (int c = 0; c < MANIFEST_COLUMNS; c++)
+        manifest->fields[c] = -1;
+    for (int f = 0; f < manifest->num_fields; f++)
+    {
+        int c;
+
+        for (c = 0; c < MANIFEST_COLUMNS; c++)
+            if (strcmp(fields[f], manifestColumns[c]) == 0)
+                break;
+        if (c == MANIFEST_COLUMNS)
+            printError("openManifest", "%s:%ld: unknown column %s (expected id, image, labels, gt, recon or imgScores)",
+                       path, manifest->line, fields[f]);
+        if (manifest->fields[c] != -1)
+            printError("openManifest", "%s:%ld: repeated column %s", path, manifest->line, fields[f]);
+        manifest->fields[c] = f;
+    }
+    if (manifest->fields[MANIFEST_LABELS] == -1)
+        printError("openManifest", "%s: the labels column is required", path);
+
+    return manifest;
+}
+
+void closeManifest(Manifest **manifest)
+{
+    if (*manifest != NULL)
+    {
+        Manifest *tmp;
+
+        tmp = *manifest;
+
+        fclose(tmp->fp);
+        free(tmp->path);
+        free(tmp->buf);
+        free(tmp);
+
+        *manifest = NULL;
+    }
+}
+
+//=============================================================================
+// Functions
+//=============================================================================
+int readManifestChunk(Manifest *manifest, ManifestEntry *entries, int max_entries)
+{
+    char *fields[MANIFEST_MAX_FIELDS];
+    int n = 0, num_fields;
+
+    while (n < max_entries && readManifestLine(manifest, fields, &num_fields))
+    {
+        ManifestEntry *entry = &entries[n++];
+
+        if (num_fields != manifest->num_fields)
+            printError("readManifestChunk", "%s:%ld: expected %d fields", manifest->path, manifest->line,
+                       manifest->num_fields);
+
+        entry->line = manifest->line;
+        entry->image = copyManifestField(fields, manifest->fields[MANIFEST_IMAGE]);
+        entry->labels = copyManifestField(fields, manifest->fields[MANIFEST_LABELS]);
+        entry->gt = copyManifestField(fields, manifest->fields[MANIFEST_GT]);
+        entry->recon = copyManifestField(fields, manifest->fields[MANIFEST_RECON]);
+        entry->imgScores = copyManifestField(fields, manifest->fields[MANIFEST_SCORES]);
+        if (entry->labels == NULL)
+            printError("readManifestChunk", "%s:%ld: the labels are empty", manifest->path, manifest->line);
+
+        if (manifest->fields[MANIFEST_ID] != -1 && fields[manifest->fields[MANIFEST_ID]][0] != '\0')
+            snprintf(entry->id, sizeof(entry->id), "%s", fields[manifest->fields[MANIFEST_ID]]);
+        else
+            getManifestStem(entry->image != NULL ? entry->image : entry->labels, entry->id, sizeof(entry->id));
+        // The logs and the journal are split at the blanks
+        for (char *c = entry->id; *c != '\0'; c++)
+            if (isspace((unsigned char)*c))
+                printError("readManifestChunk", "%s:%ld: the id \"%s\" contains blanks", manifest->path,
+                           manifest->line, entry->id);
+    }
+
+    return n;
+}
+
+void clearManifestEntries(ManifestEntry *entries, int num_entries)
+{
+    for (int i = 0; i < num_entries; i++)
+    {
+        free(entries[i].image);
+        free(entries[i].labels);
+        free(entries[i].gt);
+        free(entries[i].recon);
+        free(entries[i].imgScores);
+        memset(&entries[i], 0, sizeof(ManifestEntry));
+    }
+}
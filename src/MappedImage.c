@@ -0,0 +1,194 @@
+#include "MappedImage.h"
+#include <sys/mman.h>
+#include <fcntl.h>
+
+//=============================================================================
+// Private Prototypes
+//=============================================================================
+bool parseMappedHeaderInt(const unsigned char *buf, size_t size, size_t *pos, int *value);
+bool parseMappedHeader(MappedImage *img, const unsigned char *buf, size_t size);
+
+//=============================================================================
+// Constructors & Deconstructors
+//=============================================================================
+MappedImage *openMappedImage(const char *path)
+{
+    MappedImage *img;
+    struct stat st;
+    int fd;
+    void *map;
+
+    fd = open(path, O_RDONLY);
+    if (fd == -1)
+        printError("openMappedImage", "Could not open %s", path);
+    if (fstat(fd, &st) == -1 || st.st_size < 3)
+    {
+        close(fd);
+        return NULL;
+    }
+
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd); // The mapping keeps the file
+    if (map == MAP_FAILED)
+        return NULL;
+
+    img = (MappedImage *)calloc(1, sizeof(MappedImage));
+    img->map = map;
+    img->map_size = st.st_size;
+
+    if (!parseMappedHeader(img, (const unsigned char *)map, st.st_size))
+    {
+        closeMappedImage(&img);
+        return NULL;
+    }
+    if (img->data == NULL)
+    {
+        closeMappedImage(&img);
+        printError("openMappedImage", "Truncated image %s", path);
+    }
+
+    madvise(map, st.st_size, MADV_SEQUENTIAL);
+    return img;
+}
+
+MappedImage *openMappedImageBuffer(const void *buf, size_t size)
+{
+    MappedImage *img = (MappedImage *)calloc(1, sizeof(MappedImage));
+
+    if (!parseMappedHeader(img, (const unsigned char *)buf, size) || img->data == NULL)
+        closeMappedImage(&img);
+    return img;
+}
+
+void closeMappedImage(MappedImage **img)
+{
+    if (*img != NULL)
+    {
+        MappedImage *tmp;
+
+        tmp = *img;
+
+        if (tmp->map != NULL)
+            munmap(tmp->map, tmp->map_size);
+        iftDestroyImage(&tmp->image);
+        free(tmp);
+
+        *img = NULL;
+    }
+}
+
+//=============================================================================
+// Private Functions
+//=============================================================================
+// Skips whitespace and comments (# up to the end of the line), then reads a decimal value
+bool parseMappedHeaderInt(const unsigned char *buf, size_t size, size_t *pos, int *value)
+{
+    size_t i = *pos;
+    long v = 0;
+
+    while (i < size && (isspace(buf[i]) || buf[i] == '#'))
+    {
+        if (buf[i] == '#')
+            while (i < size && buf[i] != '\n')
+                i++;
+        else
+            i++;
+    }
+
+    if (i >= size || !isdigit(buf[i]))
+        return false;
+    while (i < size && isdigit(buf[i]) && v <= INT_MAX)
+        v = 10 * v + (buf[i++] - '0');
+
+    *pos = i;
+    *value = (int)v;
+    return v <= INT_MAX;
+}
+
+// Fills the header fields and the view; data is NULL if the file is shorter than the samples
+bool parseMappedHeader(MappedImage *img, const unsigned char *buf, size_t size)
+{
+    size_t pos = 2;
+    int max_val;
+
+    if (size < 3 || buf[0] != 'P' || (buf[1] != '5' && buf[1] != '6') ||
+        !parseMappedHeaderInt(buf, size, &pos, &img->xsize) ||
+        !parseMappedHeaderInt(buf, size, &pos, &img->ysize) ||
+        !parseMappedHeaderInt(buf, size, &pos, &max_val) ||
+        pos >= size || img->xsize <= 0 || img->ysize <= 0 || max_val <= 0 || max_val > 65535)
+        return false;
+
+    img->channels = (buf[1] == '5') ? 1 : 3;
+    img->max_val = max_val;
+    img->bytes = (max_val < 256) ? 1 : 2;
+    img->n = img->xsize * img->ysize;
+
+    // A single whitespace separates the header from the samples
+    if (size - (pos + 1) >= (size_t)img->n * img->channels * img->bytes)
+        img->data = &buf[pos + 1];
+    return true;
+}
+
+//=============================================================================
+// Functions
+//=============================================================================
+iftImage *getMappedIftImage(MappedImage *img)
+{
+    if (img->image != NULL)
+        return img->image;
+
+    iftImage *image = iftCreateImage(img->xsize, img->ysize, 1);
+    image->dz = 0.0;
+
+    if (img->channels == 1)
+    {
+#pragma omp parallel for
+        for (int p = 0; p < img->n; p++)
+            image->val[p] = getMappedSample(img, p, 0);
+    }
+    else
+    {
+        // Same conversion as iftReadImageP6
+        int rgbBitDepth = ceil(iftLog(img->max_val, 2)), ycbcrBitDepth = rgbBitDepth;
+
+        if (ycbcrBitDepth < 10)
+            ycbcrBitDepth = 10;
+        else if (ycbcrBitDepth < 12)
+            ycbcrBitDepth = 12;
+        else if (ycbcrBitDepth < 16)
+            ycbcrBitDepth = 16;
+
+        image->Cb = iftAllocUShortArray(img->n);
+        image->Cr = iftAllocUShortArray(img->n);
+
+#pragma omp parallel for
+        for (int p = 0; p < img->n; p++)
+        {
+            iftColor RGB, YCbCr;
+
+            RGB.val[0] = getMappedSample(img, p, 0);
+            RGB.val[1] = getMappedSample(img, p, 1);
+            RGB.val[2] = getMappedSample(img, p, 2);
+            if (img->bytes == 1)
+                YCbCr = iftRGBtoYCbCr(RGB, 255);
+            else
+                YCbCr = iftRGBtoYCbCrBT2020(RGB, rgbBitDepth, ycbcrBitDepth);
+
+            image->val[p] = YCbCr.val[0];
+            image->Cb[p] = (ushort)YCbCr.val[1];
+            image->Cr[p] = (ushort)YCbCr.val[2];
+        }
+    }
+
+    img->image = image;
+    return image;
+}
+
+iftImage *takeMappedIftImage(MappedImage **img)
+{
+    iftImage *image = getMappedIftImage(*img);
+
+    (*img)->image = NULL;
+    closeMappedImage(img);
+    return image;
+}
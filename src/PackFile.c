@@ -0,0 +1,562 @@
+#include "PackFile.h"
+#include <sys/mman.h>
+#include <fcntl.h>
+
+#define PACK_MAGIC "PAK1"
+#define PACK_VERSION 1
+#define PACK_HEADER 64     // Bytes before the first entry (padded to PACK_ALIGNMENT)
+#define PACK_PLANE_ALIGN 64
+#define PACK_MIN_ENTRY 58  // Index bytes of an entry with one plane and empty names (see parsePackIndex)
+
+//=============================================================================
+// Private Prototypes
+//=============================================================================
+void putPack32(uint8_t *buf, uint32_t val);
+void putPack64(uint8_t *buf, uint64_t val);
+uint32_t getPack32(const uint8_t *buf);
+uint64_t getPack64(const uint8_t *buf);
+uint64_t alignPackOffset(uint64_t offset, uint64_t alignment);
+int getPackStemLength(const char *name);
+unsigned int hashPackKey(const char *section, const char *stem, int stem_len);
+int findPackSlot(PackFile *pack, const char *section, const char *stem, int stem_len);
+void buildPackTable(PackFile *pack);
+int comparePackEntries(const void *a, const void *b);
+size_t parsePackIndex(PackFile *pack, const uint8_t *index, uint64_t index_size, uint64_t file_size);
+uint8_t *serializePackIndex(PackFile *pack, uint64_t *index_size);
+void writePackBytes(int fd, const void *buf, size_t size, uint64_t offset);
+
+//=============================================================================
+// Constructors & Deconstructors
+//=============================================================================
+PackFile *openPackFile(const char *path)
+{
+    PackFile *pack;
+    struct stat st;
+    const uint8_t *buf;
+    uint64_t index_offset, index_size;
+
+    pack = (PackFile *)calloc(1, sizeof(PackFile));
+    pack->fd = open(path, O_RDONLY);
+    if (pack->fd == -1)
+        printError("openPackFile", "Could not open %s", path);
+    if (fstat(pack->fd, &st) == -1 || st.st_size < PACK_HEADER)
+        printError("openPackFile", "%s is not a pack file", path);
+
+    pack->map_size = st.st_size;
+    pack->map = mmap(NULL, pack->map_size, PROT_READ, MAP_SHARED, pack->fd, 0);
+    if (pack->map == MAP_FAILED)
+        printError("openPackFile", "Could not map %s", path);
+    buf = (const uint8_t *)pack->map;
+
+    if (memcmp(buf, PACK_MAGIC, 4) != 0 || getPack32(&buf[4]) != PACK_VERSION)
+        printError("openPackFile", "%s is not a pack file", path);
+
+    pack->num_entries = (int)getPack32(&buf[8]);
+    index_offset = getPack64(&buf[16]);
+    index_size = getPack64(&buf[24]);
+    if (index_offset > pack->map_size || index_size > pack->map_size - index_offset)
+        printError("openPackFile", "Truncated index in %s", path);
+    // Checked before the entries are allocated, like each entry is by parsePackIndex
+    if (pack->num_entries < 0 || (uint64_t)pack->num_entries > index_size / PACK_MIN_ENTRY)
+        printError("openPackFile", "Invalid index in %s", path);
+
+    pack->capacity = pack->num_entries;
+    pack->entries = (PackEntry *)calloc(iftMax(pack->capacity, 1), sizeof(PackEntry));
+    if (parsePackIndex(pack, &buf[index_offset], index_size, pack->map_size) != index_size)
+        printError("openPackFile", "Invalid index in %s", path);
+
+    qsort(pack->entries, pack->num_entries, sizeof(PackEntry), comparePackEntries);
+    buildPackTable(pack);
+
+    // Packs are written in evaluation order
+    madvise(pack->map, pack->map_size, MADV_SEQUENTIAL);
+    return pack;
+}
+
+PackFile *appendPackFile(const char *path)
+{
+    PackFile *pack;
+    struct stat st;
+    uint8_t header[PACK_HEADER];
+
+    pack = (PackFile *)calloc(1, sizeof(PackFile));
+    pack->writable = true;
+    pack->fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (pack->fd == -1 || fstat(pack->fd, &st) == -1)
+        printError("appendPackFile", "Could not open %s", path);
+
+    if (st.st_size == 0)
+    {
+        pack->end = PACK_ALIGNMENT;
+        pack->capacity = 64;
+        pack->entries = (PackEntry *)calloc(pack->capacity, sizeof(PackEntry));
+    }
+    else
+    {
+        uint64_t index_offset, index_size;
+        uint8_t *index;
+
+        if (pread(pack->fd, header, PACK_HEADER, 0) != PACK_HEADER ||
+            memcmp(header, PACK_MAGIC, 4) != 0 || getPack32(&header[4]) != PACK_VERSION)
+            printError("appendPackFile", "%s is not a pack file", path);
+
+        pack->num_entries = (int)getPack32(&header[8]);
+        index_offset = getPack64(&header[16]);
+        index_size = getPack64(&header[24]);
+        if (index_offset > (uint64_t)st.st_size || index_size > (uint64_t)st.st_size - index_offset)
+            printError("appendPackFile", "Truncated index in %s", path);
+        if (pack->num_entries < 0 || (uint64_t)pack->num_entries > index_size / PACK_MIN_ENTRY)
+            printError("appendPackFile", "Invalid index in %s", path);
+
+        index = (uint8_t *)malloc(iftMax(index_size, 1));
+        if (pread(pack->fd, index, index_size, index_offset) != (ssize_t)index_size)
+            printError("appendPackFile", "Could not read the index of %s", path);
+
+        pack->capacity = iftMax(pack->num_entries, 64);
+        pack->entries = (PackEntry *)calloc(pack->capacity, sizeof(PackEntry));
+        if (parsePackIndex(pack, index, index_size, st.st_size) != index_size)
+            printError("appendPackFile", "Invalid index in %s", path);
+        free(index);
+
+        // The current index stays valid until the new header is written
+        pack->end = alignPackOffset(index_offset + index_size, PACK_ALIGNMENT);
+    }
+
+    buildPackTable(pack);
+    return pack;
+}
+
+void closePackFile(PackFile **pack)
+{
+    if (*pack != NULL)
+    {
+        PackFile *tmp;
+
+        tmp = *pack;
+
+        if (tmp->writable)
+        {
+            uint8_t header[PACK_HEADER] = {0}, *index;
+            uint64_t index_size;
+
+            index = serializePackIndex(tmp, &index_size);
+            writePackBytes(tmp->fd, index, index_size, tmp->end);
+            free(index);
+            if (fsync(tmp->fd) == -1)
+                printError("closePackFile", "Could not sync the pack entries");
+
+            memcpy(header, PACK_MAGIC, 4);
+            putPack32(&header[4], PACK_VERSION);
+            putPack32(&header[8], tmp->num_entries);
+            putPack64(&header[16], tmp->end);
+            putPack64(&header[24], index_size);
+            writePackBytes(tmp->fd, header, PACK_HEADER, 0);
+            if (fsync(tmp->fd) == -1)
+                printError("closePackFile", "Could not sync the pack header");
+        }
+        else
+            munmap(tmp->map, tmp->map_size);
+
+        close(tmp->fd);
+        for (int i = 0; i < tmp->num_entries; i++)
+        {
+            free(tmp->entries[i].section);
+            free(tmp->entries[i].name);
+        }
+        free(tmp->entries);
+        free(tmp->table);
+        free(tmp);
+
+        *pack = NULL;
+    }
+}
+
+//=============================================================================
+// Private Functions
+//=============================================================================
+void putPack32(uint8_t *buf, uint32_t val)
+{
+    for (int i = 0; i < 4; i++)
+        buf[i] = (uint8_t)(val >> (8 * i));
+}
+
+void putPack64(uint8_t *buf, uint64_t val)
+{
+    putPack32(buf, (uint32_t)val);
+    putPack32(&buf[4], (uint32_t)(val >> 32));
+}
+
+uint32_t getPack32(const uint8_t *buf)
+{
+    return (uint32_t)buf[0] | ((uint32_t)buf[1] << 8) | ((uint32_t)buf[2] << 16) | ((uint32_t)buf[3] << 24);
+}
+
+uint64_t getPack64(const uint8_t *buf)
+{
+    return (uint64_t)getPack32(buf) | ((uint64_t)getPack32(&buf[4]) << 32);
+}
+
+uint64_t alignPackOffset(uint64_t offset, uint64_t alignment)
+{
+    return (offset + alignment - 1) / alignment * alignment;
+}
+
+// Length of the name up to its last '.'
+int getPackStemLength(const char *name)
+{
+    const char *dot = strrchr(name, '.');
+    return (dot != NULL) ? (int)(dot - name) : (int)strlen(name);
+}
+
+// FNV-1a of section, '/' and stem
+unsigned int hashPackKey(const char *section, const char *stem, int stem_len)
+{
+    unsigned int h = 2166136261u;
+
+    for (const char *c = section; *c != '\0'; c++)
+        h = (h ^ (unsigned char)*c) * 16777619u;
+    h = (h ^ '/') * 16777619u;
+    for (int i = 0; i < stem_len; i++)
+        h = (h ^ (unsigned char)stem[i]) * 16777619u;
+    return h;
+}
+
+// Slot of the entry with this section and stem, or the empty slot where it would be
+int findPackSlot(PackFile *pack, const char *section, const char *stem, int stem_len)
+{
+    int slot = hashPackKey(section, stem, stem_len) & (pack->table_size - 1);
+
+    while (pack->table[slot] != -1)
+    {
+        PackEntry *entry = &pack->entries[pack->table[slot]];
+
+        if (getPackStemLength(entry->name) == stem_len && strncmp(entry->name, stem, stem_len) == 0 &&
+            strcmp(entry->section, section) == 0)
+            break;
+        slot = (slot + 1) & (pack->table_size - 1);
+    }
+    return slot;
+}
+
+void buildPackTable(PackFile *pack)
+{
+    free(pack->table);
+    pack->table_size = 64;
+    while (pack->table_size < 2 * iftMax(pack->num_entries, pack->capacity))
+        pack->table_size <<= 1;
+    pack->table = (int *)malloc(pack->table_size * sizeof(int));
+    memset(pack->table, -1, pack->table_size * sizeof(int));
+
+    for (int i = 0; i < pack->num_entries; i++)
+    {
+        PackEntry *entry = &pack->entries[i];
+        pack->table[findPackSlot(pack, entry->section, entry->name, getPackStemLength(entry->name))] = i;
+    }
+}
+
+int comparePackEntries(const void *a, const void *b)
+{
+    const PackEntry *x = (const PackEntry *)a, *y = (const PackEntry *)b;
+    int cmp = strcmp(x->section, y->section);
+
+    return (cmp != 0) ? cmp : strcmp(x->name, y->name);
+}
+
+// Index record: offset, size (uint64), xsize, ysize, zsize (int32), dx, dy, dz (float32),
+// num_planes (uint8), per plane width (uint8), min_val (int32), offset (uint64), then the
+// section and name lengths (uint16) and strings. Returns the parsed bytes
+size_t parsePackIndex(PackFile *pack, const uint8_t *index, uint64_t index_size, uint64_t file_size)
+{
+    size_t pos = 0;
+
+    for (int i = 0; i < pack->num_entries; i++)
+    {
+        PackEntry *entry = &pack->entries[i];
+        int len[2];
+
+        if (index_size - pos < 41)
+            return 0;
+        entry->offset = getPack64(&index[pos]);
+        entry->size = getPack64(&index[pos + 8]);
+        entry->xsize = (int)getPack32(&index[pos + 16]);
+        entry->ysize = (int)getPack32(&index[pos + 20]);
+        entry->zsize = (int)getPack32(&index[pos + 24]);
+        memcpy(&entry->dx, &index[pos + 28], sizeof(float));
+        memcpy(&entry->dy, &index[pos + 32], sizeof(float));
+        memcpy(&entry->dz, &index[pos + 36], sizeof(float));
+        entry->num_planes = index[pos + 40];
+        pos += 41;
+
+        if (entry->num_planes != 1 && entry->num_planes != 3)
+            return 0;
+        if (index_size - pos < 13 * (size_t)entry->num_planes + 4)
+            return 0;
+        for (int c = 0; c < entry->num_planes; c++)
+        {
+            entry->width[c] = index[pos];
+            entry->min_val[c] = (int)getPack32(&index[pos + 1]);
+            entry->plane_offset[c] = getPack64(&index[pos + 5]);
+            pos += 13;
+        }
+
+        len[0] = index[pos] | (index[pos + 1] << 8);
+        len[1] = index[pos + 2] | (index[pos + 3] << 8);
+        pos += 4;
+        if (index_size - pos < (size_t)len[0] + len[1])
+            return 0;
+        entry->section = strndup((const char *)&index[pos], len[0]);
+        entry->name = strndup((const char *)&index[pos + len[0]], len[1]);
+        pos += len[0] + len[1];
+
+        // The planes must lie in the entry, and the entry in the file
+        if (entry->xsize <= 0 || entry->ysize <= 0 || entry->zsize <= 0 || entry->offset > file_size ||
+            entry->size > file_size - entry->offset)
+            return 0;
+        for (int c = 0; c < entry->num_planes; c++)
+        {
+            uint64_t n = (uint64_t)entry->xsize * entry->ysize * entry->zsize;
+
+            if ((entry->width[c] != 1 && entry->width[c] != 2 && entry->width[c] != 4) ||
+                entry->plane_offset[c] > entry->size || n * entry->width[c] > entry->size - entry->plane_offset[c])
+                return 0;
+        }
+    }
+
+    return pos;
+}
+
+uint8_t *serializePackIndex(PackFile *pack, uint64_t *index_size)
+{
+    size_t size = 0, pos = 0;
+    uint8_t *index;
+
+    for (int i = 0; i < pack->num_entries; i++)
+        size += 41 + 13 * pack->entries[i].num_planes + 4 + strlen(pack->entries[i].section) + strlen(pack->entries[i].name);
+    index = (uint8_t *)malloc(iftMax(size, 1));
+
+    for (int i = 0; i < pack->num_entries; i++)
+    {
+        PackEntry *entry = &pack->entries[i];
+        int len[2] = {(int)strlen(entry->section), (int)strlen(entry->name)};
+
+        putPack64(&index[pos], entry->offset);
+        putPack64(&index[pos + 8], entry->size);
+        putPack32(&index[pos + 16], entry->xsize);
+        putPack32(&index[pos + 20], entry->ysize);
+        putPack32(&index[pos + 24], entry->zsize);
+        memcpy(&index[pos + 28], &entry->dx, sizeof(float));
+        memcpy(&index[pos + 32], &entry->dy, sizeof(float));
+        memcpy(&index[pos + 36], &entry->dz, sizeof(float));
+        index[pos + 40] = (uint8_t)entry->num_planes;
+        pos += 41;
+
+        for (int c = 0; c < entry->num_planes; c++)
+        {
+            index[pos] = (uint8_t)entry->width[c];
+            putPack32(&index[pos + 1], entry->min_val[c]);
+            putPack64(&index[pos + 5], entry->plane_offset[c]);
+            pos += 13;
+        }
+
+        index[pos] = len[0] & 0xFF;
+        index[pos + 1] = len[0] >> 8;
+        index[pos + 2] = len[1] & 0xFF;
+        index[pos + 3] = len[1] >> 8;
+        pos += 4;
+        memcpy(&index[pos], entry->section, len[0]);
+        memcpy(&index[pos + len[0]], entry->name, len[1]);
+        pos += len[0] + len[1];
+    }
+
+    *index_size = size;
+    return index;
+}
+
+void writePackBytes(int fd, const void *buf, size_t size, uint64_t offset)
+{
+    const uint8_t *bytes = (const uint8_t *)buf;
+
+    while (size > 0)
+    {
+        ssize_t written = pwrite(fd, bytes, size, offset);
+
+        if (written <= 0)
+            printError("writePackBytes", "Could not write the pack file");
+        bytes += written;
+        size -= written;
+        offset += written;
+    }
+}
+
+//=============================================================================
+// Functions
+//=============================================================================
+PackEntry *findPackEntry(PackFile *pack, const char *section, const char *stem)
+{
+    int slot = findPackSlot(pack, section, stem, (int)strlen(stem));
+
+    return (pack->table[slot] != -1) ? &pack->entries[pack->table[slot]] : NULL;
+}
+
+PackEntry *findPackSection(PackFile *pack, const char *section, int *count)
+{
+    int first = 0, last = pack->num_entries;
+
+    // Lower bound of the section (entries are sorted by section first)
+    while (first < last)
+    {
+        int mid = (first + last) / 2;
+
+        if (strcmp(pack->entries[mid].section, section) < 0)
+            first = mid + 1;
+        else
+            last = mid;
+    }
+
+    *count = 0;
+    while (first + *count < pack->num_entries && strcmp(pack->entries[first + *count].section, section) == 0)
+        (*count)++;
+
+    return (*count > 0) ? &pack->entries[first] : NULL;
+}
+
+iftImage *readPackImage(PackFile *pack, PackEntry *entry)
+{
+    iftImage *img;
+
+    if (pack->writable)
+        printError("readPackImage", "The pack is open for writing");
+
+    img = iftCreateImage(entry->xsize, entry->ysize, entry->zsize);
+    img->dx = entry->dx;
+    img->dy = entry->dy;
+    img->dz = entry->dz;
+    if (entry->num_planes == 3)
+    {
+        img->Cb = iftAllocUShortArray(img->n);
+        img->Cr = iftAllocUShortArray(img->n);
+    }
+
+    for (int c = 0; c < entry->num_planes; c++)
+    {
+        const uint8_t *plane = (const uint8_t *)pack->map + entry->offset + entry->plane_offset[c];
+        int width = entry->width[c], min_val = entry->min_val[c], *val = img->val;
+        ushort *chroma = (c == 1) ? img->Cb : img->Cr;
+
+#pragma omp parallel for
+        for (int p = 0; p < img->n; p++)
+        {
+            int v;
+
+            if (width == 1)
+                v = min_val + plane[p];
+            else if (width == 2)
+                v = min_val + (plane[2 * p] | (plane[2 * p + 1] << 8));
+            else
+                v = (int)((int64_t)min_val + getPack32(&plane[4 * (size_t)p]));
+
+            if (c == 0)
+                val[p] = v;
+            else
+                chroma[p] = (ushort)v;
+        }
+    }
+
+    return img;
+}
+
+void addPackImage(PackFile *pack, const char *section, const char *name, iftImage *img)
+{
+    PackEntry entry;
+    uint64_t size = 0;
+    uint8_t *buf;
+    int slot;
+
+    if (!pack->writable)
+        printError("addPackImage", "The pack is open for reading");
+
+    memset(&entry, 0, sizeof(PackEntry));
+    entry.xsize = img->xsize;
+    entry.ysize = img->ysize;
+    entry.zsize = img->zsize;
+    entry.dx = img->dx;
+    entry.dy = img->dy;
+    entry.dz = img->dz;
+    entry.num_planes = iftIsColorImage(img) ? 3 : 1;
+
+    // Each plane at its smallest width
+    for (int c = 0; c < entry.num_planes; c++)
+    {
+        int min_val = INT_MAX, max_val = INT_MIN;
+
+#pragma omp parallel for reduction(min : min_val) reduction(max : max_val)
+        for (int p = 0; p < img->n; p++)
+        {
+            int v = (c == 0) ? img->val[p] : (c == 1) ? img->Cb[p] : img->Cr[p];
+            if (v < min_val)
+                min_val = v;
+            if (v > max_val)
+                max_val = v;
+        }
+
+        int64_t range = (int64_t)max_val - min_val;
+        entry.width[c] = (range < 256) ? 1 : (range < 65536) ? 2 : 4;
+        entry.min_val[c] = min_val;
+        entry.plane_offset[c] = size;
+        size = alignPackOffset(size + (uint64_t)img->n * entry.width[c], PACK_PLANE_ALIGN);
+    }
+    entry.size = size;
+    entry.offset = pack->end;
+
+    buf = (uint8_t *)calloc(size, 1);
+    for (int c = 0; c < entry.num_planes; c++)
+    {
+        uint8_t *plane = &buf[entry.plane_offset[c]];
+        int width = entry.width[c], min_val = entry.min_val[c];
+
+#pragma omp parallel for
+        for (int p = 0; p < img->n; p++)
+        {
+            int v = (c == 0) ? img->val[p] : (c == 1) ? img->Cb[p] : img->Cr[p];
+            uint32_t u = (uint32_t)((int64_t)v - min_val);
+
+            if (width == 1)
+                plane[p] = (uint8_t)u;
+            else if (width == 2)
+            {
+                plane[2 * p] = (uint8_t)u;
+                plane[2 * p + 1] = (uint8_t)(u >> 8);
+            }
+            else
+                putPack32(&plane[4 * (size_t)p], u);
+        }
+    }
+    writePackBytes(pack->fd, buf, size, entry.offset);
+    free(buf);
+    pack->end = alignPackOffset(entry.offset + size, PACK_ALIGNMENT);
+
+    entry.section = iftCopyString("%s", section);
+    entry.name = iftCopyString("%s", name);
+
+    slot = findPackSlot(pack, section, name, getPackStemLength(name));
+    if (pack->table[slot] != -1)
+    {
+        // Replaced: the previous data becomes unreferenced
+        PackEntry *old = &pack->entries[pack->table[slot]];
+
+        free(old->section);
+        free(old->name);
+        *old = entry;
+        return;
+    }
+
+    if (pack->num_entries == pack->capacity)
+    {
+        pack->capacity *= 2;
+        pack->entries = (PackEntry *)realloc(pack->entries, pack->capacity * sizeof(PackEntry));
+    }
+    pack->entries[pack->num_entries] = entry;
+    pack->table[slot] = pack->num_entries++;
+    if (2 * pack->num_entries > pack->table_size)
+        buildPackTable(pack);
+}
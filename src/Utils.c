@@ -1,4 +1,7 @@
 #include "Utils.h"
+#include <omp.h>
+
+static __thread ErrorTrap *errorTrap = NULL;
 
 //=============================================================================
 // Void
@@ -12,6 +15,7 @@ void printError(const char* function_name, const char* message, ...)
     vsprintf(full_msg, message, args);
     va_end(args);
 
+    trapError(function_name, full_msg);
     fprintf(stderr, "\nError in %s:\n%s!\n", function_name, full_msg);
     fflush(stdout);
     exit(-1);
@@ -43,4 +47,67 @@ char *parseArgs(char *argv[], int argc, const char *stringKey){
         }
     }
     return "-";
-}
\ No newline at end of file
+}
+
+void setErrorTrap(ErrorTrap *trap)
+{
+    if (trap == NULL)
+    {
+        errorTrap = (errorTrap != NULL) ? errorTrap->outer : NULL;
+        return;
+    }
+    trap->level = omp_get_level();
+    trap->message[0] = '\0';
+    trap->outer = errorTrap;
+    trap->num_cleanups = 0;
+    errorTrap = trap;
+}
+
+void trapError(const char *function_name, const char *message)
+{
+    ErrorTrap *trap = errorTrap;
+
+    // Jumping out of a parallel region is undefined, so its errors still exit
+    if (trap == NULL || omp_get_level() != trap->level)
+        return;
+    errorTrap = trap->outer; // An error in a cleanup goes to the outer trap
+    snprintf(trap->message, sizeof(trap->message), "%s: %s", function_name, message);
+    for (int i = trap->num_cleanups - 1; i >= 0; i--)
+        if (i < MAX_ERROR_CLEANUPS)
+            trap->cleanups[i](trap->refs[i]);
+    longjmp(trap->env, 1);
+}
+
+void pushErrorCleanup(ErrorCleanup cleanup, void *ref)
+{
+    ErrorTrap *trap = errorTrap;
+
+    if (trap == NULL || omp_get_level() != trap->level)
+        return;
+    if (trap->num_cleanups < MAX_ERROR_CLEANUPS)
+    {
+        trap->cleanups[trap->num_cleanups] = cleanup;
+        trap->refs[trap->num_cleanups] = ref;
+    }
+    trap->num_cleanups++;
+}
+
+void popErrorCleanup(void)
+{
+    ErrorTrap *trap = errorTrap;
+
+    if (trap == NULL || omp_get_level() != trap->level || trap->num_cleanups == 0)
+        return;
+    trap->num_cleanups--;
+}
+
+void freeOnError(void *ref)
+{
+    free(*(void **)ref);
+}
+
+void closeOnError(void *ref)
+{
+    if (*(FILE **)ref != NULL)
+        fclose(*(FILE **)ref);
+}
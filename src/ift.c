@@ -9,6 +9,9 @@
 *             afalcao@ic.unicamp.br
 \*****************************************************************************/
 #include "ift.h"
+#include "LabelFile.h"
+#include "MappedImage.h"
+#include "CSVImage.h"
 
 
 // ---------- iftBasicDataTypes.c start 
@@ -1088,6 +1091,8 @@ void iftDestroyBMap(iftBMap **bmap)
 // ---------- iftImage.c start
 #if IFT_LIBPNG
 #include <png.h>
+#include <zlib.h>
+#include <omp.h>
 #endif
 #if IFT_LIBJPEG
 #include <jpeglib.h>
@@ -1108,28 +1113,33 @@ iftImage *iftReadImageByExt(const char *format, ...)
     iftImage *img = NULL;
     char *ext = iftLowerString(iftFileExt(filename));
 
+    pushErrorCleanup(freeOnError, &ext);
     if(iftCompareStrings(ext, ".png")) {
         img = iftReadImagePNG(filename);
     }
-    else if (iftCompareStrings(ext, ".pgm")){
-        FILE *fp = fopen(filename,"r");
-        char type[10];
-        if(fscanf(fp,"%s",type)!=1) iftError("Reading Error", "iftReadImageByExt");
-        if (iftCompareStrings(type,"P5")){
-            fclose(fp);
-            img   = iftReadImageP5(filename);
-        } else {
-            fclose(fp);
-            img   = iftReadImageP2(filename);
+    else if (iftCompareStrings(ext, ".pgm") || iftCompareStrings(ext, ".ppm")){
+        // Binary P5/P6 are mapped and widened in parallel; P2 is parsed as text
+        MappedImage *mapped = openMappedImage(filename);
+        bool gray = iftCompareStrings(ext, ".pgm");
+
+        if (mapped != NULL && mapped->channels == (gray ? 1 : 3))
+            img = takeMappedIftImage(&mapped);
+        else {
+            closeMappedImage(&mapped);
+            img = gray ? iftReadImageP2(filename) : iftReadImageP6(filename);
         }
-    } else if (iftCompareStrings(ext, ".ppm")){
-        img   = iftReadImageP6(filename);
     } else if (iftCompareStrings(ext, ".scn")){
         img   = iftReadImage(filename);
     } else if (iftCompareStrings(ext, ".jpg") || iftCompareStrings(ext, ".jpeg")){
         img = iftReadImageJPEG(filename);
+        if (img == NULL)
+            iftError("Could not decode %s", "iftReadImageByExt", filename);
+    } else if (iftCompareStrings(ext, ".lbl")){
+        img = readLabelFile(filename);
+    } else if (iftCompareStrings(ext, ".csv")){
+        img = readCSVLabels(filename);
     } else {
-        iftError("Invalid image format: \"%s\" - Try .scn, .ppm, .pgm, .jpg, .png",
+        iftError("Invalid image format: \"%s\" - Try .scn, .ppm, .pgm, .jpg, .png, .lbl, .csv",
                  "iftReadImageByExt", ext);
     }
 
@@ -1146,10 +1156,39 @@ iftImage *iftReadImageByExt(const char *format, ...)
       img->Cr[p]=((float)RGB.val[2]);
     }*/
 
+    popErrorCleanup();
     iftFree(ext);
     return(img);
 }
 
+iftImage *iftReadImageBufferByExt(const char *filename, const void *buf, size_t size)
+{
+    iftImage *img = NULL;
+    char *ext = iftLowerString(iftFileExt(filename));
+
+    if (iftCompareStrings(ext, ".png") || iftCompareStrings(ext, ".jpg") || iftCompareStrings(ext, ".jpeg")) {
+        // The stream decoders read the buffer through a memory stream
+        FILE *fp = (size > 0) ? fmemopen((void *)buf, size, "rb") : NULL;
+
+        if (fp != NULL) {
+            img = iftCompareStrings(ext, ".png") ? iftReadImagePNGFile(fp, filename) : iftReadImageJPEGFile(fp);
+            fclose(fp);
+        }
+    } else if (iftCompareStrings(ext, ".pgm") || iftCompareStrings(ext, ".ppm")) {
+        MappedImage *mapped = openMappedImageBuffer(buf, size);
+
+        if (mapped != NULL && mapped->channels == (iftCompareStrings(ext, ".pgm") ? 1 : 3))
+            img = takeMappedIftImage(&mapped);
+        else
+            closeMappedImage(&mapped);
+    } else if (iftCompareStrings(ext, ".csv")) {
+        img = parseCSVLabels((const char *)buf, size, filename);
+    }
+
+    iftFree(ext);
+    return img;
+}
+
 iftImage  *iftCreateImage(int xsize,int ysize,int zsize) 
 {
     int *val = iftAllocIntArray(xsize*ysize*zsize);
@@ -1186,6 +1225,20 @@ void iftDestroyImage(iftImage **img)
     }
 }
 
+// ErrorCleanup of the image being read (see pushErrorCleanup)
+static void destroyImageOnError(void *img)
+{
+    iftDestroyImage((iftImage **) img);
+}
+
+// .pgm images are written as ASCII P2 only on request (iftSetPGMAscii)
+static bool ift_pgm_ascii = false;
+
+void iftSetPGMAscii(bool ascii)
+{
+    ift_pgm_ascii = ascii;
+}
+
 void iftWriteImageByExt(const iftImage *img, const char *format, ...) 
 {
     if (img == NULL)
@@ -1212,23 +1265,35 @@ void iftWriteImageByExt(const iftImage *img, const char *format, ...)
         } else if (iftCompareStrings(ext, ".scn")) {
             iftWriteImage(img, filename);
         }else if (iftCompareStrings(ext, ".pgm")) {
-            if (iftMaximumValue(img)>255)
+            int min, max;
+            iftMinMaxValues(img, &min, &max);
+            // Binary 8/16-bit P5, unless ASCII is requested or the values do not fit in 16 bits
+            if (ift_pgm_ascii || min < 0 || max > 65535)
                 iftWriteImageP2(img,filename);
             else
                 iftWriteImageP5(img,filename);
         } else if (iftCompareStrings(ext, ".ppm")){
             iftWriteImageP6(img,filename);
+        } else if (iftCompareStrings(ext, ".lbl")){
+            writeLabelFile(img,filename);
         } else if (iftIsColorImage(img)){
-            iftWriteImageP6(img,"temp.ppm");
-            sprintf(command,"convert temp.ppm %s",filename);
+            // Unique temporary file, so concurrent writes do not share it
+            char tmp_file[] = "/tmp/iftTempXXXXXX.ppm";
+            int fd = mkstemps(tmp_file, 4);
+            if (fd == -1)
+                iftError("Cannot create a temporary file", "iftWriteImageByExt");
+            close(fd);
+
+            iftWriteImageP6(img,tmp_file);
+            sprintf(command,"convert %s %s",tmp_file,filename);
             if (system(command)==-1)
                 iftError("Program convert failed or is not installed", "iftWriteImageByExt");
-            if (system("rm -f temp.ppm")==-1)
-                iftError("Cannot remore temp.ppm", "iftWriteImageByExt");
+            if (remove(tmp_file)==-1)
+                iftError("Cannot remove %s", "iftWriteImageByExt", tmp_file);
         } else if(iftCompareStrings(ext, ".jpg") || iftCompareStrings(ext, ".jpeg")) {
             iftWriteImageJPEG(img,filename);
         } else {
-            printf("Invalid image format: %s. Please select among the accepted ones: .scn, .ppm, .pgm, .png\n",ext);
+            printf("Invalid image format: %s. Please select among the accepted ones: .scn, .ppm, .pgm, .png, .lbl\n",ext);
             exit(-1);
         }
 
@@ -1407,14 +1472,11 @@ iftImage *iftReadImage(const char *format, ...)
 }
 
 #if IFT_LIBPNG
-png_bytep* iftReadPngImageAux(const char *file_name, png_structp *png_ptr, png_infop *info_ptr)
+png_bytep* iftReadPngImageAux(FILE *fp, const char *file_name, png_structp *png_ptr, png_infop *info_ptr)
 {
     png_byte header[8];    // 8 is the maximum size that can be checked
 
-    /* open file and test for it being a png */
-    FILE *fp = fopen(file_name, "rb");
-    if (!fp)
-        iftError("File %s could not be opened for reading", "iftReadPngImageAux", file_name);
+    /* test for it being a png */
     if (fread(header, 1, 8, fp)!=8) iftError("Reading error", "iftReadPngImageAux");
     if (png_sig_cmp(header, 0, 8))
         iftError("File %s is not recognized as a PNG file", "iftReadPngImageAux", file_name);
@@ -1436,11 +1498,15 @@ png_bytep* iftReadPngImageAux(const char *file_name, png_structp *png_ptr, png_i
     }
 
 
-    if (!(*info_ptr))
+    if (!(*info_ptr)) {
+        png_destroy_read_struct(png_ptr, NULL, NULL);
         iftError("Internal error: png_create_info_struct failed", "iftReadImagePNG");
+    }
 
-    if (setjmp(png_jmpbuf(*png_ptr)))
+    if (setjmp(png_jmpbuf(*png_ptr))) {
+        png_destroy_read_struct(png_ptr, info_ptr, NULL);
         iftError("Internal error: Error during init_io", "iftReadImagePNG");
+    }
 
 
     png_init_io(*png_ptr, fp);
@@ -1456,19 +1522,23 @@ png_bytep* iftReadPngImageAux(const char *file_name, png_structp *png_ptr, png_i
     png_read_update_info(*png_ptr, *info_ptr);
 
 
-    /* read file */
-    if (setjmp(png_jmpbuf(*png_ptr)))
-        iftError("Internal error: Error during read_image", "iftReadImagePNG");
-
+    // Allocated before the setjmp, so the rows can be released after a longjmp
     row_pointers = (png_bytep*) iftAlloc(height, sizeof(png_bytep));
     for (int y=0; y<height; y++)
         row_pointers[y] = (png_byte*) iftAlloc(png_get_rowbytes(*png_ptr, *info_ptr), 1);
 
+    /* read file */
+    if (setjmp(png_jmpbuf(*png_ptr))) {
+        for (int y=0; y<height; y++)
+            iftFree(row_pointers[y]);
+        iftFree(row_pointers);
+        png_destroy_read_struct(png_ptr, info_ptr, NULL);
+        iftError("Internal error: Error during read_image", "iftReadImagePNG");
+    }
+
 
     png_read_image(*png_ptr, row_pointers);
 
-    fclose(fp);
-
     return row_pointers;
 }
 #endif
@@ -1483,11 +1553,30 @@ iftImage* iftReadImagePNG(const char* format, ...)
     vsprintf(filename, format, args);
     va_end(args);
 
+    FILE *fp = fopen(filename, "rb");
+    if (!fp)
+        iftError("File %s could not be opened for reading", "iftReadImagePNG", filename);
+
+    pushErrorCleanup(closeOnError, &fp);
+    iftImage *img = iftReadImagePNGFile(fp, filename);
+    popErrorCleanup();
+    fclose(fp);
+
+    return img;
+    #else
+    iftError("LibPNG support was not enabled!","iftReadImagePNG");
+    return NULL;
+    #endif
+}
+
+iftImage *iftReadImagePNGFile(FILE *fp, const char *filename)
+{
+    #if IFT_LIBPNG
     png_infop info_ptr;
     png_structp png_ptr;
     png_bytep *row_pointers;
 
-    row_pointers = iftReadPngImageAux(filename, &png_ptr, &info_ptr);
+    row_pointers = iftReadPngImageAux(fp, filename, &png_ptr, &info_ptr);
 
     int width, height, color_type, depth;
 
@@ -1615,7 +1704,7 @@ iftImage* iftReadImagePNG(const char* format, ...)
 
     return img;
     #else
-    iftError("LibPNG support was not enabled!","iftReadImagePNG");
+    iftError("LibPNG support was not enabled!","iftReadImagePNGFile");
     return NULL;
     #endif
 }
@@ -1625,12 +1714,51 @@ iftImage* iftReadImageJPEG(const char* format, ...)
     #if IFT_LIBJPEG
     va_list args;
     char filename[IFT_STR_DEFAULT_SIZE];
+    FILE *infile;
+    iftImage *image;
 
     va_start(args, format);
     vsprintf(filename, format, args);
     va_end(args);
 
-    iftImage* image = NULL;
+    /* VERY IMPORTANT: use "b" option to fopen() if you are on a machine that
+     * requires it in order to read binary files.
+     */
+    if ((infile = fopen(filename, "rb")) == NULL) {
+        printf("[readImageJPEG] can't open %s\n",filename);
+        return NULL;
+    }
+
+    pushErrorCleanup(closeOnError, &infile);
+    image = iftReadImageJPEGFile(infile);
+    popErrorCleanup();
+    fclose(infile);
+
+    return image;
+    #else
+    iftError("LibJPEG support was not enabled!","iftReadImageJPEG");
+    return NULL;
+    #endif
+}
+
+#if IFT_LIBJPEG
+// JPEG error handler that returns to the decoder (see example.c) instead of exiting
+typedef struct {
+    struct jpeg_error_mgr pub;
+    jmp_buf setjmp_buffer;
+} iftJpegErrorMgr;
+
+static void iftJpegErrorExit(j_common_ptr cinfo)
+{
+    (*cinfo->err->output_message)(cinfo);
+    longjmp(((iftJpegErrorMgr *) cinfo->err)->setjmp_buffer, 1);
+}
+#endif
+
+iftImage *iftReadImageJPEGFile(FILE *infile)
+{
+    #if IFT_LIBJPEG
+    iftImage *volatile image = NULL; // Read after the longjmp
     //code based on externals/libjpeg/source/example.c
     /* This struct contains the JPEG decompression parameters and pointers to
 * working space (which is allocated as needed by the JPEG library).
@@ -1640,38 +1768,29 @@ iftImage* iftReadImageJPEG(const char* format, ...)
 * Note that this struct must live as long as the main JPEG parameter
 * struct, to avoid dangling-pointer problems.
 */
-    struct jpeg_error_mgr jerr;
+    iftJpegErrorMgr jerr;
 
     /* More stuff */
-    FILE * infile;		/* source file */
     JSAMPARRAY buffer;		/* Output row buffer */
     int row_stride;		/* physical row width in output buffer */
-    /* In this example we want to open the input file before doing anything else,
- * so that the setjmp() error recovery below can assume the file is open.
- * VERY IMPORTANT: use "b" option to fopen() if you are on a machine that
- * requires it in order to read binary files.
+    /* The input file is opened (and closed) by the caller, so the setjmp() error
+ * recovery below can assume the file is open.
  */
 
-    if ((infile = fopen(filename, "rb")) == NULL) {
-        printf("[readImageJPEG] can't open %s\n",filename);
-        return NULL;
-    }
-
     /* Step 1: allocate and initialize JPEG decompression object */
 
     /* We set up the normal JPEG error routines, then override error_exit. */
-    cinfo.err = jpeg_std_error(&jerr);
-    //jerr.pub.error_exit = my_error_exit;
+    cinfo.err = jpeg_std_error(&jerr.pub);
+    jerr.pub.error_exit = iftJpegErrorExit;
 
-    /* Establish the setjmp return context for my_error_exit to use. */
-    jmp_buf setjmp_buffer;
-    if (setjmp(setjmp_buffer)) {
+    /* Establish the setjmp return context for iftJpegErrorExit to use. */
+    if (setjmp(jerr.setjmp_buffer)) {
         /* If we get here, the JPEG code has signaled an error.
-         * We need to clean up the JPEG object, close the input file, and return.
+         * We need to clean up the JPEG object and the image, and return.
          */
         jpeg_destroy_decompress(&cinfo);
+        iftDestroyImage((iftImage **) &image);
         printf("[readImageJPEG] code has signaled an error\n");
-        fclose(infile);
         return NULL;
     }
 
@@ -1833,11 +1952,15 @@ iftImage* iftReadImageJPEG(const char* format, ...)
             break;
         case JCS_EXT_RGB:
     
+            jpeg_destroy_decompress(&cinfo);
+            iftDestroyImage((iftImage **) &image);
             iftError("Big gamut red/green/blue color space not supported", "iftReadImageJPEG");
 
             break;
         default:
     
+            jpeg_destroy_decompress(&cinfo);
+            iftDestroyImage((iftImage **) &image);
             iftError("Unkwon color space", "iftReadImageJPEG");
 
             break;
@@ -1849,13 +1972,6 @@ iftImage* iftReadImageJPEG(const char* format, ...)
     /* This is an important step since it will release a good deal of memory. */
     jpeg_destroy_decompress(&cinfo);
 
-    /* After finish_decompress, we can close the input file.
-     * Here we postpone it until after no more JPEG errors are possible,
-     * so as to simplify the setjmp error logic above.  (Actually, I don't
-     * think that jpeg_destroy can do an error exit, but why assume anything...)
-     */
-
-    fclose(infile);
     /* At this point you may want to check to see whether any corrupt-data
      * warnings occurred (test whether jerr.pub.num_warnings is nonzero).
      */
@@ -1865,7 +1981,7 @@ iftImage* iftReadImageJPEG(const char* format, ...)
 
     return image;
     #else
-    iftError("LibJPEG support was not enabled!","iftReadImageJPEG");
+    iftError("LibJPEG support was not enabled!","iftReadImageJPEGFile");
     return NULL;
     #endif
 }
@@ -1875,9 +1991,8 @@ iftImage *iftReadImageP5(const char *format, ...)
     iftImage *img    = NULL;
     FILE     *fp     = NULL;
     uchar    *data8  = NULL;
-    ushort   *data16 = NULL;
     char     type[10];
-    int      p, v, xsize, ysize, zsize, hi, lo;
+    int      p, v, xsize, ysize, zsize;
 
     va_list args;
     char    filename[IFT_STR_DEFAULT_SIZE];
@@ -1890,6 +2005,8 @@ iftImage *iftReadImageP5(const char *format, ...)
     if (fp == NULL) {
         iftError(MSG_FILE_OPEN_ERROR, "iftReadImageP5", filename);
     }
+    pushErrorCleanup(closeOnError, &fp);
+    pushErrorCleanup(destroyImageOnError, &img);
 
     if (fscanf(fp, "%s\n", type) != 1) {
         iftError("Reading error", "iftReadImageP5");
@@ -1923,21 +2040,17 @@ iftImage *iftReadImageP5(const char *format, ...)
             iftFree(data8);
 
         } else if ((v <= 65535) && (v > 255)) {
-            data16 = iftAllocUShortArray(img->n);
+            // Big-endian samples, read at once and converted in bulk
+            data8 = iftAllocUCharArray(2 * (size_t)img->n);
 
-            for (p = 0; p < img->n; p++) {
-                if ((hi = fgetc(fp)) == EOF)
-                    iftError("Reading error", "iftReadImageP5");
-                if ((lo = fgetc(fp)) == EOF)
-                    iftError("Reading error", "iftReadImageP5");
-
-                data16[p] = (hi << 8) + lo;
-            }
+            if (fread(data8, sizeof(uchar), 2 * (size_t)img->n, fp) != 2 * (size_t)img->n)
+                iftError("Reading error", "iftReadImageP5");
 
+            #pragma omp parallel for
             for (p = 0; p < img->n; p++)
-                img->val[p] = (int) data16[p];
+                img->val[p] = ((int) data8[2 * p] << 8) | data8[2 * p + 1];
 
-            iftFree(data16);
+            iftFree(data8);
 
         } else {
             iftError("Invalid maximum value", "iftReadImageP5");
@@ -1946,6 +2059,8 @@ iftImage *iftReadImageP5(const char *format, ...)
         iftError("Invalid image type", "iftReadImageP5");
     }
 
+    popErrorCleanup();
+    popErrorCleanup();
     fclose(fp);
     return (img);
 }
@@ -1970,6 +2085,8 @@ iftImage *iftReadImageP6(const char *format, ...)
     if (fp == NULL){
         iftError(MSG_FILE_OPEN_ERROR, "iftReadImageP6", filename);
     }
+    pushErrorCleanup(closeOnError, &fp);
+    pushErrorCleanup(destroyImageOnError, &img);
 
     if(fscanf(fp,"%s\n",type)!=1)
         iftError("Reading error", "iftReadImageP6");
@@ -2034,6 +2151,8 @@ iftImage *iftReadImageP6(const char *format, ...)
         iftError("Invalid image type", "iftReadImageP6");
     }
 
+    popErrorCleanup();
+    popErrorCleanup();
     fclose(fp);
     return(img);
 }
@@ -2057,6 +2176,8 @@ iftImage *iftReadImageP2(const char *format, ...)
     if (fp == NULL) {
         iftError(MSG_FILE_OPEN_ERROR, "iftReadImageP2", filename);
     }
+    pushErrorCleanup(closeOnError, &fp);
+    pushErrorCleanup(destroyImageOnError, &img);
 
     if (fscanf(fp, "%s\n", type) != 1)
         iftError("Reading error", "iftReadImageP2");
@@ -2083,6 +2204,8 @@ iftImage *iftReadImageP2(const char *format, ...)
         iftError("Invalid image type", "iftReadImageP2");
     }
 
+    popErrorCleanup();
+    popErrorCleanup();
     fclose(fp);
     return (img);
 }
@@ -2216,9 +2339,8 @@ void iftWriteImage(const iftImage *img, const char *format, ...)
 void iftWriteImageP5(const iftImage *img, const char *format, ...) 
 {
     FILE   *fp     = NULL;
-    int    p, hi, lo;
+    int    p;
     uchar  *data8  = NULL;
-    ushort *data16 = NULL;
 
     va_list args;
     char    filename[IFT_STR_DEFAULT_SIZE];
@@ -2234,34 +2356,28 @@ void iftWriteImageP5(const iftImage *img, const char *format, ...)
     fprintf(fp, "P5\n");
     fprintf(fp, "%d %d\n", img->xsize, img->ysize);
 
-    int img_max_val = iftMaximumValue(img);
-    int img_min_val = iftMinimumValue(img);
+    int img_max_val, img_min_val;
+    iftMinMaxValues(img, &img_min_val, &img_max_val);
 
     if ((img_max_val < 256) && (img_min_val >= 0)) {
         fprintf(fp, "%d\n", 255);
         data8 = iftAllocUCharArray(img->n);
+        #pragma omp parallel for
         for (p = 0; p < img->n; p++)
             data8[p] = (uchar) img->val[p];
         fwrite(data8, sizeof(uchar), img->n, fp);
         iftFree(data8);
     } else if (img_max_val < 65536) {
         fprintf(fp, "%d\n", 65535);
-        data16 = iftAllocUShortArray(img->n);
-        for (p = 0; p < img->n; p++)
-            data16[p] = (ushort) img->val[p];
-
-        {
-#define HI(num) (((num) & 0x0000FF00) >> 8)
-#define LO(num) ((num) & 0x000000FF)
-            for (p = 0; p < img->n; p++) {
-                hi = HI(data16[p]);
-                lo = LO(data16[p]);
-                fputc(hi, fp);
-                fputc(lo, fp);
-            }
+        // Big-endian samples, converted in bulk and written at once
+        data8 = iftAllocUCharArray(2 * (size_t)img->n);
+        #pragma omp parallel for
+        for (p = 0; p < img->n; p++) {
+            data8[2 * p] = (img->val[p] >> 8) & 0xFF;
+            data8[2 * p + 1] = img->val[p] & 0xFF;
         }
-
-        iftFree(data16);
+        fwrite(data8, sizeof(uchar), 2 * (size_t)img->n, fp);
+        iftFree(data8);
     } else {
         char msg[200];
         sprintf(msg, "Cannot write image as P5 (%d/%d)", img_max_val, img_min_val);
@@ -2434,6 +2550,195 @@ void iftWritePngImageAux(const char *file_name, png_bytep *row_pointers, int wid
 
     fclose(fp);
 }
+
+// Compression level of iftWriteImagePNG: -1 uses libpng; 0..9 uses the parallel encoder
+static int ift_png_level = -1;
+
+void iftSetPNGCompression(int level)
+{
+    if (level < -1 || level > 9)
+        iftError("Invalid PNG compression level %d (-1 to 9)", "iftSetPNGCompression", level);
+    ift_png_level = level;
+}
+
+static void iftPutBigEndian32(uchar *buf, uint val)
+{
+    buf[0] = (val >> 24) & 0xFF;
+    buf[1] = (val >> 16) & 0xFF;
+    buf[2] = (val >> 8) & 0xFF;
+    buf[3] = val & 0xFF;
+}
+
+static void iftWritePngChunk(FILE *fp, const char *type, const uchar *data, size_t len)
+{
+    uchar buf[4];
+    uLong crc;
+
+    iftPutBigEndian32(buf, (uint)len);
+    fwrite(buf, 1, 4, fp);
+    fwrite(type, 1, 4, fp);
+    if (len > 0)
+        fwrite(data, 1, len, fp);
+
+    crc = crc32(0L, (const Bytef *)type, 4);
+    if (len > 0)
+        crc = crc32(crc, data, len);
+    iftPutBigEndian32(buf, (uint)crc);
+    fwrite(buf, 1, 4, fp);
+}
+
+static int iftPaethPredictor(int a, int b, int c)
+{
+    int p = a + b - c, pa = abs(p - a), pb = abs(p - b), pc = abs(p - c);
+
+    if (pa <= pb && pa <= pc)
+        return a;
+    return (pb <= pc) ? b : c;
+}
+
+// Writes the filter type and the filtered row to out. Without adaptive filtering, the
+// row is stored as is; otherwise, the filter with the least sum of absolute values is used
+static void iftFilterPngRow(const uchar *row, const uchar *prev, size_t len, int bpp, bool adaptive, uchar *out, uchar *tmp)
+{
+    long best_sum = LONG_MAX;
+
+    out[0] = 0;
+    memcpy(&out[1], row, len);
+    if (!adaptive)
+        return;
+
+    for (int type = 0; type < 5; type++)
+    {
+        long sum = 0;
+
+        for (size_t i = 0; i < len; i++)
+        {
+            int a = (i >= (size_t)bpp) ? row[i - bpp] : 0;
+            int b = (prev != NULL) ? prev[i] : 0;
+            int c = (prev != NULL && i >= (size_t)bpp) ? prev[i - bpp] : 0;
+            int pred = 0;
+
+            if (type == 1) pred = a;
+            else if (type == 2) pred = b;
+            else if (type == 3) pred = (a + b) / 2;
+            else if (type == 4) pred = iftPaethPredictor(a, b, c);
+
+            tmp[i] = (uchar)(row[i] - pred);
+            sum += (tmp[i] < 128) ? tmp[i] : 256 - tmp[i];
+        }
+
+        if (sum < best_sum)
+        {
+            best_sum = sum;
+            out[0] = (uchar)type;
+            memcpy(&out[1], tmp, len);
+        }
+    }
+}
+
+/*
+ * Row chunks are filtered and deflated in parallel as independent raw deflate streams.
+ * All but the last chunk end with Z_FULL_FLUSH (byte aligned, without the final block
+ * bit), so their concatenation is a single deflate stream, and the Adler-32 of the
+ * zlib trailer is combined from the chunks' checksums. Each chunk is written as an IDAT.
+ */
+void iftWritePngImageParallel(const char *file_name, png_bytep *row_pointers, int width, int height, int bit_depth, int color_type, int level)
+{
+    static const uchar signature[8] = {137, 80, 78, 71, 13, 10, 26, 10};
+    int channels, bpp, num_chunks, chunk_rows, num_threads = omp_get_max_threads();
+    size_t row_len;
+    uchar ihdr[13], zheader[2], trailer[4], **chunk_data;
+    size_t *chunk_size;
+    uLong *chunk_adler, adler;
+
+    channels = (color_type == PNG_COLOR_TYPE_GRAY) ? 1 : (color_type == PNG_COLOR_TYPE_GRAY_ALPHA) ? 2 :
+               (color_type == PNG_COLOR_TYPE_RGB) ? 3 : 4;
+    bpp = channels * bit_depth / 8;
+    row_len = (size_t)width * bpp;
+
+    // A few chunks per thread, of at least 256KB (or one row), so the deflate window is used
+    chunk_rows = iftMax((height + 4 * num_threads - 1) / (4 * num_threads), (int)((1 << 18) / (row_len + 1)));
+    chunk_rows = iftMax(iftMin(chunk_rows, height), 1);
+    num_chunks = (height + chunk_rows - 1) / chunk_rows;
+
+    chunk_data = (uchar **)iftAlloc(num_chunks, sizeof(uchar *));
+    chunk_size = (size_t *)iftAlloc(num_chunks, sizeof(size_t));
+    chunk_adler = (uLong *)iftAlloc(num_chunks, sizeof(uLong));
+
+#pragma omp parallel for schedule(dynamic)
+    for (int c = 0; c < num_chunks; c++)
+    {
+        int first = c * chunk_rows, last = iftMin(first + chunk_rows, height);
+        size_t raw_len = (size_t)(last - first) * (row_len + 1);
+        uchar *raw = (uchar *)iftAlloc(raw_len, sizeof(uchar)), *tmp = (uchar *)iftAlloc(row_len, sizeof(uchar));
+        z_stream zs;
+
+        // Filters may use the last row of the previous chunk: only the compression is split
+        for (int y = first; y < last; y++)
+            iftFilterPngRow(row_pointers[y], (y > 0) ? row_pointers[y - 1] : NULL, row_len, bpp, level > 0,
+                            &raw[(size_t)(y - first) * (row_len + 1)], tmp);
+        chunk_adler[c] = adler32(adler32(0L, Z_NULL, 0), raw, raw_len);
+
+        memset(&zs, 0, sizeof(zs));
+        if (deflateInit2(&zs, level, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+            iftError("Internal Error: deflateInit2 failed", "iftWritePngImageParallel");
+
+        size_t bound = deflateBound(&zs, raw_len) + 16;
+        chunk_data[c] = (uchar *)iftAlloc(bound, sizeof(uchar));
+        zs.next_in = raw;
+        zs.avail_in = raw_len;
+        zs.next_out = chunk_data[c];
+        zs.avail_out = bound;
+        if (deflate(&zs, (c == num_chunks - 1) ? Z_FINISH : Z_FULL_FLUSH) == Z_STREAM_ERROR || zs.avail_in != 0)
+            iftError("Internal Error: deflate failed", "iftWritePngImageParallel");
+        chunk_size[c] = bound - zs.avail_out;
+        deflateEnd(&zs);
+
+        iftFree(raw);
+        iftFree(tmp);
+    }
+
+    FILE *fp = fopen(file_name, "wb");
+    if (!fp)
+        iftError("Internal Error: File %s could not be opened for writing", "iftWritePngImageParallel", file_name);
+
+    fwrite(signature, 1, 8, fp);
+    iftPutBigEndian32(&ihdr[0], width);
+    iftPutBigEndian32(&ihdr[4], height);
+    ihdr[8] = bit_depth;
+    ihdr[9] = color_type;
+    ihdr[10] = ihdr[11] = ihdr[12] = 0; // deflate, adaptive filtering, no interlace
+    iftWritePngChunk(fp, "IHDR", ihdr, 13);
+
+    // zlib header: deflate with a 32KB window, and the compression level hint
+    zheader[0] = 0x78;
+    zheader[1] = (level <= 1 ? 0 : level <= 5 ? 1 : level == 6 ? 2 : 3) << 6;
+    zheader[1] += 31 - ((zheader[0] * 256 + zheader[1]) % 31);
+    iftWritePngChunk(fp, "IDAT", zheader, 2);
+
+    adler = chunk_adler[0];
+    for (int c = 0; c < num_chunks; c++)
+    {
+        if (c > 0)
+        {
+            int rows = iftMin(chunk_rows, height - c * chunk_rows);
+            adler = adler32_combine(adler, chunk_adler[c], (z_off_t)rows * (row_len + 1));
+        }
+        iftWritePngChunk(fp, "IDAT", chunk_data[c], chunk_size[c]);
+        iftFree(chunk_data[c]);
+    }
+    iftPutBigEndian32(trailer, (uint)adler);
+    iftWritePngChunk(fp, "IDAT", trailer, 4);
+    iftWritePngChunk(fp, "IEND", NULL, 0);
+    fclose(fp);
+
+    iftFree(chunk_data);
+    iftFree(chunk_size);
+    iftFree(chunk_adler);
+    for (int y = 0; y < height; y++)
+        iftFree(row_pointers[y]);
+    iftFree(row_pointers);
+}
 #endif
 
 void iftWriteImagePNG(const iftImage* img, const char* format, ...) 
@@ -2488,9 +2793,10 @@ void iftWriteImagePNG(const iftImage* img, const char* format, ...)
         row_pointers[y] = (png_byte*) iftAlloc(width, numberOfChannels*byteshift);
 
     if(color_type == PNG_COLOR_TYPE_GRAY){
-        int p = 0;
+        #pragma omp parallel for
         for (int y = 0; y < height; ++y) {
             png_byte* row = row_pointers[y];
+            int p = y * width;
             for (int x=0; x<width; x++) {
                 png_byte* ptr = &(row[x*numberOfChannels*byteshift]);
 
@@ -2505,9 +2811,10 @@ void iftWriteImagePNG(const iftImage* img, const char* format, ...)
             }
         }
     }else if(color_type == PNG_COLOR_TYPE_GRAY_ALPHA){
-        int p = 0;
+        #pragma omp parallel for
         for (int y = 0; y < height; ++y) {
             png_byte* row = row_pointers[y];
+            int p = y * width;
             for (int x=0; x<width; x++) {
                 png_byte* ptr = &(row[x*numberOfChannels*byteshift]);
 
@@ -2529,10 +2836,11 @@ void iftWriteImagePNG(const iftImage* img, const char* format, ...)
             }
         }
     }else if(color_type == PNG_COLOR_TYPE_RGB){
-        iftColor rgb, ycbcr;
-        int p = 0;
+        #pragma omp parallel for
         for (int y = 0; y < height; ++y) {
             png_byte* row = row_pointers[y];
+            iftColor rgb, ycbcr;
+            int p = y * width;
             for (int x=0; x<width; x++) {
                 png_byte* ptr = &(row[x*numberOfChannels*byteshift]);
 
@@ -2561,10 +2869,11 @@ void iftWriteImagePNG(const iftImage* img, const char* format, ...)
         }
 
     }else if(color_type == PNG_COLOR_TYPE_RGB_ALPHA){
-        iftColor rgb, ycbcr;
-        int p = 0;
+        #pragma omp parallel for
         for (int y = 0; y < height; ++y) {
             png_byte* row = row_pointers[y];
+            iftColor rgb, ycbcr;
+            int p = y * width;
             for (int x=0; x<width; x++) {
                 png_byte* ptr = &(row[x*numberOfChannels*byteshift]);
 
@@ -2600,7 +2909,10 @@ void iftWriteImagePNG(const iftImage* img, const char* format, ...)
     };
 
 
-    iftWritePngImageAux(filename, row_pointers, width, height, depth, color_type);
+    if (ift_png_level >= 0)
+        iftWritePngImageParallel(filename, row_pointers, width, height, depth, color_type, ift_png_level);
+    else
+        iftWritePngImageAux(filename, row_pointers, width, height, depth, color_type);
     #else
     iftError("LibPNG support was not enabled!","iftWriteImagePNG");
     #endif
@@ -3856,6 +4168,7 @@ void iftError(const char *msg, const char *func, ...)
     vsprintf(final_msg, msg, args);
     va_end(args);
     
+    trapError(func, final_msg);
     fprintf(stderr, "\nError in %s: \n%s\n", func, final_msg);
     fflush(stdout);
     exit(-1);
@@ -4340,7 +4653,7 @@ void iftMakeDir(const char *dir_path)
             
             if (!iftDirExists(parent_dir)) {
             #if defined(__linux) || defined(__APPLE__)
-                if (mkdir(parent_dir, 0777) == -1) // Create the directory
+                if (mkdir(parent_dir, 0777) == -1 && errno != EEXIST) // Create the directory (another thread may have created it)
                     iftError("Problem to create the directory: %s", "iftMakeDir", dir_path);
             #else
                 if (!CreateDirectory(parent_dir, NULL))